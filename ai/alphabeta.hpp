@@ -2,9 +2,21 @@
 
 #include "tak/tak.hpp"
 #include "tak/ptn.hpp"
+#include "symmetry.hpp"
+#include "evalcache.hpp"
+#include "batch.hpp"
 #include <vector>
 #include <iostream>
 #include <atomic>
+#include <array>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <type_traits>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 template<uint8_t SIZE, typename Evaluator>
 class alphabeta {
@@ -18,23 +30,21 @@ private:
     Score scores[N];
   };
 
-  template<size_t NUM_ENTRIES>
   struct TranspositionTable {
   private:
-    struct InternalEntry {
-      std::atomic<uint64_t> hash;
-      std::atomic<uint64_t> data;
-
-      InternalEntry() : hash(0), data(0) {}
-    };
-
-    std::array<InternalEntry, NUM_ENTRIES> table;
+    // Slide counts go up to SIZE, range goes up to SIZE-1
+    static const int SLIDE_BITS = SIZE < 8 ? 3 : 4;
+    // The packed move has to fit below the direction bits (24-25),
+    // if it doesn't the drop pattern gets a word of its own
+    static const bool WIDE = 3 + (SIZE-1)*SLIDE_BITS > 24;
   public:
     struct Entry {
     private:
       friend struct TranspositionTable;
       uint64_t data;
-      Entry(uint64_t data) : data(data) {}
+      // Slide counts, one byte each (only used for wide entries)
+      uint64_t drops;
+      Entry(uint64_t data, uint64_t drops) : data(data), drops(drops) {}
     public:
       enum Type : uint8_t {
         INVALID = 0, ALPHA = 1, BETA = 2, EXACT = 3,
@@ -45,7 +55,8 @@ private:
       {}
 
       Entry(Type type, int depth, int16_t score, const Move<SIZE>& bestMove) :
-        data((((uint64_t)type&0x3)<<62) | (((uint64_t)depth&0x1FFF)<<49) | ((uint64_t)score&0xFFFF)<<33)
+        data((((uint64_t)type&0x3)<<62) | (((uint64_t)depth&0x1FFF)<<49) | ((uint64_t)score&0xFFFF)<<33),
+        drops(0)
       {
         data |= (static_cast<uint64_t>(bestMove.type())<<32) | (static_cast<uint64_t>(bestMove.idx())<<26);
         switch(bestMove.type()) {
@@ -69,14 +80,18 @@ private:
           }
           data |= bestMove.range();
           for(int i = 1; i < SIZE; i++) {
-            data |= bestMove.slides(i)<<(i*3);
+            if(WIDE) {
+              drops |= static_cast<uint64_t>(bestMove.slides(i))<<((i-1)*8);
+            } else {
+              data |= static_cast<uint64_t>(bestMove.slides(i))<<(i*SLIDE_BITS);
+            }
           }
           break;
           }
         }
       }
 
-      Entry() : data(((uint64_t)INVALID)<<62) {}
+      Entry() : data(((uint64_t)INVALID)<<62), drops(0) {}
 
       Type type() {
         return (Type)(data>>62);
@@ -115,8 +130,13 @@ private:
             dir = Move<SIZE>::Dir::WEST;
             break;
           }
-          for(int i = 0; i < SIZE; i++) {
-            slides[i] = (data>>(i*3))&0x7;
+          slides[0] = data&0x7;
+          for(int i = 1; i < SIZE; i++) {
+            if(WIDE) {
+              slides[i] = (drops>>((i-1)*8))&0xFF;
+            } else {
+              slides[i] = (data>>(i*SLIDE_BITS))&((1<<SLIDE_BITS)-1);
+            }
           }
           return Move<SIZE>(idx, dir, slides[0], &slides[1]);
           }
@@ -128,103 +148,453 @@ private:
       }
     };
 
-    inline util::option<Entry> get(Board<SIZE>& b) {
-      uint64_t hash = b.hash();
-      auto& e = table[hash % NUM_ENTRIES];
-      auto h = e.hash.load(std::memory_order_relaxed);
-      auto d = e.data.load(std::memory_order_relaxed);
-      if(Entry(d).type() == Entry::INVALID || (h ^ d) != hash) {
-        return util::option<Entry>::None;
+  private:
+    // Each entry is stored with its key xor'd against the data
+    // so torn writes from other threads fail verification
+    struct NarrowEntry {
+      std::atomic<uint64_t> hash;
+      std::atomic<uint64_t> data;
+
+      NarrowEntry() : hash(0), data(0) {}
+
+      inline bool load(uint64_t key, Entry& e) {
+        auto h = hash.load(std::memory_order_relaxed);
+        auto d = data.load(std::memory_order_relaxed);
+        e = Entry(d, 0);
+        return e.type() != Entry::INVALID && (h ^ d) == key;
+      }
+
+      inline void store(uint64_t key, const Entry& e) {
+        hash.store(key^e.data, std::memory_order_relaxed);
+        data.store(e.data, std::memory_order_relaxed);
+      }
+    };
+
+    struct WideEntry {
+      std::atomic<uint64_t> hash;
+      std::atomic<uint64_t> data;
+      std::atomic<uint64_t> drops;
+
+      WideEntry() : hash(0), data(0), drops(0) {}
+
+      inline bool load(uint64_t key, Entry& e) {
+        auto h = hash.load(std::memory_order_relaxed);
+        auto d = data.load(std::memory_order_relaxed);
+        auto s = drops.load(std::memory_order_relaxed);
+        e = Entry(d, s);
+        return e.type() != Entry::INVALID && (h ^ d ^ s) == key;
+      }
+
+      inline void store(uint64_t key, const Entry& e) {
+        hash.store(key^e.data^e.drops, std::memory_order_relaxed);
+        data.store(e.data, std::memory_order_relaxed);
+        drops.store(e.drops, std::memory_order_relaxed);
+      }
+    };
+
+    using InternalEntry = typename std::conditional<WIDE, WideEntry, NarrowEntry>::type;
+
+    std::unique_ptr<InternalEntry[]> table;
+    uint64_t mask;
+  public:
+    // 2^bits entries
+    explicit TranspositionTable(int bits = 18) : table(new InternalEntry[(size_t)1 << bits]), mask(((uint64_t)1 << bits)-1) {}
+
+    // The most bits that fit in bytes
+    static int bits_for(size_t bytes) {
+      int bits = 10;
+      while(((size_t)2 << bits)*sizeof(InternalEntry) <= bytes) bits++;
+      return bits;
+    }
+
+    size_t size() const { return mask+1; }
+
+    inline util::option<Entry> get(uint64_t hash) {
+      Entry e;
+      if(table[hash & mask].load(hash, e)) {
+        return util::option<Entry>(e);
       } else {
-        return util::option<Entry>(Entry(d));
+        return util::option<Entry>::None;
       }
     }
 
-    inline void put(Board<SIZE>& b, Entry e) {
-      uint64_t hash = b.hash();
+    inline void put(uint64_t hash, Entry e) {
       // Always replace for now because of MTD-f
       // (we need root node to update the best move!)
       //auto ex = get(b);
       //if(ex && ex->depth() >= e.depth()) return;
-      table[hash % NUM_ENTRIES].hash.store(hash^e.data, std::memory_order_relaxed);
-      table[hash % NUM_ENTRIES].data.store(e.data, std::memory_order_relaxed);
+      table[hash & mask].store(hash, e);
     }
   };
 
+  using Sym = Symmetry<SIZE>;
+  using Acc = typename Evaluator::template Accumulator<SIZE>;
+
   int hits;
+  int node_count;
+
+  using TT = TranspositionTable;
+  std::shared_ptr<TT> ttable;
 
-  //using TT = TranspositionTable<(1<<25)>;
-  using TT = TranspositionTable<(1<<18)>;
-  std::unique_ptr<TT> ttable;
+  using EC = EvalCache<Score, (1<<16)>;
+  std::unique_ptr<EC> ecache;
+  int ecache_probes;
+  int ecache_hits;
 
   std::vector<KillerMove<2>> killer_moves;
-  std::chrono::steady_clock::time_point start;
-  std::chrono::steady_clock::time_point end;
+  std::chrono::steady_clock::time_point start_time;
+  std::chrono::steady_clock::time_point end_time;
   int leaf_count;
 
   const static int NULL_MOVE_REDUCTION = 3;
-public:
-  Score search(Board<SIZE>& state, Move<SIZE>& bestMove, int max_depth) {
-    std::chrono::duration<double> time_span;
 
+  // Key the ttable on the canonical orientation of each position
+  bool symmetric = false;
+
+  // Where searches say how they're going, if anywhere
+  std::ostream* log = &std::cout;
+
+  // Score the children of depth 1 nodes all at once with BatchEval
+  bool batch = false;
+
+  // The key a position is stored under in the ttable, and the symmetry
+  // taking moves from the board's orientation to the stored one
+  inline uint64_t key(Board<SIZE>& state, const typename Sym::Hashes& sym, int& orientation) {
+    if(!symmetric) {
+      orientation = 0;
+      return state.hash();
+    }
+    return util::fnv64(sym.canonical(orientation)).hash(state.curPlayer).get();
+  }
+
+  inline util::option<typename TT::Entry> probe(Board<SIZE>& state) {
+    int orientation;
+    return ttable->get(key(state, typename Sym::Hashes(state), orientation));
+  }
+
+  inline Move<SIZE> probe_move(Board<SIZE>& state) {
+    int orientation;
+    auto e = ttable->get(key(state, typename Sym::Hashes(state), orientation));
+    return Sym::transform(Sym::inverse(orientation), e->move());
+  }
+
+  // Root moves to leave out, for multi-PV
+  std::vector<Move<SIZE>> excluded;
+
+  // Set from another thread to give up on the search in progress. Once
+  // it's set every score is meaningless, so nothing more is stored.
+  const std::atomic<bool>* stop_flag = nullptr;
+  // Give up after this many nodes, if not 0
+  int node_limit = 0;
+  // Neither applies until depth 1 is done
+  bool stoppable = false;
+
+  inline bool stopped() const {
+    return stoppable && ((stop_flag && stop_flag->load(std::memory_order_relaxed)) ||
+                         (node_limit && node_count >= node_limit));
+  }
+
+  // Get ready for a search up to max_depth
+  void begin(int max_depth) {
     hits = 0;
     leaf_count = 0;
+    node_count = 0;
+    ecache_probes = ecache_hits = 0;
     if(!ttable) {
-      std::cout << "Recreating ttable" << std::endl;
-      ttable = std::unique_ptr<TT>(new TT());
+      if(log) *log << "Recreating ttable" << std::endl;
+      ttable = std::make_shared<TT>();
     }
     killer_moves = std::vector<KillerMove<2>>(max_depth+1, {Move<SIZE>(), Move<SIZE>(), Evaluator::MIN, Evaluator::MIN});
+    start_time = std::chrono::steady_clock::now();
+  }
+
+  // The line the ttable expects from state, at most max_length moves
+  // (the ttable can hold a cycle)
+  std::vector<Move<SIZE>> pv(Board<SIZE> state, int max_length) {
+    std::vector<Move<SIZE>> line;
+    while((int)line.size() < max_length && probe(state)) {
+      Move<SIZE> move = probe_move(state);
+      if(move.type() == Move<SIZE>::Type::PLACE && move.pieceType() == Piece::INVALID) break;
+      if(!state.valid(move) || state.status().over) break;
+      line.push_back(move);
+      state.execute(move);
+    }
+    return line;
+  }
+public:
+  // A ttable that any number of searches can use at once: torn entries
+  // fail their key check, and the worst a race does is lose an entry
+  using Table = TT;
+
+  // Search with table from now on, which may be shared with other
+  // alphabetas of the same kind. They should agree on set_symmetric.
+  void share_ttable(std::shared_ptr<Table> table) {
+    ttable = table;
+  }
+
+  // Share ttable entries between the eight rotations/reflections
+  // of a position. Changing this throws away the current ttable.
+  void set_symmetric(bool s) {
+    if(s != symmetric) {
+      symmetric = s;
+      ttable.reset();
+      if(ecache) ecache.reset(new EC());
+    }
+  }
+
+  // Cache leaf evaluations separately from the ttable. Worth turning
+  // on for evaluators that cost more than a cache miss.
+  void set_eval_cache(bool enable) {
+    if(enable && !ecache) {
+      ecache = std::unique_ptr<EC>(new EC());
+    } else if(!enable) {
+      ecache.reset();
+    }
+  }
+
+  // Evaluate the leaves under each depth 1 node in one batch instead
+  // of one at a time. BatchEval scores like Eval, so only evaluators
+  // that do the same can use it. Children a cutoff would have skipped
+  // get scored too, so it's off by default.
+  void set_batch_eval(bool enable) {
+    static_assert(Evaluator::EVAL_EQUIVALENT, "BatchEval only scores like Eval");
+    batch = enable;
+  }
+
+  // Write what searches find at each depth, and their stats, to out
+  // (std::cout unless told otherwise), or nowhere if it's null
+  void set_log(std::ostream* out) {
+    log = out;
+  }
+
+  // Stop searches once they've visited about this many nodes, and
+  // play the best move of the deepest depth finished. 0 for no limit.
+  void set_node_limit(int nodes) {
+    node_limit = nodes;
+  }
+
+  // Nodes and leaves visited by the last search, and how many of the
+  // nodes were cut off by the ttable
+  int nodes() const { return node_count; }
+  int leaves() const { return leaf_count; }
+  int ttable_hits() const { return hits; }
+
+  Score search(Board<SIZE>& state, Move<SIZE>& bestMove, int max_depth) {
+    return search(state, bestMove, max_depth, nullptr, Progress());
+  }
+
+  // One of the lines found by a multi-PV search
+  struct Line {
+    Move<SIZE> move;
+    Score score;
+    int depth;
+    // Nodes searched for this line at its depth
+    int nodes;
+    // The line from the root, starting with move
+    std::vector<Move<SIZE>> pv;
+  };
+
+  // Told the best line after each depth of a search finishes
+  using Progress = std::function<void(const Line&)>;
 
-    start = std::chrono::steady_clock::now();
+  // A search started with start(), running on a thread of its own.
+  // Copies refer to the same search; the last one to go stops it and
+  // waits for its thread.
+  class Handle {
+  public:
+    // Give up on the depth being searched as soon as possible. The
+    // result is then the best move of the deepest one finished, and
+    // depth 1 always finishes so there is one.
+    void stop() const {
+      if(shared) shared->stop = true;
+    }
+
+    bool done() const {
+      std::lock_guard<std::mutex> guard(shared->lock);
+      return shared->done;
+    }
+
+    // Wait up to seconds for the search to end, true if it has
+    bool wait_for(double seconds) const {
+      std::unique_lock<std::mutex> guard(shared->lock);
+      return shared->finished.wait_for(guard, std::chrono::duration<double>(seconds), [this]() { return shared->done; });
+    }
+
+    // Wait for the search to end, for its best move and score
+    Score wait(Move<SIZE>& bestMove) const {
+      std::unique_lock<std::mutex> guard(shared->lock);
+      shared->finished.wait(guard, [this]() { return shared->done; });
+      bestMove = shared->move;
+      return shared->score;
+    }
+
+  private:
+    friend class alphabeta;
+    struct Shared {
+      std::atomic<bool> stop;
+      std::mutex lock;
+      std::condition_variable finished;
+      bool done;
+      Move<SIZE> move;
+      Score score;
+      std::thread thread;
+
+      Shared() : stop(false), done(false), score(0) {}
+      ~Shared() {
+        stop = true;
+        if(thread.joinable()) thread.join();
+      }
+    };
+    std::shared_ptr<Shared> shared;
+  };
+
+  // Search state to max_depth like search, but on another thread,
+  // calling progress (on that thread) as each depth finishes. Nothing
+  // else may use this alphabeta until the search is done.
+  Handle start(const Board<SIZE>& state, int max_depth, Progress progress = Progress()) {
+    Handle h;
+    h.shared = std::make_shared<typename Handle::Shared>();
+    typename Handle::Shared* shared = h.shared.get();
+    Board<SIZE> board = state;
+    shared->thread = std::thread([this, shared, board, max_depth, progress]() mutable {
+      Move<SIZE> move;
+      Score score = search(board, move, max_depth, &shared->stop, progress);
+      std::lock_guard<std::mutex> guard(shared->lock);
+      shared->move = move;
+      shared->score = score;
+      shared->done = true;
+      shared->finished.notify_all();
+    });
+    return h;
+  }
+
+  Score search(Board<SIZE>& state, Move<SIZE>& bestMove, int max_depth, const std::atomic<bool>* stop, const Progress& progress) {
+    std::chrono::duration<double> time_span;
+
+    begin(max_depth);
+    excluded.clear();
 
     Score score = 0;
     Score lastScore = 0;
 
+    stop_flag = stop;
     for(int d = 1; d <= max_depth; d++) {
+      // Always finish depth 1, so there's a move to play
+      stoppable = d > 1;
       Score t = lastScore;
-      lastScore = score;
-      score = mtdf(bestMove, t, state, d);
-      auto entry = ttable->get(state);
-      if(entry) {
-        std::cout << "Best move for depth "<<d<<" "<<ptn::to_str(entry->move())<< std::endl;
-      } else {
-        std::cout << "Couldn't get move for depth " << d << std::endl;
+      int nodes = node_count;
+      Move<SIZE> move;
+      Score s = mtdf(move, t, state, d);
+      if(stopped()) {
+        if(log) *log << "Stopped during depth " << d << std::endl;
+        break;
       }
-    }
-
-    Move<SIZE> move;
-    Board<SIZE> state_copy = state;
-    while(true) {
-      auto e = ttable->get(state_copy);
-      if(e) {
-        move = e->move();
-        if(!(move.type() == Move<SIZE>::Type::PLACE && move.pieceType() == Piece::INVALID)) {
-          std::cout << ptn::to_str(move) << " ";
-          state_copy.execute(move);
+      lastScore = score;
+      score = s;
+      bestMove = move;
+      if(log) {
+        if(probe(state)) {
+          *log << "Best move for depth "<<d<<" "<<ptn::to_str(probe_move(state))<< std::endl;
         } else {
-          break;
+          *log << "Couldn't get move for depth " << d << std::endl;
         }
-      } else {
-        break;
+      }
+      if(progress) {
+        Line line;
+        line.move = move;
+        line.score = score;
+        line.depth = d;
+        line.nodes = node_count-nodes;
+        Board<SIZE> child = state;
+        child.execute(move);
+        line.pv.push_back(move);
+        for(Move<SIZE>& m : pv(child, d-1)) line.pv.push_back(m);
+        progress(line);
       }
     }
-    std::cout << std::endl;
+    stop_flag = nullptr;
+    stoppable = false;
 
-    end = std::chrono::steady_clock::now();
-    time_span = std::chrono::duration_cast<std::chrono::duration<double>>(end-start);
-    std::cout << std::endl;
-    std::cout << leaf_count << " leafs evaluated in " << time_span.count() << "s" << std::endl;
-    std::cout << leaf_count/time_span.count() << " leafs/s" << std::endl;
-    std::cout << "Hits: " << hits << std::endl;
+    end_time = std::chrono::steady_clock::now();
+    if(!log) return score;
+
+    for(Move<SIZE>& m : pv(state, max_depth)) {
+      *log << ptn::to_str(m) << " ";
+    }
+    *log << std::endl;
+
+    time_span = std::chrono::duration_cast<std::chrono::duration<double>>(end_time-start_time);
+    *log << std::endl;
+    *log << leaf_count << " leafs evaluated in " << time_span.count() << "s" << std::endl;
+    *log << leaf_count/time_span.count() << " leafs/s" << std::endl;
+    *log << node_count << " nodes searched" << std::endl;
+    if(ecache) {
+      *log << "Eval cache hits: " << ecache_hits << "/" << ecache_probes
+           << " (" << (ecache_probes ? 100.0*ecache_hits/ecache_probes : 0.0) << "%)" << std::endl;
+    }
+    *log << "Hits: " << hits << std::endl;
 
     return score;
   }
 
+  // The best `lines' moves from state with their exact scores, best
+  // first. At each depth the root is searched once per line, each time
+  // with the moves already found left out, so the score of each is exact
+  // rather than just a bound. Everything below the root shares the
+  // ttable, so the later lines mostly find their work already done.
+  std::vector<Line> search_multipv(Board<SIZE>& state, int lines, int max_depth) {
+    begin(max_depth);
+    int num_moves = 0;
+    typename Board<SIZE>::Map map(state);
+    state.forEachMove(map, [&num_moves](Move<SIZE>) {
+      num_moves++;
+      return CONTINUE;
+    });
+    lines = util::min(lines, num_moves);
+
+    std::vector<Line> result;
+    for(int d = 1; d <= max_depth; d++) {
+      std::vector<Line> found;
+      excluded.clear();
+      for(int i = 0; i < lines; i++) {
+        // Start from this line's score at the last depth
+        Score guess = i < (int)result.size() ? result[i].score : 0;
+        int nodes = node_count;
+        Line line;
+        line.score = mtdf(line.move, guess, state, d);
+        line.depth = d;
+        line.nodes = node_count-nodes;
+        Board<SIZE> child = state;
+        child.execute(line.move);
+        line.pv.push_back(line.move);
+        for(Move<SIZE>& m : pv(child, d-1)) line.pv.push_back(m);
+        excluded.push_back(line.move);
+        found.push_back(line);
+      }
+      excluded.clear();
+      // mtdf finds the best of what's left, so the lines come out in
+      // order, ties aside
+      std::stable_sort(found.begin(), found.end(), [](const Line& a, const Line& b) { return a.score > b.score; });
+      result.swap(found);
+
+      if(log) {
+        *log << "Depth " << d << ":";
+        for(const Line& l : result) *log << " " << ptn::to_str(l.move) << " (" << l.score << ")";
+        *log << std::endl;
+      }
+    }
+    return result;
+  }
+
   Score mtdf(Move<SIZE>& bestMove, Score guess, Board<SIZE>& state, int max_depth) {
     Score upperBound = Evaluator::MAX, lowerBound = Evaluator::MIN;
+    typename Sym::Hashes sym;
+    if(symmetric) sym = typename Sym::Hashes(state);
+    Acc acc(state);
     while(lowerBound < upperBound) {
       Score beta = util::max<Score>(guess, lowerBound+1);
-      guess = negamax(state, bestMove, 0, max_depth, beta-1, beta);
+      guess = negamax(state, acc, sym, bestMove, 0, max_depth, beta-1, beta);
+      if(stopped()) break;
       if(guess < beta) upperBound = guess;
       else lowerBound = guess;
     }
@@ -232,13 +602,21 @@ public:
     return guess;
   }
 
-  Score negamax(Board<SIZE>& state, Move<SIZE>& bestMove, int ply, int depth, Score alpha, Score beta) {
+  // leaf, if given, is the already batched evaluation of this node
+  Score negamax(Board<SIZE>& state, const Acc& acc, const typename Sym::Hashes& sym, Move<SIZE>& bestMove, int ply, int depth, Score alpha, Score beta, const Score* leaf = nullptr) {
     using Entry = typename TT::Entry;
     Score init_alpha = alpha;
     util::option<Entry> e;
+    int orientation;
+    uint64_t hash = key(state, sym, orientation);
+    node_count++;
+    if(stopped()) return 0;
+    // A root with moves left out has a different value, keep it out of
+    // the ttable
+    bool restricted = ply == 0 && !excluded.empty();
     if(ttable) {
-      e = ttable->get(state);
-      if(e && e->depth() >= depth) {
+      e = ttable->get(hash);
+      if(e && e->depth() >= depth && !restricted) {
         hits++;
         switch(e->type()) {
         case Entry::EXACT:
@@ -267,7 +645,7 @@ public:
 
     if(status.over) {
       int s = status.winner == state.curPlayer ? Evaluator::WIN+depth : Evaluator::LOSS-depth;
-      if(ttable) ttable->put(state, Entry(Entry::EXACT, depth, s));
+      if(ttable) ttable->put(hash, Entry(Entry::EXACT, depth, s));
       return s;
     }
 
@@ -275,8 +653,21 @@ public:
       if(depth < 0) {
         std::cout << "Error: depth " << depth << std::endl;
       }
-      int s = Evaluator::eval(state, state.curPlayer);
-      if(ttable) ttable->put(state, Entry(Entry::EXACT, depth, s));
+      Score s;
+      if(leaf) {
+        s = *leaf;
+      } else if(ecache) {
+        ecache_probes++;
+        if(ecache->get(hash, s)) {
+          ecache_hits++;
+        } else {
+          s = Evaluator::eval(state, acc, state.curPlayer);
+          ecache->put(hash, s);
+        }
+      } else {
+        s = Evaluator::eval(state, acc, state.curPlayer);
+      }
+      if(ttable) ttable->put(hash, Entry(Entry::EXACT, depth, s));
       return s;
     } else {
       typename Board<SIZE>::Map map(state);
@@ -290,7 +681,7 @@ public:
 
       util::option<Move<SIZE>> hash_move;
       if(e) {
-        hash_move = e->move();
+        hash_move = Sym::transform(Sym::inverse(orientation), e->move());
       }
 
       auto score_move = [this,depth,&hash_move](Move<SIZE>& m) {
@@ -303,7 +694,12 @@ public:
       };
 
       std::vector<MoveAndScore> moves;
-      state.forEachMove(map, [&moves, score_move](Move<SIZE> m) {
+      state.forEachMove(map, [this, restricted, &moves, score_move](Move<SIZE> m) {
+        if(restricted) {
+          for(Move<SIZE>& x : excluded) {
+            if(x == m) return CONTINUE;
+          }
+        }
         moves.push_back({m, score_move(m)});
         return CONTINUE;
       });
@@ -319,14 +715,27 @@ public:
         moves[j+1] = m;
       }
 
+      std::vector<Score> leaves;
+      if(batch && depth == 1) {
+        std::vector<Move<SIZE>> children(numMoves);
+        for(int i = 0; i < numMoves; i++) children[i] = moves[i].m;
+        leaves.resize(numMoves);
+        BatchEval<SIZE>::eval(state, children.data(), numMoves, !state.curPlayer, leaves.data());
+      }
+
       Score bestScore = Evaluator::MIN;
       //Move<SIZE> bestMove;
       for(int i = 0; i < numMoves; i++) {
         Move<SIZE>& m = moves[i].m;
         Board<SIZE> check = state;
-        check.execute(m);
+        Acc child_acc = acc;
+        check.execute(m, child_acc);
+        typename Sym::Hashes child_sym;
+        if(symmetric) child_sym = sym.after(state, check, m);
         Move<SIZE> bm;
-        Score score = -negamax(check, bm, ply+1, depth-1, -beta, -alpha);
+        const Score* leaf = leaves.empty() ? nullptr : &leaves[i];
+        Score score = -negamax(check, child_acc, child_sym, bm, ply+1, depth-1, -beta, -alpha, leaf);
+        if(stopped()) return 0;
 
         if(score > bestScore) {
           bestScore = score;
@@ -345,18 +754,18 @@ public:
             }
           }
 
-          if(ttable) {
-            ttable->put(state, Entry(Entry::BETA, depth, bestScore, bestMove));
+          if(ttable && !restricted) {
+            ttable->put(hash, Entry(Entry::BETA, depth, bestScore, Sym::transform(orientation, bestMove)));
           }
           return bestScore;
         }
       }
 
-      if(ttable) {
+      if(ttable && !restricted) {
         if(bestScore > init_alpha) {
-          ttable->put(state, Entry(Entry::EXACT, depth, bestScore, bestMove));
+          ttable->put(hash, Entry(Entry::EXACT, depth, bestScore, Sym::transform(orientation, bestMove)));
         } else {
-          ttable->put(state, Entry(Entry::ALPHA, depth, bestScore, bestMove));
+          ttable->put(hash, Entry(Entry::ALPHA, depth, bestScore, Sym::transform(orientation, bestMove)));
         }
       }
       return bestScore;
@@ -0,0 +1,405 @@
+// A headless analysis server, for GUIs and scripts to drive the engine
+// without going through Playtak. It listens on localhost or a Unix
+// socket and speaks a text protocol along the lines of TEI/UCI, one
+// command per line:
+//
+//   tei                       id name cutak, then teiok
+//   isready                   readyok
+//   teinewgame <size>         start over on an empty board of size
+//   position startpos [moves <ptn>...]
+//   position tps <tps> [moves <ptn>...]
+//   go [depth n] [nodes n] [movetime ms] [wtime ms btime ms [winc ms binc ms]] [infinite]
+//   stop                      finish the search now
+//   quit
+//
+// A search sends an info line for every depth it finishes
+//
+//   info depth <d> score cp <s> nodes <n> time <ms> nps <n> pv <ptn>...
+//
+// and then bestmove <ptn>. Anything wrong is reported as info string.
+//
+// Any number of sessions can be open at once. Their searches share one
+// worker pool, and one ttable for each size of board.
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#define ASIO_STANDALONE
+#include "asio.hpp"
+#include "tak/tak.hpp"
+#include "tak/ptn.hpp"
+#include "tak/tps.hpp"
+#include "alphabeta.hpp"
+#include "incremental.hpp"
+#include "scheduler.hpp"
+
+using err_t = std::error_code;
+
+// What go asks for. Anything left at 0 is unlimited.
+struct Limits {
+  int depth = 0;
+  int nodes = 0;
+  // Milliseconds
+  double movetime = 0;
+  double time[2] = { 0, 0 };
+  double inc[2] = { 0, 0 };
+};
+
+// Deepest search a go without a depth goes to
+static const int MAX_DEPTH = 64;
+
+// log2 of the number of entries in each size's ttable
+static int ttable_bits = 18;
+
+// A session's position and its search, for one size of board
+class AnalyzerBase {
+public:
+  virtual ~AnalyzerBase() {}
+  virtual int size() const = 0;
+  // Set up the position, which is TPS (or empty for the start) followed
+  // by moves. If anything's wrong says what in error and leaves the
+  // position as it was.
+  virtual bool position(const std::string& tps, const std::vector<std::string>& moves, std::string& error) = 0;
+  // Search the position, sending an info line to send for each depth.
+  // Runs on a worker, and returns the best move once it's done.
+  virtual std::string go(const Limits& limits, Scheduler::Cancel& cancel, std::function<void(const std::string&)> send) = 0;
+};
+
+template<uint8_t N>
+class Analyzer : public AnalyzerBase {
+public:
+  using Search = alphabeta<N, IncrementalEval>;
+
+  Analyzer() {
+    ab.share_ttable(table());
+    ab.set_log(nullptr);
+  }
+
+  int size() const override { return N; }
+
+  bool position(const std::string& tps, const std::vector<std::string>& moves, std::string& error) override {
+    Board<N> b;
+    if(tps.size() && !tps::from_str(tps, b)) {
+      error = "bad TPS " + tps;
+      return false;
+    }
+    for(const std::string& s : moves) {
+      Move<N> m;
+      if(!ptn::from_str<N>(s, m) || !b.valid(m)) {
+        error = "illegal move " + s;
+        return false;
+      }
+      b.execute(m);
+    }
+    board = b;
+    return true;
+  }
+
+  std::string go(const Limits& limits, Scheduler::Cancel& cancel, std::function<void(const std::string&)> send) override {
+    auto start = std::chrono::steady_clock::now();
+    long nodes = 0;
+    ab.set_node_limit(limits.nodes);
+    typename Search::Handle search = ab.start(board, limits.depth ? limits.depth : MAX_DEPTH,
+                                              [&](const typename Search::Line& line) {
+      nodes += line.nodes;
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+      std::ostringstream info;
+      info << "info depth " << line.depth << " score cp " << line.score << " nodes " << nodes
+           << " time " << (long)(seconds*1000) << " nps " << (long)(seconds > 0 ? nodes/seconds : 0) << " pv";
+      for(const Move<N>& m : line.pv) info << " " << ptn::to_str(m);
+      send(info.str());
+    });
+    if(!cancel.attach([search]() { search.stop(); })) search.stop();
+
+    // A fixed time, or a share of what's left on the clock
+    double ms = limits.movetime;
+    int player = board.curPlayer == WHITE ? 0 : 1;
+    if(!ms && limits.time[player] > 0) ms = limits.time[player]/20 + limits.inc[player]/2;
+    if(ms > 0 && !search.wait_for(ms/1000)) search.stop();
+
+    Move<N> move;
+    search.wait(move);
+    cancel.detach();
+    return ptn::to_str(move);
+  }
+
+private:
+  Board<N> board;
+  Search ab;
+
+  // Shared by every session on this size of board
+  static std::shared_ptr<typename Search::Table> table() {
+    static std::shared_ptr<typename Search::Table> t = std::make_shared<typename Search::Table>(ttable_bits);
+    return t;
+  }
+};
+
+static std::shared_ptr<AnalyzerBase> make_analyzer(int size) {
+  switch(size) {
+  case 3: return std::make_shared<Analyzer<3>>();
+  case 4: return std::make_shared<Analyzer<4>>();
+  case 5: return std::make_shared<Analyzer<5>>();
+  case 6: return std::make_shared<Analyzer<6>>();
+  case 7: return std::make_shared<Analyzer<7>>();
+  case 8: return std::make_shared<Analyzer<8>>();
+  default: return nullptr;
+  }
+}
+
+// One client, over either kind of socket
+template<typename Protocol>
+class Session : public std::enable_shared_from_this<Session<Protocol>> {
+public:
+  Session(asio::io_service& io, Scheduler& scheduler, int id) :
+    sock(io), io(io), scheduler(scheduler), id(id), searching(false), analyzer(make_analyzer(5)) {}
+
+  typename Protocol::socket sock;
+
+  void start() {
+    std::cerr << "Session " << id << " opened" << std::endl;
+    readline();
+  }
+
+private:
+  asio::io_service& io;
+  Scheduler& scheduler;
+  int id;
+  asio::streambuf buf;
+  std::queue<std::string> msg_queue;
+
+  bool searching;
+  std::shared_ptr<Scheduler::Cancel> cancel;
+  // Shared with the search, which may outlive a teinewgame
+  std::shared_ptr<AnalyzerBase> analyzer;
+
+  void send(const std::string& msg) {
+    bool send_in_progress = msg_queue.size() > 0;
+    msg_queue.push(msg + "\n");
+    if(!send_in_progress) {
+      do_send();
+    }
+  }
+
+  void do_send() {
+    auto self = this->shared_from_this();
+    asio::async_write(sock, asio::buffer(msg_queue.front()), [self](err_t err, std::size_t) {
+      if(!err) {
+        self->msg_queue.pop();
+        if(self->msg_queue.size()) {
+          self->do_send();
+        }
+      }
+    });
+  }
+
+  void readline() {
+    auto self = this->shared_from_this();
+    asio::async_read_until(sock, buf, '\n', [self](err_t err, std::size_t n) {
+      if(!err) {
+        std::istream in(&self->buf);
+        std::string line;
+        std::getline(in, line);
+        if(line.size() && line.back() == '\r') line.pop_back();
+        if(self->handle(line)) self->readline();
+      } else {
+        self->close();
+      }
+    });
+  }
+
+  // Stop searching and reading. The socket closes once what's left to
+  // send has gone and nothing refers to the session any more.
+  void close() {
+    std::cerr << "Session " << id << " closed" << std::endl;
+    if(cancel) cancel->cancel();
+    scheduler.cancel(id);
+  }
+
+  // False once the session's over
+  bool handle(const std::string& line) {
+    std::istringstream in(line);
+    std::string command;
+    in >> command;
+    if(command == "tei") {
+      send("id name cutak");
+      send("teiok");
+    } else if(command == "isready") {
+      send("readyok");
+    } else if(command == "teinewgame") {
+      int size = 5;
+      in >> size;
+      if(searching) {
+        send("info string can't start a new game while searching");
+      } else if(auto a = make_analyzer(size)) {
+        analyzer = a;
+      } else {
+        send("info string boards of size < 3 or > 8 not supported");
+      }
+    } else if(command == "position") {
+      position(in);
+    } else if(command == "go") {
+      go(in);
+    } else if(command == "stop") {
+      if(cancel) cancel->cancel();
+    } else if(command == "quit") {
+      close();
+      return false;
+    } else if(command.size() && command != "setoption") {
+      send("info string unknown command " + command);
+    }
+    return true;
+  }
+
+  void position(std::istream& in) {
+    if(searching) {
+      send("info string can't change position while searching");
+      return;
+    }
+    std::string word, tps;
+    in >> word;
+    if(word == "tps") {
+      while(in >> word && word != "moves") tps += (tps.size() ? " " : "") + word;
+    } else if(word == "startpos") {
+      in >> word;
+    } else {
+      send("info string expected startpos or tps");
+      return;
+    }
+    std::vector<std::string> moves;
+    if(word == "moves") {
+      while(in >> word) moves.push_back(word);
+    }
+
+    // TPS says the size, otherwise it's the size of the game
+    std::shared_ptr<AnalyzerBase> a = analyzer;
+    if(tps.size()) {
+      size_t rows = tps.find(' ');
+      if(rows == std::string::npos) {
+        send("info string bad TPS " + tps);
+        return;
+      }
+      int size = 1 + std::count(tps.begin(), tps.begin() + rows, '/');
+      if(size != a->size()) a = make_analyzer(size);
+      if(!a) {
+        send("info string boards of size < 3 or > 8 not supported");
+        return;
+      }
+    }
+    std::string error;
+    if(!a->position(tps, moves, error)) {
+      send("info string " + error);
+      return;
+    }
+    analyzer = a;
+  }
+
+  void go(std::istream& in) {
+    if(searching) {
+      send("info string already searching");
+      return;
+    }
+    Limits limits;
+    std::string word;
+    while(in >> word) {
+      double value = 0;
+      if(word == "infinite") continue;
+      in >> value;
+      if(word == "depth") limits.depth = (int)value;
+      else if(word == "nodes") limits.nodes = (int)value;
+      else if(word == "movetime") limits.movetime = value;
+      else if(word == "wtime") limits.time[0] = value;
+      else if(word == "btime") limits.time[1] = value;
+      else if(word == "winc") limits.inc[0] = value;
+      else if(word == "binc") limits.inc[1] = value;
+    }
+
+    searching = true;
+    cancel = std::make_shared<Scheduler::Cancel>();
+    auto self = this->shared_from_this();
+    std::shared_ptr<AnalyzerBase> a = analyzer;
+    std::shared_ptr<Scheduler::Cancel> c = cancel;
+    // Searches with a deadline go first
+    double clock = limits.movetime ? limits.movetime/1000 : 0;
+    scheduler.submit(id, clock, false, [self, a, c, limits](int) {
+      std::string move = a->go(limits, *c, [self](const std::string& line) {
+        self->io.post([self, line]() { self->send(line); });
+      });
+      // Together, so the client can't get in between the two
+      self->io.post([self, move]() {
+        self->searching = false;
+        self->send("bestmove " + move);
+      });
+    });
+  }
+};
+
+template<typename Protocol>
+class Server {
+public:
+  Server(asio::io_service& io, const typename Protocol::endpoint& endpoint, Scheduler& scheduler) :
+    io(io), acceptor(io, endpoint), scheduler(scheduler), next_id(1)
+  {
+    accept();
+  }
+
+private:
+  asio::io_service& io;
+  typename Protocol::acceptor acceptor;
+  Scheduler& scheduler;
+  int next_id;
+
+  void accept() {
+    auto session = std::make_shared<Session<Protocol>>(io, scheduler, next_id++);
+    acceptor.async_accept(session->sock, [this, session](err_t err) {
+      if(!err) session->start();
+      accept();
+    });
+  }
+};
+
+int main(int argc, char** argv) {
+  if(argc < 2) {
+    std::cout << "usage: analysis <port>|unix:<path> [--cores n] [--hash MB]" << std::endl;
+    return -1;
+  }
+  std::string where = argv[1];
+  int cores = std::thread::hardware_concurrency();
+  size_t hash = 64;
+  for(int i = 2; i+1 < argc; i++) {
+    std::string arg = argv[i];
+    if(arg == "--cores") {
+      cores = std::atoi(argv[++i]);
+    } else if(arg == "--hash") {
+      hash = std::atoi(argv[++i]);
+    } else {
+      std::cout << "Unknown option " << arg << std::endl;
+      return -1;
+    }
+  }
+  // Going by 5x5's entries, 8x8's are half as big again
+  ttable_bits = alphabeta<5, IncrementalEval>::Table::bits_for(hash << 20);
+
+  Eval::load_weights("weights.txt");
+
+  asio::io_service io;
+  Scheduler scheduler(cores);
+  if(where.compare(0, 5, "unix:") == 0) {
+    std::string path = where.substr(5);
+    std::remove(path.c_str());
+    Server<asio::local::stream_protocol> server(io, asio::local::stream_protocol::endpoint(path), scheduler);
+    std::cerr << "Listening on " << path << std::endl;
+    io.run();
+  } else {
+    asio::ip::tcp::endpoint endpoint(asio::ip::address_v4::loopback(), std::atoi(where.c_str()));
+    Server<asio::ip::tcp> server(io, endpoint, scheduler);
+    std::cerr << "Listening on localhost:" << where << std::endl;
+    io.run();
+  }
+}
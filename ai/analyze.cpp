@@ -0,0 +1,293 @@
+// Analyses archives of games: every position of every game in some PTN
+// files (or stdin) is searched to a fixed depth or number of nodes, and
+// what was found written out as CSV or binary records.
+//
+// Games are read a move at a time and replayed onto a queue of
+// positions that a thread pool works through, so archives of any size
+// stream through in bounded memory. The threads' searches share one
+// ttable, so positions that come up in many games (openings especially)
+// are mostly looked up rather than searched again.
+//
+// Results come out in the order they finish, one for each position
+// before a move, with the move that was played next to the best found:
+//
+//   csv: game,ply,player,played,best,score,depth,nodes,tps
+//
+// with the score in centiflats for the player to move. The binary file
+// is a Header then a Record for each position, with the moves packed as
+// in the books (see book.hpp) and the positions as Board::hash keys.
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include "tak/tak.hpp"
+#include "tak/ptn.hpp"
+#include "tak/tps.hpp"
+#include "tak/ptnfile.hpp"
+#include "alphabeta.hpp"
+#include "incremental.hpp"
+#include "book.hpp"
+#include "match.hpp"
+
+struct Options {
+  int depth = 0;
+  int nodes = 0;
+  int threads = 1;
+  size_t hash = 256;
+  bool binary = false;
+};
+
+// Deepest a search with only a node limit goes
+static const int MAX_DEPTH = 64;
+
+// Positions waiting for a thread
+static const size_t QUEUE_SIZE = 1024;
+
+struct Header {
+  char magic[4];
+  uint8_t size;
+  uint8_t pad[3];
+  uint64_t count;
+};
+
+struct Record {
+  uint64_t key;
+  uint32_t game;
+  uint16_t ply;
+  int16_t score;
+  uint32_t played;
+  uint32_t best;
+  uint32_t nodes;
+  uint8_t depth;
+  uint8_t pad[3];
+};
+
+template<uint8_t SIZE>
+struct Position {
+  uint32_t game;
+  uint16_t ply;
+  Board<SIZE> board;
+  Move<SIZE> played;
+};
+
+// Positions from the reader to the threads, which wait while it's empty
+// while the reader waits while it's full
+template<uint8_t SIZE>
+class Queue {
+public:
+  Queue() : closed(false) {}
+
+  void push(const Position<SIZE>& p) {
+    std::unique_lock<std::mutex> guard(lock);
+    not_full.wait(guard, [this]() { return positions.size() < QUEUE_SIZE; });
+    positions.push_back(p);
+    not_empty.notify_one();
+  }
+
+  // False once it's closed and empty
+  bool pop(Position<SIZE>& p) {
+    std::unique_lock<std::mutex> guard(lock);
+    not_empty.wait(guard, [this]() { return positions.size() || closed; });
+    if(positions.empty()) return false;
+    p = positions.front();
+    positions.pop_front();
+    not_full.notify_one();
+    return true;
+  }
+
+  // No more positions are coming
+  void close() {
+    std::lock_guard<std::mutex> guard(lock);
+    closed = true;
+    not_empty.notify_all();
+  }
+
+private:
+  std::mutex lock;
+  std::condition_variable not_empty, not_full;
+  std::deque<Position<SIZE>> positions;
+  bool closed;
+};
+
+template<uint8_t SIZE>
+static int analyze(const std::string& out_path, const std::vector<std::string>& files, const Options& opts) {
+  using Search = alphabeta<SIZE, IncrementalEval>;
+  using B = Book<SIZE>;
+
+  std::ofstream file;
+  if(out_path != "-") {
+    file.open(out_path, opts.binary ? std::ios::binary : std::ios::out);
+    if(!file.is_open()) {
+      std::cout << "Failed to open " << out_path << std::endl;
+      return -1;
+    }
+  } else if(opts.binary) {
+    std::cout << "Binary output has to go to a file" << std::endl;
+    return -1;
+  }
+
+  std::ostream& out = file.is_open() ? file : std::cout;
+
+  if(opts.binary) {
+    // The count is filled in at the end
+    Header h = { { 'T', 'A', 'N', 'L' }, SIZE, { 0, 0, 0 }, 0 };
+    out.write((const char*)&h, sizeof(h));
+  } else {
+    out << "game,ply,player,played,best,score,depth,nodes,tps\n";
+  }
+
+  auto table = std::make_shared<typename Search::Table>(Search::Table::bits_for(opts.hash << 20));
+  Queue<SIZE> queue;
+  std::mutex lock;
+  long analyzed = 0, nodes = 0, games = 0;
+  auto start = std::chrono::steady_clock::now();
+  double last_report = 0;
+
+  std::vector<std::thread> workers;
+  for(int t = 0; t < opts.threads; t++) {
+    workers.emplace_back([&]() {
+      Search ab;
+      ab.share_ttable(table);
+      ab.set_node_limit(opts.nodes);
+      ab.set_log(nullptr);
+      Position<SIZE> p;
+      while(queue.pop(p)) {
+        Move<SIZE> best;
+        Board<SIZE> board = p.board;
+        // The deepest depth finished, since a node limit can stop any
+        int depth = 0;
+        auto score = ab.search(board, best, opts.depth ? opts.depth : MAX_DEPTH, nullptr,
+                               [&](const typename Search::Line& line) { depth = line.depth; });
+
+        std::lock_guard<std::mutex> guard(lock);
+        if(opts.binary) {
+          Record r = { p.board.hash(), p.game, p.ply, (int16_t)score, B::pack(p.played), B::pack(best),
+                       (uint32_t)ab.nodes(), (uint8_t)depth, { 0, 0, 0 } };
+          out.write((const char*)&r, sizeof(r));
+        } else {
+          out << p.game << "," << p.ply << "," << (p.board.curPlayer == WHITE ? "white" : "black") << ","
+              << ptn::to_str(p.played) << "," << ptn::to_str(best) << "," << score << ","
+              << depth << "," << ab.nodes() << "," << tps::to_str(p.board) << "\n";
+        }
+        analyzed++;
+        nodes += ab.nodes();
+        double seconds = match::since(start);
+        if(seconds - last_report >= 1) {
+          last_report = seconds;
+          std::cerr << games << " games, " << analyzed << " positions, "
+                    << (long)(analyzed/seconds) << " positions/s, "
+                    << (long)(nodes/seconds) << " nodes/s\r" << std::flush;
+        }
+      }
+    });
+  }
+
+  // Replay the games onto the queue
+  long skipped = 0;
+  auto read = [&](std::istream& in) {
+    ptn::Reader<SIZE> reader(in);
+    while(reader.next_game()) {
+      uint32_t game;
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        if(reader.size() && reader.size() != SIZE) {
+          skipped++;
+          continue;
+        }
+        game = games++;
+      }
+      Position<SIZE> p;
+      p.game = game;
+      while(reader.next(p.played) && !reader.position().status().over) {
+        p.ply = reader.ply();
+        p.board = reader.position();
+        queue.push(p);
+      }
+      if(reader.error().size()) {
+        std::cerr << reader.error() << " in game " << game << std::endl;
+      }
+    }
+  };
+  if(files.empty()) {
+    read(std::cin);
+  }
+  for(const std::string& path : files) {
+    std::ifstream in(path);
+    if(!in.is_open()) {
+      std::cerr << "Failed to open " << path << std::endl;
+      continue;
+    }
+    read(in);
+  }
+  queue.close();
+  for(auto& w : workers) w.join();
+
+  if(opts.binary) {
+    Header h = { { 'T', 'A', 'N', 'L' }, SIZE, { 0, 0, 0 }, (uint64_t)analyzed };
+    out.seekp(0);
+    out.write((const char*)&h, sizeof(h));
+  }
+  out.flush();
+
+  double seconds = match::since(start);
+  std::cerr << std::endl;
+  std::cout << "Analysed " << analyzed << " positions from " << games << " games in " << seconds << "s ("
+            << analyzed/seconds << " positions/s, " << nodes/seconds << " nodes/s)";
+  if(skipped) std::cout << ", skipped " << skipped << " games of other sizes";
+  std::cout << std::endl;
+  return out.good() ? 0 : -1;
+}
+
+int main(int argc, char** argv) {
+  if(argc < 3) {
+    std::cout << "usage: analyze <size> <out>|- [--depth <n>] [--nodes <n>] [--threads <n>] [--hash <MB>]" << std::endl;
+    std::cout << "               [--format csv|bin] [games.ptn...]" << std::endl;
+    return -1;
+  }
+  int size = std::atoi(argv[1]);
+  std::string out = argv[2];
+
+  Options opts;
+  opts.threads = std::thread::hardware_concurrency();
+  std::vector<std::string> files;
+  for(int i = 3; i < argc; i++) {
+    std::string arg = argv[i];
+    bool more = i+1 < argc;
+    if(arg == "--depth" && more) opts.depth = std::atoi(argv[++i]);
+    else if(arg == "--nodes" && more) opts.nodes = std::atoi(argv[++i]);
+    else if(arg == "--threads" && more) opts.threads = std::atoi(argv[++i]);
+    else if(arg == "--hash" && more) opts.hash = std::atoi(argv[++i]);
+    else if(arg == "--format" && more) opts.binary = std::string(argv[++i]) == "bin";
+    else if(arg.compare(0, 2, "--") == 0) {
+      std::cout << "Unknown option " << arg << std::endl;
+      return -1;
+    } else {
+      files.push_back(arg);
+    }
+  }
+  if(opts.threads < 1) opts.threads = 1;
+  if(!opts.depth && !opts.nodes) opts.depth = 5;
+
+  Eval::load_weights("weights.txt");
+
+  switch(size) {
+  case 3: return analyze<3>(out, files, opts);
+  case 4: return analyze<4>(out, files, opts);
+  case 5: return analyze<5>(out, files, opts);
+  case 6: return analyze<6>(out, files, opts);
+  case 7: return analyze<7>(out, files, opts);
+  case 8: return analyze<8>(out, files, opts);
+  default:
+    std::cout << "Boards of size < 3 or > 8 not supported!" << std::endl;
+    return -1;
+  }
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include "biteval.hpp"
+#include <vector>
+
+// Evaluate every child of one position in a single call, the CPU
+// counterpart of eval_parallel in libtak/alphabeta.cu.
+//
+// A move only changes a handful of squares, so the children are built
+// as bit boards from the parent's, laid out structure-of-arrays, and the
+// features that depend on the whole board are computed for four
+// children at a time with AVX2 (or one at a time without it). The
+// captive features are patched from the parent's for just the squares
+// each move touches.
+//
+// Scores are the same as Eval::eval would give each child.
+template<uint8_t SIZE>
+class BatchEval {
+public:
+  using Score = Eval::Score;
+  using Terms = Eval::Terms;
+
+  // Score the children of parent reached by moves[0..n), as seen by player
+  static void eval(const Board<SIZE>& parent, const Move<SIZE>* moves, int n, uint8_t player, Score* scores) {
+    Children& c = children();
+    c.resize(n);
+
+    Board<SIZE> board = parent;
+    BitEval::Bits parent_bits = BitEval::bits(parent);
+
+    for(int i = 0; i < n; i++) {
+      Move<SIZE> m = moves[i];
+      uint64_t changed = Board<SIZE>::squares(m);
+
+      // Take out the captive features of the squares that change...
+      Terms stacks[2];
+      for(uint64_t sq = changed; sq; sq &= sq-1) {
+        BitEval::stack(board.board[__builtin_ctzll(sq)], stacks);
+      }
+      for(int p = 0; p < 2; p++) {
+        stacks[p].flats = -stacks[p].flats;
+        stacks[p].captured_penalty = -stacks[p].captured_penalty;
+      }
+
+      // ...and put back the child's
+      board.execute(m);
+      BitEval::Bits b = parent_bits;
+      for(uint64_t sq = changed; sq; sq &= sq-1) {
+        int idx = __builtin_ctzll(sq);
+        BitEval::stack(board.board[idx], stacks);
+        b.set(board.board[idx], idx);
+      }
+      board.undo(m);
+
+      c.occupied[i] = b.occupied;
+      c.black[i] = b.black;
+      c.flat[i] = b.flat;
+      c.cap[i] = b.cap;
+      for(int p = 0; p < 2; p++) {
+        c.flats[p][i] = stacks[p].flats;
+        c.penalty[p][i] = stacks[p].captured_penalty;
+      }
+    }
+
+    // Captive features of the parent, shared by every child
+    Terms base[2];
+    BitEval::terms(parent, base);
+
+    int i = 0;
+#ifdef BITEVAL_AVX2
+    if(BitEval::has_avx2()) {
+      i = score_avx2(c, n & ~3, base, player, scores);
+    }
+#endif
+    for(; i < n; i++) {
+      BitEval::Bits b = { c.occupied[i], c.black[i], c.flat[i], c.cap[i] };
+      Terms t[2];
+      BitEval::top_terms<SIZE>(b, t);
+      for(int p = 0; p < 2; p++) {
+        t[p].flats = base[p].flats + c.flats[p][i];
+        t[p].captured_penalty = base[p].captured_penalty + c.penalty[p][i];
+      }
+      scores[i] = Eval::combine(t[player]) - Eval::combine(t[!player]);
+    }
+
+#ifdef EVAL_DEBUG
+    for(int i = 0; i < n; i++) {
+      Board<SIZE> child = parent;
+      Move<SIZE> m = moves[i];
+      child.execute(m);
+      Score full = Eval::eval(child, player);
+      if(scores[i] != full) {
+        std::cout << "Error: batched eval " << scores[i] << " != full eval " << full << std::endl;
+      }
+    }
+#endif
+  }
+
+private:
+  // Children as structure-of-arrays, the captive features relative to the parent
+  struct Children {
+    std::vector<uint64_t> occupied, black, flat, cap;
+    std::vector<int64_t> flats[2], penalty[2];
+
+    void resize(int n) {
+      // Padded out to whole AVX2 registers
+      size_t size = (n+3) & ~3;
+      if(occupied.size() >= size) return;
+      occupied.resize(size); black.resize(size); flat.resize(size); cap.resize(size);
+      for(int p = 0; p < 2; p++) {
+        flats[p].resize(size);
+        penalty[p].resize(size);
+      }
+    }
+  };
+
+  static Children& children() {
+    static thread_local Children c;
+    return c;
+  }
+
+#ifdef BITEVAL_AVX2
+  __attribute__((target("avx2")))
+  static inline __m256i popcount(__m256i v) {
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+    const __m256i nibble_count = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                                  0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    __m256i lo = _mm256_shuffle_epi8(nibble_count, _mm256_and_si256(v, low_nibble));
+    __m256i hi = _mm256_shuffle_epi8(nibble_count, _mm256_and_si256(_mm256_srli_epi64(v, 4), low_nibble));
+    return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+  }
+
+  __attribute__((target("avx2")))
+  static inline __m256i load(const std::vector<uint64_t>& v, int i) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v.data()+i));
+  }
+
+  __attribute__((target("avx2")))
+  static inline __m256i load(const std::vector<int64_t>& v, int i) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v.data()+i));
+  }
+
+  __attribute__((target("avx2")))
+  static inline __m256i weigh(__m256i v, int w) {
+    // Features and weights are small, so 32x32 bit products are enough
+    return _mm256_mul_epi32(v, _mm256_set1_epi64x(w));
+  }
+
+  // Score n children (a multiple of 4), four at a time. Returns the number scored.
+  __attribute__((target("avx2")))
+  static int score_avx2(const Children& c, int n, const Terms base[2], uint8_t player, Score* scores) {
+    using G = Geometry<SIZE>;
+    const Eval::Weights& w = Eval::weights;
+    const __m256i east = _mm256_set1_epi64x(G::east_edge());
+    const __m256i has_neighbour[4] = {
+      _mm256_set1_epi64x(~G::north_edge()), _mm256_set1_epi64x(~G::south_edge()),
+      _mm256_set1_epi64x(~G::east_edge()), _mm256_set1_epi64x(~G::west_edge()),
+    };
+    const __m256i win = _mm256_set1_epi64x(Eval::WIN-1);
+    const __m256i loss = _mm256_set1_epi64x(Eval::LOSS+1);
+
+    for(int i = 0; i < n; i += 4) {
+      __m256i occupied = load(c.occupied, i);
+      __m256i black = load(c.black, i);
+      __m256i flat = load(c.flat, i);
+      __m256i cap = load(c.cap, i);
+      __m256i owned[2] = { _mm256_andnot_si256(black, occupied), black };
+
+      __m256i influence[2];
+      for(int p = 0; p < 2; p++) {
+        influence[p] = _mm256_setzero_si256();
+        for(int d = 0; d < 4; d++) {
+          influence[p] = _mm256_add_epi64(influence[p], popcount(_mm256_and_si256(owned[p], has_neighbour[d])));
+        }
+      }
+      __m256i white_influence = _mm256_sub_epi64(influence[WHITE], influence[BLACK]);
+
+      __m256i s[2];
+      for(int p = 0; p < 2; p++) {
+        __m256i f = _mm256_and_si256(owned[p], flat);
+        __m256i adj = _mm256_add_epi64(
+          popcount(_mm256_and_si256(f, _mm256_srli_epi64(f, SIZE))),
+          popcount(_mm256_andnot_si256(east, _mm256_and_si256(f, _mm256_srli_epi64(f, 1)))));
+        __m256i flats = _mm256_add_epi64(load(c.flats[p], i), _mm256_set1_epi64x(base[p].flats));
+        __m256i penalty = _mm256_add_epi64(load(c.penalty[p], i), _mm256_set1_epi64x(base[p].captured_penalty));
+        __m256i infl = p == WHITE ? white_influence : _mm256_sub_epi64(_mm256_setzero_si256(), white_influence);
+
+        __m256i v = weigh(popcount(f), w.top_flats);
+        v = _mm256_add_epi64(v, weigh(adj, 2*w.adj_flats));
+        v = _mm256_add_epi64(v, weigh(flats, w.flats));
+        v = _mm256_add_epi64(v, weigh(popcount(_mm256_and_si256(owned[p], cap)), w.caps));
+        v = _mm256_add_epi64(v, weigh(infl, w.influence));
+        v = _mm256_add_epi64(v, weigh(penalty, w.captured_penalty));
+        // Clamp like Eval::combine
+        v = _mm256_blendv_epi8(v, win, _mm256_cmpgt_epi64(v, win));
+        v = _mm256_blendv_epi8(v, loss, _mm256_cmpgt_epi64(loss, v));
+        s[p] = v;
+      }
+
+      alignas(32) int64_t out[4];
+      _mm256_store_si256(reinterpret_cast<__m256i*>(out), _mm256_sub_epi64(s[player], s[!player]));
+      for(int j = 0; j < 4; j++) {
+        scores[i+j] = out[j];
+      }
+    }
+    return n;
+  }
+#endif
+};
@@ -0,0 +1,71 @@
+// The CPU version of the comparison in libtak/alphabeta.cu: score every
+// child of a position (read as TPS on stdin) one at a time and in
+// batches, with the moves repeated to get bigger batches.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include "tak/tak.hpp"
+#include "tak/tps.hpp"
+#include "batch.hpp"
+
+int main() {
+  using namespace std::chrono;
+
+  Board<5> host_board;
+
+  // Read in board from tps
+  std::string board_tps;
+  std::getline(std::cin, board_tps);
+  if(!tps::from_str(board_tps, host_board)) {
+    std::cout << "Failed to parse tps" << std::endl;
+    return -1;
+  }
+  std::cout << tps::to_str(host_board) << std::endl;
+
+  std::vector<Move<5>> host_moves;
+  std::vector<Move<5>> moves;
+
+  typename Board<5>::Map map(host_board);
+  host_board.forEachMove(map, [&moves](Move<5> m) {
+    moves.push_back(m);
+    return CONTINUE;
+  });
+
+  std::cout << "Num moves: " << moves.size() << std::endl;
+  for(int n = 10; n < 1001; n+=10) {
+    host_moves.clear();
+    for(int i = 0; i < n; i++) {
+      host_moves.insert(host_moves.end(), moves.begin(), moves.end());
+    }
+
+    std::vector<Eval::Score> batched(host_moves.size());
+    std::vector<Eval::Score> sequential(host_moves.size());
+
+    std::cout << "Num moves: " << host_moves.size() << std::endl;
+
+    auto start = steady_clock::now();
+    BatchEval<5>::eval(host_board, host_moves.data(), host_moves.size(), WHITE, batched.data());
+    auto end = steady_clock::now();
+
+    printf("batched: %d, time: %lu\n", batched[0], (unsigned long)duration_cast<microseconds>(end-start).count());
+
+    start = steady_clock::now();
+    int i = 0;
+    for(Move<5> move : host_moves) {
+      Board<5> b = host_board;
+      b.execute(move);
+      sequential[i++] = Eval::eval(b,WHITE);
+    }
+    end = steady_clock::now();
+    printf("sequential: %d, time: %lu\n", sequential[0], (unsigned long)duration_cast<microseconds>(end-start).count());
+
+    for(size_t i = 0; i < host_moves.size(); i++) {
+      if(batched[i] != sequential[i]) {
+        printf("Score %lu not the same: %d != %d\n", (unsigned long)i, batched[i], sequential[i]);
+        return -1;
+      }
+    }
+  }
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "eval.hpp"
+#include <iostream>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define BITEVAL_AVX2
+#include <immintrin.h>
+#endif
+
+// Same evaluation as Eval, computed from bit boards instead of walking
+// the neighbours of every square.
+//
+// Neighbour counts come from shifting the masks of each kind of piece
+// and counting the overlap, captive counts come from the owners of the
+// flat topped stacks, four stacks at a time when the CPU has AVX2.
+// Both players are scored in one pass.
+//
+// Build with EVAL_DEBUG to check every evaluation against Eval.
+struct BitEval : Eval {
+  // Bit boards of who owns each square, and what's on top
+  struct Bits {
+    uint64_t occupied, black, flat, cap;
+
+    inline void set(const Stack& s, int i) {
+      uint64_t bit = static_cast<uint64_t>(1)<<i;
+      occupied &= ~bit; black &= ~bit; flat &= ~bit; cap &= ~bit;
+      bit &= -static_cast<uint64_t>(s.height != 0);
+      occupied |= bit;
+      black |= bit & -static_cast<uint64_t>(s.owners&1);
+      flat |= bit & -static_cast<uint64_t>(s.top == Piece::FLAT);
+      cap |= bit & -static_cast<uint64_t>(s.top == Piece::CAP);
+    }
+  };
+
+  template<uint8_t SIZE>
+  static Bits bits(const Board<SIZE>& state) {
+    Bits b = { 0, 0, 0, 0 };
+    for(int i = 0; i < SIZE*SIZE; i++) {
+      const Stack& s = state.board[i];
+      uint64_t bit = static_cast<uint64_t>(s.height != 0)<<i;
+      b.occupied |= bit;
+      b.black |= bit & (static_cast<uint64_t>(s.owners&1)<<i);
+      b.flat |= bit & (static_cast<uint64_t>(s.top == Piece::FLAT)<<i);
+      b.cap |= bit & (static_cast<uint64_t>(s.top == Piece::CAP)<<i);
+    }
+    return b;
+  }
+
+  // The features that only depend on the tops of the stacks
+  template<uint8_t SIZE>
+  static void top_terms(const Bits& b, Terms t[2]) {
+    using G = Geometry<SIZE>;
+    uint64_t owned[2] = { b.occupied & ~b.black, b.black };
+
+    for(int p = 0; p < 2; p++) {
+      uint64_t f = owned[p] & b.flat;
+      t[p].top_flats = __builtin_popcountll(f);
+      t[p].caps = __builtin_popcountll(owned[p] & b.cap);
+      // Every adjacent pair of flats is counted from both ends
+      t[p].adj_flats = 2*(__builtin_popcountll(f & (f>>SIZE)) +
+                          __builtin_popcountll(f & (f>>1) & ~G::east_edge()));
+      // Each piece counts once for every square next to it
+      t[p].influence = __builtin_popcountll(owned[p] & ~G::north_edge()) +
+                       __builtin_popcountll(owned[p] & ~G::south_edge()) +
+                       __builtin_popcountll(owned[p] & ~G::east_edge()) +
+                       __builtin_popcountll(owned[p] & ~G::west_edge());
+    }
+    int influence = t[WHITE].influence - t[BLACK].influence;
+    t[WHITE].influence = influence;
+    t[BLACK].influence = -influence;
+  }
+
+  template<uint8_t SIZE>
+  static void terms(const Board<SIZE>& state, Terms t[2]) {
+    top_terms<SIZE>(bits(state), t);
+    for(int p = 0; p < 2; p++) {
+      t[p].flats = 0;
+      t[p].captured_penalty = 0;
+    }
+
+    int i = 0;
+#ifdef BITEVAL_AVX2
+    if(has_avx2()) {
+      i = stacks_avx2(state.board, SIZE*SIZE & ~3, t);
+    }
+#endif
+    for(; i < SIZE*SIZE; i++) {
+      stack(state.board[i], t);
+    }
+  }
+
+  template<uint8_t SIZE>
+  static Score eval(const Board<SIZE>& state, uint8_t player) {
+    Terms t[2];
+    terms(state, t);
+    Score s = combine(t[player]) - combine(t[!player]);
+#ifdef EVAL_DEBUG
+    Score full = Eval::eval(state, player);
+    if(s != full) {
+      std::cout << "Error: bitboard eval " << s << " != full eval " << full << std::endl;
+    }
+#endif
+    return s;
+  }
+
+  template<uint8_t SIZE>
+  static Score eval(const Board<SIZE>& state, const Accumulator<SIZE>&, uint8_t player) {
+    return eval(state, player);
+  }
+
+  // Reserves and captives under a flat topped stack
+  static inline void stack(const Stack& s, Terms t[2]) {
+    int below = (s.height > 0 && s.top == Piece::FLAT) ? s.height-1 : 0;
+    uint64_t mask = below ? (~static_cast<uint64_t>(0))>>(64-below) : 0;
+    int black_below = __builtin_popcountll((s.owners>>1) & mask);
+    int owner = s.owners&1;
+    int own = owner == BLACK ? black_below : below-black_below;
+    int captives = below-own;
+    t[owner].flats += own;
+    t[owner].captured_penalty += captives >= 3 ? captives*captives : 0;
+  }
+
+#ifdef BITEVAL_AVX2
+  static inline bool has_avx2() {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+  }
+
+private:
+  // The stack loop above for n stacks (a multiple of 4), four at a time.
+  // Returns the number of stacks done.
+  __attribute__((target("avx2")))
+  static int stacks_avx2(const Stack* board, int n, Terms t[2]) {
+    static_assert(sizeof(Stack) == 16, "stacks_avx2 loads two stacks per 128 bits");
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i byte = _mm256_set1_epi64x(0xFF);
+    const __m256i two = _mm256_set1_epi64x(2);
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+    const __m256i nibble_count = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                                  0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+    __m256i flats[2] = { zero, zero };
+    __m256i penalty[2] = { zero, zero };
+    for(int i = 0; i < n; i += 4) {
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(board+i));
+      __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(board+i+2));
+      // The lanes end up out of order, which doesn't matter for sums
+      __m256i owners = _mm256_unpacklo_epi64(a, b);
+      __m256i meta = _mm256_unpackhi_epi64(a, b);
+      __m256i height = _mm256_and_si256(meta, byte);
+      __m256i top = _mm256_and_si256(_mm256_srli_epi64(meta, 8), byte);
+      __m256i is_flat = _mm256_andnot_si256(_mm256_cmpeq_epi64(height, zero),
+                                            _mm256_cmpeq_epi64(top, zero));
+      __m256i below = _mm256_and_si256(is_flat, _mm256_sub_epi64(height, one));
+      __m256i mask = _mm256_sub_epi64(_mm256_sllv_epi64(one, below), one);
+      __m256i pieces = _mm256_and_si256(_mm256_srli_epi64(owners, 1), mask);
+      // Popcount each lane with a nibble lookup
+      __m256i lo = _mm256_shuffle_epi8(nibble_count, _mm256_and_si256(pieces, low_nibble));
+      __m256i hi = _mm256_shuffle_epi8(nibble_count, _mm256_and_si256(_mm256_srli_epi64(pieces, 4), low_nibble));
+      __m256i black_below = _mm256_sad_epu8(_mm256_add_epi8(lo, hi), zero);
+      __m256i white_below = _mm256_sub_epi64(below, black_below);
+      __m256i is_black = _mm256_cmpeq_epi64(_mm256_and_si256(owners, one), one);
+      __m256i own = _mm256_blendv_epi8(white_below, black_below, is_black);
+      __m256i captives = _mm256_sub_epi64(below, own);
+      __m256i square = _mm256_and_si256(_mm256_mul_epu32(captives, captives),
+                                        _mm256_cmpgt_epi64(captives, two));
+      flats[WHITE] = _mm256_add_epi64(flats[WHITE], _mm256_andnot_si256(is_black, own));
+      flats[BLACK] = _mm256_add_epi64(flats[BLACK], _mm256_and_si256(is_black, own));
+      penalty[WHITE] = _mm256_add_epi64(penalty[WHITE], _mm256_andnot_si256(is_black, square));
+      penalty[BLACK] = _mm256_add_epi64(penalty[BLACK], _mm256_and_si256(is_black, square));
+    }
+    for(int p = 0; p < 2; p++) {
+      t[p].flats += sum(flats[p]);
+      t[p].captured_penalty += sum(penalty[p]);
+    }
+    return n;
+  }
+
+  __attribute__((target("avx2")))
+  static inline int sum(__m256i v) {
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    return (int)(_mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1));
+  }
+#endif
+};
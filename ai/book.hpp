@@ -0,0 +1,195 @@
+#pragma once
+
+#include "tak/tak.hpp"
+#include "symmetry.hpp"
+#include "mapped.hpp"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+// Opening books, written by bookgen and read by the bot.
+//
+// A book is a header followed by entries sorted by position, each a
+// position's key, one move from it and that move's weight. A position
+// can have several moves, which sit next to each other; the bot picks
+// one at random in proportion to their weights. Like the solved tables
+// the entries are searched where they lie in the file.
+//
+// Positions are keyed on the canonical hash from Symmetry, so the eight
+// orientations of a position share their entries, and the moves are kept
+// in the canonical orientation.
+template<uint8_t SIZE>
+class Book {
+public:
+  using Sym = Symmetry<SIZE>;
+
+  struct Header {
+    char magic[4];
+    uint8_t size;
+    uint8_t pad[3];
+    uint64_t count;
+  };
+
+  struct Entry {
+    uint64_t key;
+    uint32_t move;
+    uint32_t weight;
+  };
+
+  Book() = default;
+  Book(const Book&) = delete;
+  Book& operator=(const Book&) = delete;
+
+  // The key b is kept under, and the symmetry that takes b to the
+  // orientation its moves are kept in
+  static uint64_t key(const Board<SIZE>& b, int& orientation) {
+    uint64_t h = typename Sym::Hashes(b).canonical(orientation);
+    return util::fnv64(h).hash(b.curPlayer).get();
+  }
+
+  // Moves packed into 21 bits: the square, whether it's a spread, then
+  // the piece or direction, and for spreads the number of pieces carried
+  // and a bit for each of them that's the last dropped on its square
+  static uint32_t pack(Move<SIZE> m) {
+    uint32_t p = m.idx();
+    if(m.type() == Move<SIZE>::Type::PLACE) {
+      return p | (uint32_t)m.pieceType() << 7;
+    }
+    int dir;
+    switch(m.dir()) {
+    case Move<SIZE>::Dir::NORTH: dir = 0; break;
+    case Move<SIZE>::Dir::SOUTH: dir = 1; break;
+    case Move<SIZE>::Dir::EAST: dir = 2; break;
+    default: dir = 3; break;
+    }
+    int carry = 0;
+    uint32_t drops = 0;
+    for(int i = 1; i <= m.range(); i++) {
+      carry += m.slides(i);
+      drops |= 1u << (carry-1);
+    }
+    return p | 1u << 6 | dir << 7 | carry << 9 | drops << 13;
+  }
+
+  static Move<SIZE> unpack(uint32_t p) {
+    uint8_t idx = p & 63;
+    if(!(p & 1u << 6)) {
+      return Move<SIZE>(idx, (Piece)(p >> 7 & 3));
+    }
+    typename Move<SIZE>::Dir dirs[] = {
+      Move<SIZE>::Dir::NORTH, Move<SIZE>::Dir::SOUTH, Move<SIZE>::Dir::EAST, Move<SIZE>::Dir::WEST,
+    };
+    int carry = p >> 9 & 15;
+    uint32_t drops = p >> 13 & 255;
+    uint8_t slides[SIZE-1] = { 0 };
+    uint8_t range = 0;
+    for(int i = 0, n = 0; i < carry && range < SIZE-1; i++) {
+      n++;
+      if(drops & 1u << i) {
+        slides[range++] = n;
+        n = 0;
+      }
+    }
+    return Move<SIZE>(idx, dirs[p >> 7 & 3], range, slides);
+  }
+
+  // Sort entries, adding up the weights of any that repeat, and write
+  // them to path
+  static bool write(const std::string& path, std::vector<Entry>& entries) {
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+      return a.key != b.key ? a.key < b.key : a.move < b.move;
+    });
+    std::vector<Entry> merged;
+    for(const Entry& e : entries) {
+      if(merged.size() && merged.back().key == e.key && merged.back().move == e.move) {
+        merged.back().weight += e.weight;
+      } else if(e.weight) {
+        merged.push_back(e);
+      }
+    }
+    std::ofstream out(path, std::ios::binary);
+    if(!out.is_open()) return false;
+    Header h = { { 'T', 'B', 'O', 'K' }, SIZE, { 0, 0, 0 }, merged.size() };
+    out.write((const char*)&h, sizeof(h));
+    out.write((const char*)merged.data(), merged.size()*sizeof(Entry));
+    entries.swap(merged);
+    return out.good();
+  }
+
+  bool open(const std::string& path) {
+    close();
+    if(!file.open(path)) return false;
+    Header h;
+    if(file.size() < sizeof(h)) {
+      close();
+      return false;
+    }
+    std::memcpy(&h, file.data(), sizeof(h));
+    if(std::memcmp(h.magic, "TBOK", 4) || h.size != SIZE ||
+       file.size() != sizeof(h) + h.count*sizeof(Entry)) {
+      close();
+      return false;
+    }
+    count = h.count;
+    entries = (const Entry*)(file.data() + sizeof(h));
+    return true;
+  }
+
+  void close() {
+    file.close();
+    entries = nullptr;
+    count = 0;
+  }
+
+  // The book the bot plays from
+  static Book& get() {
+    static Book book;
+    return book;
+  }
+
+  bool loaded() const { return entries != nullptr; }
+  size_t size() const { return count; }
+
+  // The book's moves from b with their weights, in b's orientation
+  std::vector<std::pair<Move<SIZE>, uint32_t>> moves(const Board<SIZE>& b) const {
+    std::vector<std::pair<Move<SIZE>, uint32_t>> out;
+    if(!entries) return out;
+    int orientation;
+    uint64_t k = key(b, orientation);
+    const Entry* it = std::lower_bound(entries, entries+count, k,
+                                       [](const Entry& e, uint64_t k) { return e.key < k; });
+    for(; it != entries+count && it->key == k; it++) {
+      Move<SIZE> m = Sym::transform(Sym::inverse(orientation), unpack(it->move));
+      // Guard against positions that only share a hash
+      if(b.valid(m)) out.push_back(std::make_pair(m, it->weight));
+    }
+    return out;
+  }
+
+  // Pick one of the book's moves from b, in proportion to their weights,
+  // using random to choose. False if b isn't in the book.
+  bool choose(const Board<SIZE>& b, Move<SIZE>& move, uint64_t random) const {
+    auto options = moves(b);
+    uint64_t total = 0;
+    for(auto& o : options) total += o.second;
+    if(!total) return false;
+    uint64_t r = random % total;
+    for(auto& o : options) {
+      if(r < o.second) {
+        move = o.first;
+        return true;
+      }
+      r -= o.second;
+    }
+    return false;
+  }
+
+private:
+  MappedFile file;
+  size_t count = 0;
+  const Entry* entries = nullptr;
+};
@@ -0,0 +1,198 @@
+// Builds opening books for the bot (see book.hpp), one of two ways:
+//
+//   search: every position within the first few plies is searched to a
+//   fixed depth on all threads, and the book gets the best few moves
+//   found by a multi-PV search, those close enough to the best weighted
+//   by how close. Every reply is followed, so whatever the opponent
+//   plays the next position is in the book too.
+//
+//   games: the first few plies of a collection of games (PTN on stdin)
+//   are counted up, weighting each move by how it worked out for the
+//   player who made it: two for a win, one for a draw. Moves seen in
+//   fewer than a minimum number of games are left out.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <memory>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
+#include "tak/tak.hpp"
+#include "tak/ptn.hpp"
+#include "tak/ptnfile.hpp"
+#include "alphabeta.hpp"
+#include "incremental.hpp"
+#include "corpus.hpp"
+#include "book.hpp"
+
+// How far behind the best move, in evaluator units (a flat is 100 by
+// default), another can be and still go in the book
+static const int MARGIN = 100;
+
+template<uint8_t SIZE>
+static int search(const std::string& out, int plies, int depth, int threads, int lines) {
+  using B = Book<SIZE>;
+  std::vector<typename B::Entry> entries;
+  std::unordered_set<uint64_t> seen;
+  std::vector<Board<SIZE>> level(1);
+  int orientation;
+  seen.insert(B::key(level[0], orientation));
+
+  std::vector<std::unique_ptr<alphabeta<SIZE, IncrementalEval>>> searches;
+  for(int t = 0; t < threads; t++) {
+    searches.emplace_back(new alphabeta<SIZE, IncrementalEval>());
+    searches.back()->set_log(nullptr);
+  }
+
+  for(int ply = 0; ply < plies && level.size(); ply++) {
+    std::cerr << "Ply " << ply+1 << ": searching " << level.size() << " positions" << std::endl;
+    std::vector<std::vector<typename B::Entry>> found(level.size());
+    std::atomic<size_t> done(0);
+    corpus::parallel_for(level.size(), threads, [&](size_t begin, size_t end, int t) {
+      for(size_t i = begin; i < end; i++) {
+        Board<SIZE> b = level[i];
+        auto pvs = searches[t]->search_multipv(b, lines, depth);
+        int o;
+        uint64_t k = B::key(b, o);
+        for(auto& l : pvs) {
+          int behind = pvs[0].score - l.score;
+          if(behind > MARGIN) break;
+          found[i].push_back({ k, B::pack(Symmetry<SIZE>::transform(o, l.move)), (uint32_t)(MARGIN+1-behind) });
+        }
+        size_t n = ++done;
+        if(t == 0) std::cerr << n << "/" << level.size() << "\r" << std::flush;
+      }
+    });
+    std::cerr << std::endl;
+    for(auto& f : found) entries.insert(entries.end(), f.begin(), f.end());
+    if(ply+1 == plies) break;
+
+    // Everything one ply on, once per orientation
+    std::vector<Board<SIZE>> next;
+    for(Board<SIZE>& b : level) {
+      typename Board<SIZE>::Map map(b);
+      b.forEachMove(map, [&](Move<SIZE> m) {
+        Board<SIZE> c = b;
+        c.execute(m);
+        if(!c.status().over && seen.insert(B::key(c, orientation)).second) {
+          next.push_back(c);
+        }
+        return CONTINUE;
+      });
+    }
+    level.swap(next);
+  }
+
+  if(!B::write(out, entries)) {
+    std::cout << "Failed to write " << out << std::endl;
+    return -1;
+  }
+  std::cout << "Wrote " << entries.size() << " book moves to " << out << std::endl;
+  return 0;
+}
+
+template<uint8_t SIZE>
+static int games(const std::string& out, int plies, int min_games) {
+  using B = Book<SIZE>;
+  struct Count { uint32_t games = 0, weight = 0; };
+  std::unordered_map<uint64_t, std::unordered_map<uint32_t, Count>> counts;
+
+  // The book moves of a game, waiting on its result
+  struct Played { uint64_t key; uint32_t move; uint8_t player; };
+  std::vector<Played> played;
+
+  int used = 0, skipped = 0;
+  ptn::Reader<SIZE> reader(std::cin);
+  while(reader.next_game()) {
+    if(reader.size() && reader.size() != SIZE) {
+      skipped++;
+      continue;
+    }
+    played.clear();
+    Move<SIZE> m;
+    bool any = false;
+    while(reader.next(m)) {
+      any = true;
+      if(reader.ply() >= plies) continue;
+      const Board<SIZE>& b = reader.position();
+      int o;
+      uint64_t k = B::key(b, o);
+      played.push_back({ k, B::pack(Symmetry<SIZE>::transform(o, m)), b.curPlayer });
+    }
+    if(reader.error().size()) {
+      std::cout << reader.error() << " in game " << used+skipped+1 << std::endl;
+    }
+    if(!any && reader.error().empty()) continue;
+
+    float result;
+    if(!corpus::parse_result(reader.result(), result)) {
+      skipped++;
+      continue;
+    }
+    for(const Played& p : played) {
+      float score = p.player == WHITE ? result : 1-result;
+      Count& c = counts[p.key][p.move];
+      c.games++;
+      c.weight += (uint32_t)(2*score + 0.5f);
+    }
+    used++;
+  }
+  std::cout << "Read " << used << " games, skipped " << skipped << std::endl;
+
+  std::vector<typename B::Entry> entries;
+  for(auto& p : counts) {
+    for(auto& m : p.second) {
+      if((int)m.second.games >= min_games && m.second.weight) {
+        entries.push_back({ p.first, m.first, m.second.weight });
+      }
+    }
+  }
+  if(!B::write(out, entries)) {
+    std::cout << "Failed to write " << out << std::endl;
+    return -1;
+  }
+  std::cout << "Wrote " << entries.size() << " book moves from " << counts.size() << " positions to " << out << std::endl;
+  return 0;
+}
+
+template<uint8_t SIZE>
+static int build(const std::string& mode, const std::string& out, int plies, int arg, int threads, int lines) {
+  if(mode == "search") return search<SIZE>(out, plies, arg, threads, lines);
+  if(mode == "games") return games<SIZE>(out, plies, arg);
+  std::cout << "Unknown mode " << mode << std::endl;
+  return -1;
+}
+
+int main(int argc, char** argv) {
+  if(argc < 4) {
+    std::cout << "usage: bookgen <size> search <out> [plies] [depth] [threads] [lines]" << std::endl;
+    std::cout << "       bookgen <size> games <out> [plies] [min games] < games.ptn" << std::endl;
+    return -1;
+  }
+  int size = std::atoi(argv[1]);
+  std::string mode = argv[2];
+  std::string out = argv[3];
+  int plies = argc > 4 ? std::atoi(argv[4]) : 4;
+  int arg = argc > 5 ? std::atoi(argv[5]) : mode == "search" ? 6 : 2;
+  int threads = argc > 6 ? std::atoi(argv[6]) : std::thread::hardware_concurrency();
+  if(threads < 1) threads = 1;
+  int lines = argc > 7 ? std::atoi(argv[7]) : 1;
+  if(lines < 1) lines = 1;
+
+  Eval::load_weights("weights.txt");
+
+  switch(size) {
+  case 3: return build<3>(mode, out, plies, arg, threads, lines);
+  case 4: return build<4>(mode, out, plies, arg, threads, lines);
+  case 5: return build<5>(mode, out, plies, arg, threads, lines);
+  case 6: return build<6>(mode, out, plies, arg, threads, lines);
+  case 7: return build<7>(mode, out, plies, arg, threads, lines);
+  case 8: return build<8>(mode, out, plies, arg, threads, lines);
+  default:
+    std::cout << "Boards of size < 3 or > 8 not supported!" << std::endl;
+    return -1;
+  }
+}
@@ -7,7 +7,12 @@
 #include <queue>
 #include <memory>
 #include <unordered_set>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <functional>
 #include <cstdint>
+#include <random>
 #define ASIO_STANDALONE
 #include "asio.hpp"
 #include "tak/tak.hpp"
@@ -15,7 +20,15 @@
 #include "tak/ptn.hpp"
 #include "tak/tps.hpp"
 #include "alphabeta.hpp"
+#include "mcts.hpp"
 #include "eval.hpp"
+#include "incremental.hpp"
+#include "biteval.hpp"
+#include "nnue.hpp"
+#include "solved.hpp"
+#include "book.hpp"
+#include "scheduler.hpp"
+#include "metrics.hpp"
 
 using asio::ip::tcp;
 using err_t = std::error_code;
@@ -26,16 +39,59 @@ using namespace tak::net;
 
 class client : public ServerMsg::Visitor, DynamicBoard::Visitor {
 public:
-  client(asio::io_service& io, tcp::resolver::iterator endpoints, Login login, std::vector<std::string> whitelist) : io(io), sock(io), login(login), whitelist(whitelist), game_id(-1), max_depth(DEFAULT_MAX_DEPTH) {
+  client(asio::io_service& io, tcp::resolver::iterator endpoints, Login login, std::vector<std::string> whitelist, double mcts_seconds, int mcts_threads, int cores, int max_games, std::string metrics_log, int metrics_port) : io(io), sock(io), ping_timer(io), login(login), whitelist(whitelist), next_depth(DEFAULT_MAX_DEPTH), current(nullptr), mcts_seconds(mcts_seconds), mcts_threads(mcts_threads), max_games(max_games), scheduler(cores) {
+    if(metrics_log.size() && !metrics.open_log(metrics_log)) {
+      std::cout << "Failed to open " << metrics_log << std::endl;
+    }
+    if(metrics_port) {
+      metrics_acceptor = std::unique_ptr<tcp::acceptor>(
+        new tcp::acceptor(io, tcp::endpoint(asio::ip::address_v4::loopback(), metrics_port)));
+      serve_metrics();
+    }
     connect(endpoints);
   }
 private:
+  // The searches for one game, kept between its moves. Only one search
+  // runs on them at a time.
+  struct EnginesBase {
+    virtual ~EnginesBase() {}
+    std::mutex lock;
+  };
+
+  template<uint8_t N>
+  struct Engines : EnginesBase {
+    alphabeta<N, IncrementalEval> ab;
+    alphabeta<N, NNUE> ab_nnue;
+    mcts<N, BitEval> tree;
+    mcts<N, NNUE> tree_nnue;
+  };
+
+  using Cancel = Scheduler::Cancel;
+
+  struct Game {
+    int id;
+    int size;
+    std::unique_ptr<DynamicBoard> board;
+    // Everything played so far, to replay after an undo
+    std::vector<DynamicMove> moves;
+    Player color;
+    std::string opponent;
+    int max_depth;
+    // Seconds left on our clock, or 0 if the server hasn't said
+    double clock = 0;
+    // Bumped on every move, so stale search results can be told apart
+    int generation = 0;
+    // Made when the game first needs a search, once its size is known
+    std::shared_ptr<EnginesBase> engines;
+    // The search for our next move, if there's one queued or running
+    std::shared_ptr<Cancel> search;
+  };
 
   void seek() {
     //send_msg_io(ClientMsg::seek(5, 1800, 0, WHITE));
   }
 
-  virtual void error_msg(std::string msg) {
+  virtual void error_msg(util::string_view msg) {
     std::cout << "ERROR: " << msg << std::endl;
   }
 
@@ -47,37 +103,55 @@ private:
     send_msg_io(ClientMsg::login(login.username, login.password));
   }
 
-  virtual void login_success_msg(std::string name) {
+  virtual void login_success_msg(util::string_view name) {
     seek();
   }
 
   virtual void game_start_msg(
-    int id, int size, std::string player1, std::string player2, Player player
+    int id, int size, util::string_view player1, util::string_view player2, Player player
   ) {
-    otherPlayer = player == WHITE ? player2 : player1;
-    std::cout << "Starting game against " << otherPlayer << std::endl;
-    my_color = player;
-
-    game = std::unique_ptr<DynamicBoard>(new DynamicBoard(size));
-    game_id = id;
-
-    //send_msg_io(ClientMsg::shout("Good luck, "+otherPlayer+"!"));
-
-    if(my_color == WHITE) {
-      game->accept(*this);
+    std::unique_ptr<Game> game(new Game());
+    game->id = id;
+    game->size = size;
+    game->opponent = (player == WHITE ? player2 : player1).str();
+    game->color = player;
+    game->board = std::unique_ptr<DynamicBoard>(new DynamicBoard(size));
+    game->max_depth = next_depth;
+    next_depth = DEFAULT_MAX_DEPTH;
+    std::cout << "Starting game " << id << " against " << game->opponent << std::endl;
+
+    //send_msg_io(ClientMsg::shout("Good luck, "+game->opponent+"!"));
+
+    Game& g = *game;
+    games[id] = std::move(game);
+    if(g.color == WHITE) {
+      think(g);
     }
   }
 
   virtual void move_msg(int id, DynamicMove move) {
-    if(id == game_id && game) {
-      std::cout << "Recieved move from opponent: " << ptn::to_str(move) << std::endl;
-      game->execute(move);
-      game->accept(*this);
+    auto it = games.find(id);
+    if(it != games.end()) {
+      std::cout << "Recieved move from opponent in game " << id << ": " << ptn::to_str(move) << std::endl;
+      Game& g = *it->second;
+      g.board->execute(move);
+      g.moves.push_back(move);
+      g.generation++;
+      think(g);
     } else {
       std::cout << "Recieved move for unknown game: " << ptn::to_str(move) << std::endl;
     }
   }
 
+  virtual void time_msg(int id, int white_time, int black_time) {
+    auto it = games.find(id);
+    if(it != games.end()) {
+      Game& g = *it->second;
+      g.clock = g.color == WHITE ? white_time : black_time;
+      scheduler.set_clock(id, g.clock);
+    }
+  }
+
   virtual void game_over_msg(int id, GameStatus status) {
     game_done(id);
   }
@@ -86,13 +160,37 @@ private:
     game_done(id);
   }
 
+  // Take back the last move, ours or theirs
+  virtual void undo_msg(int id) {
+    auto it = games.find(id);
+    if(it == games.end() || it->second->moves.empty()) return;
+    Game& g = *it->second;
+    stop_search(g);
+    g.moves.pop_back();
+    g.board = std::unique_ptr<DynamicBoard>(new DynamicBoard(g.size));
+    for(DynamicMove m : g.moves) g.board->execute(m);
+    g.generation++;
+    std::cout << "Undid the last move in game " << id << std::endl;
+    // White moves on even plies
+    if((g.moves.size() % 2 == 0) == (g.color == WHITE)) {
+      think(g);
+    }
+  }
+
+  // Drop whatever search g has queued, and stop the one running
+  void stop_search(Game& g) {
+    scheduler.cancel(g.id);
+    if(g.search) g.search->cancel();
+    g.search.reset();
+  }
+
   // Called whichever way a game ends
   void game_done(int id) {
-    if(id == game_id) {
-      //send_msg_io(ClientMsg::shout("gg, "+otherPlayer+"!"));
-      game_id = -1;
-      game.reset();
-      max_depth = DEFAULT_MAX_DEPTH;
+    auto it = games.find(id);
+    if(it != games.end()) {
+      //send_msg_io(ClientMsg::shout("gg, "+it->second->opponent+"!"));
+      stop_search(*it->second);
+      games.erase(it);
       seek();
     }
   }
@@ -110,7 +208,8 @@ private:
     seeks.erase(seek);
   }
 
-  virtual void shout_msg(std::string name, std::string msg) {
+  virtual void shout_msg(util::string_view player, util::string_view text) {
+    std::string name = player.str(), msg = text.str();
     std::regex command_rgx("^cutak_bot: (.*)");
     std::smatch match;
     if(std::regex_search(msg, match, command_rgx)) {
@@ -119,12 +218,12 @@ private:
                                       std::istream_iterator<std::string>());
 
       if(words.size() && words[0] == "play") {
-        if(game) {
-          send_msg_io(ClientMsg::shout("Sorry "+name+", I'm currently playing a game against "+otherPlayer+". Please try again once this game is over."));
+        if((int)games.size() >= max_games) {
+          send_msg_io(ClientMsg::shout("Sorry "+name+", I'm currently playing as many games as I can. Please try again once one of them is over."));
         } else {
           if(words.size() == 2) {
             try {
-              max_depth = std::stoi(words[1]);
+              next_depth = std::stoi(words[1]);
             } catch(std::exception e) {
               send_msg(ClientMsg::shout("Sorry "+name+", I failed to parse the depth `"+words[1]+"'"));
             }
@@ -158,9 +257,10 @@ private:
     });
   }
 
-  void send_msg_io(ClientMsg msg) {
+  // sent, if given, is called once msg has been written
+  void send_msg_io(ClientMsg msg, std::function<void()> sent = nullptr) {
     bool send_in_progress = msg_queue.size() > 0;
-    msg_queue.push(msg.text());
+    msg_queue.push({ msg.text(), sent });
     if(!send_in_progress) {
       do_send_msg();
     }
@@ -169,13 +269,7 @@ private:
   void connect(tcp::resolver::iterator endpoints) {
     asio::async_connect(sock, endpoints, [this](err_t err, tcp::resolver::iterator) {
       if(!err) {
-        std::thread([this]() {
-          while(true) {
-            std::cout << "Sending ping..."<< std::endl;
-            send_msg(ClientMsg::ping());
-            std::this_thread::sleep_for(std::chrono::seconds(30));
-          }
-        }).detach();
+        ping();
         readline();
       } else {
         std::cout << "Error connecting socket: " << err.message() << std::endl;
@@ -184,15 +278,46 @@ private:
     });
   }
 
+  // Keep the connection alive, every 30 seconds from now on
+  void ping() {
+    std::cout << "Sending ping..."<< std::endl;
+    send_msg_io(ClientMsg::ping());
+    ping_timer.expires_from_now(std::chrono::seconds(30));
+    ping_timer.async_wait([this](err_t err) {
+      if(!err) ping();
+    });
+  }
+
+  // Answer whatever's asked on the metrics port with the metrics, for
+  // Prometheus to scrape
+  void serve_metrics() {
+    auto conn = std::make_shared<tcp::socket>(io);
+    metrics_acceptor->async_accept(*conn, [this, conn](err_t err) {
+      if(err) return;
+      auto request = std::make_shared<asio::streambuf>();
+      asio::async_read_until(*conn, *request, "\r\n\r\n", [this, conn, request](err_t err, std::size_t) {
+        if(err) return;
+        auto response = std::make_shared<std::string>(
+          "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n\r\n" + metrics.prometheus());
+        // The connection closes once the last of these handlers is done
+        asio::async_write(*conn, asio::buffer(*response), [conn, response](err_t, std::size_t) {});
+      });
+      serve_metrics();
+    });
+  }
+
   void readline() {
-    asio::async_read_until(sock, buf, '\n', [this](err_t err, std::size_t) {
+    asio::async_read_until(sock, buf, '\n', [this](err_t err, std::size_t n) {
       if(!err) {
-        std::istream is(&buf);
-        std::string line;
-        std::getline(is, line);
-
-        // Handle incoming messages
-        ServerMsg(line).handle(*this);
+        // Handle incoming messages where they sit in the buffer, without
+        // the newline
+        received = std::chrono::steady_clock::now();
+        received_at = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+        const char* line = asio::buffer_cast<const char*>(buf.data());
+        size_t length = n-1;
+        if(length && line[length-1] == '\r') length--;
+        ServerMsg(util::string_view(line, length)).handle(*this);
+        buf.consume(n);
 
         readline();
 
@@ -204,9 +329,10 @@ private:
   }
 
   void do_send_msg() {
-    asio::async_write(sock, asio::buffer(msg_queue.front()), [this](err_t err, std::size_t) {
+    asio::async_write(sock, asio::buffer(msg_queue.front().text), [this](err_t err, std::size_t) {
       if(!err) {
-        std::cout << "Send message `" << msg_queue.front() << "' to server" << std::endl;
+        std::cout << "Send message `" << msg_queue.front().text << "' to server" << std::endl;
+        if(msg_queue.front().sent) msg_queue.front().sent();
         msg_queue.pop();
         if(msg_queue.size()) {
           do_send_msg();
@@ -218,25 +344,123 @@ private:
     });
   }
 
+  // Searches keep what they learn between moves of the same game
+  template<uint8_t N, typename Evaluator>
+  Move<N> think_ab(alphabeta<N, Evaluator>& ab, Board<N>& board, int depth, Cancel& cancel, MoveMetrics& record) {
+    MoveMetrics::Time last = std::chrono::steady_clock::now();
+    typename alphabeta<N, Evaluator>::Handle search = ab.start(board, depth, [&record, &last](const typename alphabeta<N, Evaluator>::Line&) {
+      record.iterations.push_back(MoveMetrics::since(last));
+      last = std::chrono::steady_clock::now();
+    });
+    if(!cancel.attach([search]() { search.stop(); })) search.stop();
+    Move<N> move;
+    typename alphabeta<N, Evaluator>::Score score = search.wait(move);
+    cancel.detach();
+    record.source = "alphabeta";
+    record.nodes = ab.nodes();
+    record.ttable_hits = ab.ttable_hits();
+    std::cout << "Best move: " << ptn::to_str(move) << " with score " << score << std::endl;
+    return move;
+  }
+
+  // Same, searching with MCTS for a fixed time instead
+  template<uint8_t N, typename Evaluator>
+  Move<N> think_mcts(mcts<N, Evaluator>& tree, Board<N>& board, double seconds, int threads, Cancel& cancel, MoveMetrics& record) {
+    typename mcts<N, Evaluator>::Options options;
+    options.threads = threads;
+    tree.set_options(options);
+    Move<N> move;
+    typename mcts<N, Evaluator>::Score score = tree.search(board, move, seconds, &cancel.cancelled);
+    record.source = "mcts";
+    record.nodes = tree.num_playouts();
+    std::cout << "Best move: " << ptn::to_str(move) << " with score " << score << std::endl;
+    return move;
+  }
+
+  template<uint8_t N>
+  Move<N> think(Engines<N>& engines, Board<N>& board, int depth, double clock, int threads, Cancel& cancel, MoveMetrics& record) {
+    std::lock_guard<std::mutex> guard(engines.lock);
+    // Cancelled while waiting for the last search to finish
+    if(cancel.cancelled) return Move<N>();
+    // Play straight from the solved positions where there are any
+    Move<N> move;
+    Solved result;
+    int plies;
+    if(SolvedTable<N>::get().best_move(board, move, result, plies)) {
+      const char* names[] = { "unknown", "win", "loss", "draw" };
+      std::cout << "Best move: " << ptn::to_str(move) << " from the table, a "
+                << names[(int)result] << " in " << plies << " plies" << std::endl;
+      record.source = "table";
+      return move;
+    }
+    // Then from the opening book, picking among its moves at random
+    static thread_local std::mt19937_64 rng(std::random_device{}());
+    if(Book<N>::get().choose(board, move, rng())) {
+      std::cout << "Best move: " << ptn::to_str(move) << " from the book" << std::endl;
+      record.source = "book";
+      return move;
+    }
+    // Use the network for this size if one was loaded
+    if(mcts_seconds > 0) {
+      // Don't spend more than a twentieth of what's left on one move
+      double seconds = clock > 0 ? std::min(mcts_seconds, clock/20) : mcts_seconds;
+      threads = std::min(threads, mcts_threads);
+      return NNUE::loaded<N>() ? think_mcts(engines.tree_nnue, board, seconds, threads, cancel, record)
+                               : think_mcts(engines.tree, board, seconds, threads, cancel, record);
+    }
+    return NNUE::loaded<N>() ? think_ab(engines.ab_nnue, board, depth, cancel, record)
+                             : think_ab(engines.ab, board, depth, cancel, record);
+  }
+
+  // Queue a search for our move in g, which visit picks up
+  void think(Game& g) {
+    g.search = std::make_shared<Cancel>();
+    current = &g;
+    g.board->accept(*this);
+    current = nullptr;
+  }
+
 // I'd like to find a way to get rid of this macro...
 #define VISIT(N) \
   virtual void visit(Board<N>& board) { \
-    int id = game_id; \
-    std::thread([this, board, id] () mutable { \
-      static alphabeta<N, Eval> ab; \
-      Move<N> move; \
-      alphabeta<N, Eval>::Score score = ab.search(board, move, max_depth); \
-      std::cout << "Best move: " << ptn::to_str(move) << " with score " << score << std::endl; \
-      std::cout << "Move sequence: "; \
-      std::cout << std::endl; \
-      io.post([this, move, id]() mutable { \
-        if(id == game_id && game) { \
-          DynamicMove m = move;\
-          game->execute(m); \
-          send_msg_io(ClientMsg::move(game_id, m)); \
+    Game& g = *current; \
+    if(!g.engines) g.engines = std::make_shared<Engines<N>>(); \
+    std::shared_ptr<Engines<N>> engines = std::static_pointer_cast<Engines<N>>(g.engines); \
+    int id = g.id, generation = g.generation, depth = g.max_depth; \
+    double clock = g.clock; \
+    std::shared_ptr<Cancel> cancel = g.search; \
+    MoveMetrics record; \
+    record.game = id; \
+    record.received = received; \
+    record.received_at = received_at; \
+    record.parse = MoveMetrics::since(received); \
+    MoveMetrics::Time submitted = std::chrono::steady_clock::now(); \
+    scheduler.submit(id, clock, mcts_seconds > 0, [this, board, engines, cancel, record, submitted, id, generation, depth, clock](int threads) mutable { \
+      record.queued = MoveMetrics::since(submitted); \
+      MoveMetrics::Time started = std::chrono::steady_clock::now(); \
+      Move<N> move = think<N>(*engines, board, depth, clock, threads, *cancel, record); \
+      record.search = MoveMetrics::since(started); \
+      record.found = std::chrono::steady_clock::now(); \
+      if(cancel->cancelled) { \
+        std::cout << "Stopped searching in game " << id << std::endl; \
+        return; \
+      } \
+      io.post([this, move, record, id, generation]() mutable { \
+        auto it = games.find(id); \
+        if(it != games.end() && it->second->generation == generation) { \
+          DynamicMove m = move; \
+          it->second->board->execute(m); \
+          it->second->moves.push_back(m); \
+          it->second->generation++; \
+          it->second->search.reset(); \
+          send_msg_io(ClientMsg::move(id, m), [this, record]() mutable { \
+            record.send = MoveMetrics::since(record.found); \
+            record.total = MoveMetrics::since(record.received); \
+            metrics.add(record); \
+          }); \
         } \
       }); \
-    }).detach(); \
+    }); \
   }
 
   VISIT(3)
@@ -246,15 +470,29 @@ private:
   VISIT(7)
   VISIT(8)
 
-  std::unique_ptr<DynamicBoard> game;
-  Player my_color;
-  std::string otherPlayer;
-  int game_id;
-  int max_depth;
+  // Games in progress, by id. Only touched on the io thread.
+  std::map<int, std::unique_ptr<Game>> games;
+  // Depth for the next game to start
+  int next_depth;
   static const int DEFAULT_MAX_DEPTH = 6;
+  // The game visit is searching for
+  Game* current;
+  // Seconds per move to search with MCTS, or 0 to use alphabeta
+  double mcts_seconds;
+  // At most this many threads for one search
+  int mcts_threads;
+  int max_games;
 
   asio::streambuf buf;
-  std::queue<std::string> msg_queue;
+  struct Outgoing {
+    std::string text;
+    std::function<void()> sent;
+  };
+  std::queue<Outgoing> msg_queue;
+  // When the message being handled arrived
+  MoveMetrics::Time received;
+  double received_at;
+  Metrics metrics;
 
   // Login information
   Login login;
@@ -266,14 +504,55 @@ private:
 
   asio::io_service& io;
   tcp::socket sock;
+  asio::steady_timer ping_timer;
+  std::unique_ptr<tcp::acceptor> metrics_acceptor;
+
+  // Declared last so it's destroyed first, while what the searches
+  // post back to is still there
+  Scheduler scheduler;
 };
 
+template<uint8_t N>
+static void load_book() {
+  std::string path = "book" + std::to_string(N) + ".bin";
+  if(Book<N>::get().open(path)) {
+    std::cout << "Loaded " << Book<N>::get().size() << " " << (int)N << "x" << (int)N << " book moves from " << path << std::endl;
+  }
+}
+
 int main(int argc, char** argv) {
   if(argc < 3) {
     std::cout << "please specify a server to connect to" << std::endl;
+    std::cout << "usage: bot <host> <port> [--mcts <seconds per move> [threads]] [--cores <n>] [--games <n>] [--metrics-log <file>] [--metrics-port <port>]" << std::endl;
     return -1;
   }
 
+  double mcts_seconds = 0;
+  int mcts_threads = std::thread::hardware_concurrency();
+  // Searches run on this many cores, shared between this many games
+  int cores = std::thread::hardware_concurrency();
+  int max_games = 4;
+  // Per move metrics as JSON lines, and/or for Prometheus on localhost
+  std::string metrics_log;
+  int metrics_port = 0;
+  for(int i = 3; i+1 < argc; i++) {
+    std::string arg = argv[i];
+    if(arg == "--mcts") {
+      mcts_seconds = std::atof(argv[++i]);
+      if(i+1 < argc && argv[i+1][0] != '-') mcts_threads = std::atoi(argv[++i]);
+    } else if(arg == "--cores") {
+      cores = std::atoi(argv[++i]);
+    } else if(arg == "--games") {
+      max_games = std::atoi(argv[++i]);
+    } else if(arg == "--metrics-log") {
+      metrics_log = argv[++i];
+    } else if(arg == "--metrics-port") {
+      metrics_port = std::atoi(argv[++i]);
+    }
+  }
+  if(mcts_threads < 1) mcts_threads = 1;
+  if(cores < 1) cores = 1;
+
   std::ifstream auth("auth.txt");
   if(!auth.is_open()) {
     std::cout << "Failed to open auth.txt" << std::endl;
@@ -295,11 +574,33 @@ int main(int argc, char** argv) {
   std::getline(auth, login.username);
   std::getline(auth, login.password);
 
+  if(Eval::load_weights("weights.txt")) {
+    std::cout << "Loaded evaluation weights from weights.txt" << std::endl;
+  }
+  for(int size = 3; size <= 8; size++) {
+    std::string path = "nnue" + std::to_string(size) + ".bin";
+    if(NNUE::load(path) == size) {
+      std::cout << "Loaded " << size << "x" << size << " network from " << path << std::endl;
+    }
+  }
+  if(SolvedTable<3>::get().open("solved3.bin")) {
+    std::cout << "Loaded " << SolvedTable<3>::get().size() << " solved 3x3 positions from solved3.bin" << std::endl;
+  }
+  if(SolvedTable<4>::get().open("solved4.bin")) {
+    std::cout << "Loaded " << SolvedTable<4>::get().size() << " solved 4x4 positions from solved4.bin" << std::endl;
+  }
+  load_book<3>();
+  load_book<4>();
+  load_book<5>();
+  load_book<6>();
+  load_book<7>();
+  load_book<8>();
+
   asio::io_service io;
   tcp::resolver resolver(io);
   tcp::socket socket(io);
   tcp::resolver::iterator endpoints = resolver.resolve({argv[1], argv[2]});
-  client c(io, endpoints, login, whitelist);
+  client c(io, endpoints, login, whitelist, mcts_seconds, mcts_threads, cores, max_games, metrics_log, metrics_port);
   std::thread io_thread([&io](){ io.run(); });
 
   while(true) {
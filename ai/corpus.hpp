@@ -0,0 +1,59 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Helpers shared by the tools that learn from a corpus of positions
+// labelled with the result of the game they came from, one per line:
+//
+//   <tps> <result>
+//
+// where the result is from white's point of view (1-0, 0-1, 1/2-1/2, or
+// the R-0/0-F style results Playtak reports).
+namespace corpus {
+
+inline bool parse_result(const std::string& r, float& result) {
+  if(r == "1-0" || r == "R-0" || r == "F-0" || r == "1") result = 1;
+  else if(r == "0-1" || r == "0-R" || r == "0-F" || r == "0") result = 0;
+  else if(r == "1/2-1/2" || r == "0.5") result = 0.5;
+  else return false;
+  return true;
+}
+
+// Split a corpus line into its tps and result
+inline bool parse_line(const std::string& line, std::string& tps, float& result) {
+  size_t split = line.find_last_of(' ');
+  if(split == std::string::npos || !parse_result(line.substr(split+1), result)) {
+    return false;
+  }
+  tps = line.substr(0, split);
+  return true;
+}
+
+// The non-empty lines of a file
+inline bool read_lines(const std::string& path, std::vector<std::string>& lines) {
+  std::ifstream f(path);
+  if(!f.is_open()) {
+    return false;
+  }
+  std::string line;
+  while(std::getline(f, line)) {
+    if(line.size()) lines.push_back(line);
+  }
+  return true;
+}
+
+// Run f(begin, end, thread) over [0, n) split across threads
+template<typename F>
+void parallel_for(size_t n, int threads, F f) {
+  std::vector<std::thread> pool;
+  for(int t = 0; t < threads; t++) {
+    size_t begin = n*t/threads, end = n*(t+1)/threads;
+    pool.emplace_back([=]() { f(begin, end, t); });
+  }
+  for(auto& t : pool) t.join();
+}
+
+}
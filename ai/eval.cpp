@@ -1,4 +1,44 @@
 #include "eval.hpp"
+#include <fstream>
+#include <iostream>
 
 std::mt19937 Eval::generator;
 std::uniform_int_distribution<int> Eval::distribution = std::uniform_int_distribution<int>(-500,500);
+
+Eval::Weights Eval::weights;
+
+bool Eval::load_weights(const std::string& path) {
+  std::ifstream f(path);
+  if(!f.is_open()) {
+    return false;
+  }
+
+  Weights w = weights;
+  std::string name;
+  int value;
+  while(f >> name >> value) {
+#define WEIGHT(n) if(name == #n) { w.n = value; continue; }
+    EVAL_WEIGHTS
+#undef WEIGHT
+    std::cout << "Unknown weight `" << name << "' in " << path << std::endl;
+    return false;
+  }
+  if(!f.eof()) {
+    std::cout << "Failed to parse weights from " << path << std::endl;
+    return false;
+  }
+
+  weights = w;
+  return true;
+}
+
+bool Eval::save_weights(const std::string& path, const Weights& w) {
+  std::ofstream f(path);
+  if(!f.is_open()) {
+    return false;
+  }
+#define WEIGHT(n) f << #n << " " << w.n << "\n";
+  EVAL_WEIGHTS
+#undef WEIGHT
+  return f.good();
+}
@@ -2,6 +2,18 @@
 
 #include "tak/tak.hpp"
 #include <random>
+#include <string>
+
+// Every feature, in the order of Eval::Term. Define WEIGHT(name) to do
+// something with each field of Terms or Weights, expand EVAL_WEIGHTS,
+// then undefine it.
+#define EVAL_WEIGHTS \
+  WEIGHT(top_flats) \
+  WEIGHT(adj_flats) \
+  WEIGHT(flats) \
+  WEIGHT(caps) \
+  WEIGHT(influence) \
+  WEIGHT(captured_penalty)
 
 struct Eval {
   using Score = int16_t;
@@ -13,105 +25,162 @@ struct Eval {
     WIN = 16384,
   };
 
+  // Whether every position scores exactly as Eval::eval scores it, so
+  // that Eval's other implementations (e.g. BatchEval) can stand in.
+  // Evaluators built on Eval that score differently set this to false.
+  static const bool EVAL_EQUIVALENT = true;
+
   static std::mt19937 generator;
   static std::uniform_int_distribution<int> distribution;
 
-  // Evaluates the strength of one player
-  template<uint8_t SIZE>
-  static Score eval_player(const Board<SIZE>& state, uint8_t player) {
+  // The features, in the order they appear in Terms and Weights
+  enum Term {
+    TOP_FLATS, ADJ_FLATS, FLATS, CAPS, INFLUENCE, CAPTURED_PENALTY, NUM_TERMS
+  };
+
+  // terms_player tells a Probe where the work for each feature starts
+  // and ends, so an instrumented build can see what each one costs (see
+  // ai/profile.hpp). This one does nothing and compiles away.
+  struct NoProbe {
+    static inline void begin(Term) {}
+    static inline void end(Term) {}
+  };
+
+  // The raw features the score of one player is built from
+  struct Terms {
     int top_flats = 0;
     int adj_flats = 0;
     int flats = 0;
     int caps = 0;
     int influence = 0;
-    int captured = 0;
     int captured_penalty = 0;
+  };
+
+  // How much each feature is worth. Adjacent flats are counted from
+  // both ends of each pair. These are the hand picked defaults, tuned
+  // values can be loaded over them (see ai/tune.cpp)
+  struct Weights {
+    int top_flats = 400;
+    int adj_flats = 200;
+    int flats = 100;
+    int caps = 50;
+    int influence = 25;
+    int captured_penalty = -100;
+  };
+
+  static Weights weights;
+
+  // Read weights from a file of `name value' lines. Features that
+  // aren't mentioned keep their current weight.
+  static bool load_weights(const std::string& path);
+  static bool save_weights(const std::string& path, const Weights& w);
+
+  // Weigh up the features of one player
+  static Score combine(const Terms& t) {
+    const Weights& w = weights;
+    int s = t.influence*w.influence + t.top_flats*w.top_flats + t.adj_flats*w.adj_flats +
+            t.flats*w.flats + t.caps*w.caps + t.captured_penalty*w.captured_penalty;
+    if(s >= WIN) s = WIN-1;
+    if(s <= LOSS) s = LOSS+1;
+    return s;
+  }
+
+  // Features of both players
+  template<uint8_t SIZE>
+  static void terms(const Board<SIZE>& state, Terms t[2]) {
+    t[WHITE] = terms_player(state, WHITE);
+    t[BLACK] = terms_player(state, BLACK);
+  }
+
+  // Evaluates the strength of one player
+  template<uint8_t SIZE>
+  static Score eval_player(const Board<SIZE>& state, uint8_t player) {
+    return combine(terms_player(state, player));
+  }
+
+  template<uint8_t SIZE, typename Probe = NoProbe>
+  static Terms terms_player(const Board<SIZE>& state, uint8_t player) {
+    using G = Geometry<SIZE>;
+    Terms t;
     for(int i = 0; i < SIZE*SIZE; i++) {
       Stack s = state.board[i];
       int cap_this_stack = 0;
       if(s.height && s.top == Piece::FLAT && s.owner() == player) {
-        top_flats++;
-        uint8_t o = i+Move<SIZE>::Dir::NORTH;
-        if(o < SIZE*SIZE && state.board[o].height && state.board[o].owner() == player && state.board[o].top == Piece::FLAT) {
-          adj_flats++;
-        }
-        o = i+Move<SIZE>::Dir::SOUTH;
-        if(o < SIZE*SIZE && state.board[o].height && state.board[o].owner() == player && state.board[o].top == Piece::FLAT) {
-          adj_flats++;
-        }
-        o = i+Move<SIZE>::Dir::EAST;
-        if(o/SIZE == i/SIZE && state.board[o].height && state.board[o].owner() == player && state.board[o].top == Piece::FLAT) {
-          adj_flats++;
-        }
-        o = i+Move<SIZE>::Dir::WEST;
-        if(o/SIZE == i/SIZE && state.board[o].height && state.board[o].owner() == player && state.board[o].top == Piece::FLAT) {
-          adj_flats++;
+        Probe::begin(TOP_FLATS);
+        t.top_flats++;
+        Probe::end(TOP_FLATS);
+        Probe::begin(ADJ_FLATS);
+        for(uint64_t n = G::neighbours(i); n; n &= n-1) {
+          const Stack& o = state.board[__builtin_ctzll(n)];
+          if(o.height && o.owner() == player && o.top == Piece::FLAT) {
+            t.adj_flats++;
+          }
         }
+        Probe::end(ADJ_FLATS);
         //influence += (0x7F&map.left[i]) + (0x7F&map.right[i]) + (0x7F&map.up[i]) + (0x7F&map.down[i]);
-        uint64_t owners = state.board[i].owners;
-        for(int i = 1; i < state.board[i].height; i++) {
+        // Counting the captives is charged to flats, the penalty only
+        // for squaring them
+        Probe::begin(FLATS);
+        uint64_t owners = s.owners;
+        for(int j = 1; j < s.height; j++) {
           owners >>= 1;
           if((owners&1) == player) {
-            flats += 1;
+            t.flats += 1;
           } else {
-            captured += 1;
             cap_this_stack += 1;
           }
         }
+        Probe::end(FLATS);
+        Probe::begin(CAPTURED_PENALTY);
         if(cap_this_stack >= 3) {
-          captured_penalty += cap_this_stack*cap_this_stack;
+          t.captured_penalty += cap_this_stack*cap_this_stack;
         }
+        Probe::end(CAPTURED_PENALTY);
       } else if(s.height && s.top == Piece::CAP && s.owner() == player) {
-        caps++;
+        Probe::begin(CAPS);
+        t.caps++;
+        Probe::end(CAPS);
       }
 
+      Probe::begin(INFLUENCE);
       int adj_ally = 0;
       int adj_enemy = 0;
-      uint8_t o = i+Move<SIZE>::Dir::NORTH;
-      if(o < SIZE*SIZE && state.board[o].height) {
-        if(state.board[o].owner() == player) {
-          adj_ally++;
-        } else {
-          adj_enemy++;
-        }
-      }
-      o = i+Move<SIZE>::Dir::SOUTH;
-      if(o < SIZE*SIZE && state.board[o].height) {
-        if(state.board[o].owner() == player) {
-          adj_ally++;
-        } else {
-          adj_enemy++;
-        }
-      }
-      o = i+Move<SIZE>::Dir::EAST;
-      if(o/SIZE == i/SIZE && state.board[o].height) {
-        if(state.board[o].owner() == player) {
-          adj_ally++;
-        } else {
-          adj_enemy++;
-        }
-      }
-      o = i+Move<SIZE>::Dir::WEST;
-      if(o/SIZE == i/SIZE && state.board[o].height) {
-        if(state.board[o].owner() == player) {
-          adj_ally++;
-        } else {
-          adj_enemy++;
+      for(uint64_t n = G::neighbours(i); n; n &= n-1) {
+        const Stack& o = state.board[__builtin_ctzll(n)];
+        if(o.height) {
+          if(o.owner() == player) {
+            adj_ally++;
+          } else {
+            adj_enemy++;
+          }
         }
       }
 
-      influence += adj_ally-adj_enemy;
+      t.influence += adj_ally-adj_enemy;
+      Probe::end(INFLUENCE);
     }
 
-    Score s = influence*25 + (top_flats+adj_flats/2)*400 + flats*100 + caps*50 - captured_penalty*100;
-    if(s >= WIN) s = WIN-1;
-    if(s <= LOSS) s = LOSS+1;
-    return s;
+    return t;
   }
 
   template<uint8_t SIZE>
   static Score eval(const Board<SIZE>& state, uint8_t player) {
     return eval_player(state, player) - eval_player(state, !player);// + distribution(generator);
   }
+
+  // Evaluators that keep incremental state are told which squares each
+  // move changes through their Accumulator. This one recomputes
+  // everything at the leaves, so there's nothing to keep track of.
+  template<uint8_t SIZE>
+  struct Accumulator {
+    explicit Accumulator(const Board<SIZE>&) {}
+    inline void before(const Board<SIZE>&, uint64_t) {}
+    inline void after(const Board<SIZE>&, uint64_t) {}
+  };
+
+  template<uint8_t SIZE>
+  static Score eval(const Board<SIZE>& state, const Accumulator<SIZE>&, uint8_t player) {
+    return eval(state, player);
+  }
 };
 
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+// Direct mapped cache of leaf evaluations, keyed by position hash.
+//
+// Each slot is a single 64 bit word holding the upper half of the
+// hash next to the score, so a reader on another thread either sees
+// a whole entry or a key mismatch, never half of one.
+template<typename Score, size_t NUM_ENTRIES>
+class EvalCache {
+private:
+  static_assert(std::is_integral<Score>::value && sizeof(Score) <= 4,
+                "EvalCache packs scores into 32 bits");
+  static_assert((NUM_ENTRIES & (NUM_ENTRIES-1)) == 0,
+                "EvalCache size must be a power of two");
+
+  std::array<std::atomic<uint64_t>, NUM_ENTRIES> table;
+
+  // The low bits of the hash pick the slot, the high bits verify it
+  static inline uint64_t check(uint64_t hash) { return hash & 0xFFFFFFFF00000000; }
+public:
+  EvalCache() {
+    for(auto& e : table) e.store(0, std::memory_order_relaxed);
+  }
+
+  inline bool get(uint64_t hash, Score& score) const {
+    uint64_t e = table[hash & (NUM_ENTRIES-1)].load(std::memory_order_relaxed);
+    // An all zero word is an empty slot, not a score of 0 for hash 0
+    if(e == 0 || (e & 0xFFFFFFFF00000000) != check(hash)) return false;
+    score = (Score)(int32_t)(uint32_t)e;
+    return true;
+  }
+
+  inline void put(uint64_t hash, Score score) {
+    uint64_t e = check(hash) | (uint32_t)(int32_t)score;
+    table[hash & (NUM_ENTRIES-1)].store(e, std::memory_order_relaxed);
+  }
+};
@@ -0,0 +1,85 @@
+// Checks the evaluators that compute Eval's scores another way against
+// Eval itself, over every position of some random games: IncrementalEval
+// with its accumulator carried along the game (forwards, then undoing
+// the moves back to the start), and BitEval. Both players' scores have
+// to match exactly.
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include "tak/tak.hpp"
+#include "tak/tps.hpp"
+#include "incremental.hpp"
+#include "biteval.hpp"
+
+template<uint8_t SIZE>
+static int check(int games) {
+  using Acc = IncrementalEval::Accumulator<SIZE>;
+  std::mt19937 rng(1);
+  long checked = 0, wrong = 0;
+
+  auto compare = [&](const Board<SIZE>& b, const Acc& acc) {
+    for(uint8_t p : { WHITE, BLACK }) {
+      Eval::Score full = Eval::eval(b, p);
+      Eval::Score inc = IncrementalEval::eval(b, acc, p);
+      Eval::Score bit = BitEval::eval(b, p);
+      checked++;
+      if(inc != full || bit != full) {
+        if(wrong++ < 10) {
+          std::cout << tps::to_str(b) << " for " << (p == WHITE ? "white" : "black") << ": eval " << full
+                    << ", incremental " << inc << ", bitboard " << bit << std::endl;
+        }
+      }
+    }
+  };
+
+  for(int g = 0; g < games; g++) {
+    Board<SIZE> b;
+    Acc acc(b);
+    std::vector<Move<SIZE>> played;
+    while(true) {
+      compare(b, acc);
+      if(b.status().over) break;
+      std::vector<Move<SIZE>> legal;
+      typename Board<SIZE>::Map map(b);
+      b.forEachMove(map, [&legal](Move<SIZE> m) {
+        legal.push_back(m);
+        return CONTINUE;
+      });
+      if(legal.empty()) break;
+      played.push_back(legal[rng() % legal.size()]);
+      b.execute(played.back(), acc);
+    }
+    while(played.size()) {
+      b.undo(played.back(), acc);
+      played.pop_back();
+      compare(b, acc);
+    }
+  }
+
+  std::cout << checked << " evaluations, " << wrong << " wrong" << std::endl;
+  return wrong ? -1 : 0;
+}
+
+int main(int argc, char** argv) {
+  if(argc < 2) {
+    std::cout << "usage: evalcheck <size> [games]" << std::endl;
+    return -1;
+  }
+  int size = std::atoi(argv[1]);
+  int games = argc > 2 ? std::atoi(argv[2]) : 50;
+
+  Eval::load_weights("weights.txt");
+
+  switch(size) {
+  case 3: return check<3>(games);
+  case 4: return check<4>(games);
+  case 5: return check<5>(games);
+  case 6: return check<6>(games);
+  case 7: return check<7>(games);
+  case 8: return check<8>(games);
+  default:
+    std::cout << "Boards of size < 3 or > 8 not supported!" << std::endl;
+    return -1;
+  }
+}
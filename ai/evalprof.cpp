@@ -0,0 +1,60 @@
+// Shows what goes into Eval's score for a position (read as TPS on
+// stdin), and optionally profiles the evaluation over a search from it.
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include "tak/tak.hpp"
+#include "tak/ptn.hpp"
+#include "tak/tps.hpp"
+#include "alphabeta.hpp"
+#include "profile.hpp"
+
+template<uint8_t SIZE>
+static int profile(const std::string& tps_str, int depth) {
+  Board<SIZE> board;
+  if(!tps::from_str(tps_str, board)) {
+    std::cout << "Failed to parse tps" << std::endl;
+    return -1;
+  }
+  std::cout << tps::to_str(board) << std::endl << std::endl;
+  ProfiledEval::breakdown(board, board.curPlayer);
+
+  if(depth > 0) {
+    std::cout << std::endl;
+    alphabeta<SIZE, ProfiledEval> ab;
+    Move<SIZE> move;
+    EvalProfile::get().reset();
+    ab.search(board, move, depth);
+    std::cout << std::endl;
+    EvalProfile::get().print();
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if(argc < 2) {
+    std::cout << "usage: evalprof <size> [search depth] < position.tps" << std::endl;
+    return -1;
+  }
+  int size = std::atoi(argv[1]);
+  int depth = argc > 2 ? std::atoi(argv[2]) : 0;
+
+  if(Eval::load_weights("weights.txt")) {
+    std::cout << "Loaded evaluation weights from weights.txt" << std::endl;
+  }
+
+  std::string tps_str;
+  std::getline(std::cin, tps_str);
+
+  switch(size) {
+  case 3: return profile<3>(tps_str, depth);
+  case 4: return profile<4>(tps_str, depth);
+  case 5: return profile<5>(tps_str, depth);
+  case 6: return profile<6>(tps_str, depth);
+  case 7: return profile<7>(tps_str, depth);
+  case 8: return profile<8>(tps_str, depth);
+  default:
+    std::cout << "Boards of size < 3 or > 8 not supported!" << std::endl;
+    return -1;
+  }
+}
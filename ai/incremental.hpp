@@ -0,0 +1,107 @@
+#pragma once
+
+#include "eval.hpp"
+#include <iostream>
+
+// Same evaluation as Eval, but the features are kept up to date as moves
+// are made instead of being recomputed from the whole board at each leaf.
+//
+// Every feature is split into parts that only depend on a single square
+// (or a square and its neighbours, for adjacent flats), so a move only
+// has to take out and put back the parts of the squares it touches.
+//
+// Build with EVAL_DEBUG to check every evaluation against Eval.
+struct IncrementalEval : Eval {
+  template<uint8_t SIZE>
+  struct Accumulator {
+    Terms terms[2];
+
+    explicit Accumulator(const Board<SIZE>& state) {
+      update(state, G::all(), G::all(), 1);
+    }
+
+    inline void before(const Board<SIZE>& state, uint64_t changed) {
+      update(state, changed, neighbourhood(changed), -1);
+    }
+
+    inline void after(const Board<SIZE>& state, uint64_t changed) {
+      update(state, changed, neighbourhood(changed), 1);
+    }
+
+  private:
+    using G = Geometry<SIZE>;
+
+    static inline bool top_flat(const Board<SIZE>& state, int i, uint8_t player) {
+      const Stack& s = state.board[i];
+      return s.height && s.top == Piece::FLAT && s.owner() == player;
+    }
+
+    // The changed squares plus everything next to them
+    static inline uint64_t neighbourhood(uint64_t m) {
+      return m | G::spread(m);
+    }
+
+    // Add (sign = 1) or take out (sign = -1) the parts of the features
+    // belonging to the squares in `squares', and the adjacent flats
+    // counted from the squares in `adjacent'
+    void update(const Board<SIZE>& state, uint64_t squares, uint64_t adjacent, int sign) {
+      for(uint64_t m = squares; m; m &= m-1) {
+        int i = __builtin_ctzll(m);
+        const Stack& s = state.board[i];
+        if(!s.height) continue;
+        uint8_t owner = s.owner();
+        Terms& t = terms[owner];
+        if(s.top == Piece::FLAT) {
+          t.top_flats += sign;
+          int captives = 0;
+          int own = 0;
+          uint64_t owners = s.owners;
+          for(int j = 1; j < s.height; j++) {
+            owners >>= 1;
+            if((owners&1) == owner) own++;
+            else captives++;
+          }
+          t.flats += sign*own;
+          if(captives >= 3) {
+            t.captured_penalty += sign*captives*captives;
+          }
+        } else if(s.top == Piece::CAP) {
+          t.caps += sign;
+        }
+
+        // Each piece counts once towards influence for every square next to it
+        int degree = G::degree(i);
+        terms[owner].influence += sign*degree;
+        terms[!owner].influence -= sign*degree;
+      }
+
+      for(uint64_t m = adjacent; m; m &= m-1) {
+        int i = __builtin_ctzll(m);
+        const Stack& s = state.board[i];
+        if(!s.height || s.top != Piece::FLAT) continue;
+        uint8_t owner = s.owner();
+        int adj = 0;
+        for(uint64_t n = G::neighbours(i); n; n &= n-1) {
+          if(top_flat(state, __builtin_ctzll(n), owner)) adj++;
+        }
+        terms[owner].adj_flats += sign*adj;
+      }
+    }
+  };
+
+  template<uint8_t SIZE>
+  static Score eval(const Board<SIZE>& state, const Accumulator<SIZE>& acc, uint8_t player) {
+    Score s = combine(acc.terms[player]) - combine(acc.terms[!player]);
+#ifdef EVAL_DEBUG
+    Score full = Eval::eval(state, player);
+    if(s != full) {
+      std::cout << "Error: incremental eval " << s << " != full eval " << full << std::endl;
+    }
+#else
+    (void)state;
+#endif
+    return s;
+  }
+
+  using Eval::eval;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPED_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// A read only file for the tables the bot looks things up in (solved
+// positions, opening books), memory mapped where that's possible and
+// read into memory where it isn't.
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile() { close(); }
+
+  bool open(const std::string& path) {
+    close();
+#ifdef MAPPED_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if(p != MAP_FAILED) {
+        mapped = p;
+        length = st.st_size;
+      }
+    }
+    ::close(fd);
+    if(!mapped) return false;
+    bytes = (const char*)mapped;
+#else
+    std::ifstream in(path, std::ios::binary);
+    if(!in.is_open()) return false;
+    buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    length = buffer.size();
+    bytes = buffer.data();
+#endif
+    return true;
+  }
+
+  void close() {
+#ifdef MAPPED_MMAP
+    if(mapped) munmap(mapped, length);
+    mapped = nullptr;
+#else
+    buffer.clear();
+#endif
+    bytes = nullptr;
+    length = 0;
+  }
+
+  const char* data() const { return bytes; }
+  size_t size() const { return length; }
+
+private:
+  const char* bytes = nullptr;
+  size_t length = 0;
+#ifdef MAPPED_MMAP
+  void* mapped = nullptr;
+#else
+  std::vector<char> buffer;
+#endif
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include "tak/tak.hpp"
+#include "tak/ptn.hpp"
+#include "tak/tps.hpp"
+
+// Helpers shared by the tools that time engines and play them against
+// each other
+namespace match {
+
+// Seconds from start until now
+inline double since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+// The Elo difference a score of p (0 < p < 1) implies
+inline double elo(double p) {
+  return -400*std::log10(1/p-1);
+}
+
+// Play one game from board, asking whichever engine is to move for its
+// think(board), and return the result for white. An engine that returns
+// an illegal move loses, and a game still going after MAX_PLIES is a draw.
+static const int MAX_PLIES = 300;
+
+template<uint8_t SIZE, typename White, typename Black>
+double play(Board<SIZE> board, White& white, Black& black) {
+  for(int ply = 0; ply < MAX_PLIES; ply++) {
+    GameStatus status = board.status();
+    if(status.over) {
+      return status.winner == WHITE ? 1 : status.winner == BLACK ? 0 : 0.5;
+    }
+    Move<SIZE> m = board.curPlayer == WHITE ? white.think(board) : black.think(board);
+    if(!board.valid(m)) {
+      std::cerr << "Illegal move " << ptn::to_str(m) << " in " << tps::to_str(board) << std::endl;
+      return board.curPlayer == WHITE ? 0 : 1;
+    }
+    board.execute(m);
+  }
+  return 0.5;
+}
+
+}
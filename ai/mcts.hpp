@@ -0,0 +1,430 @@
+#pragma once
+
+#include "tak/tak.hpp"
+#include "tak/ptn.hpp"
+#include "playout.hpp"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Monte Carlo tree search, as an alternative to alphabeta for the big
+// boards where alphabeta can't see far.
+//
+// Leaves are scored with the evaluator (as a win probability, through a
+// logistic curve) instead of random playouts. Children are picked by UCT
+// or by PUCT, with priors from a softmax over the evaluations of the
+// children.
+//
+// The tree lives in a fixed size arena, with each node's children
+// allocated together, so a node only needs the index of its first child
+// and a count. Several threads grow the tree at once without locks:
+// visits are counted on the way down, which makes a path being explored
+// look like a loss (a virtual loss) to the other threads until its value
+// is added on the way back up, and only the thread that claims a leaf
+// expands it.
+//
+// The subtree for the position reached after the last search is kept
+// for the next one, as much of it as fits in half the arena.
+template<uint8_t SIZE, typename Evaluator>
+class mcts {
+public:
+  using Score = typename Evaluator::Score;
+
+  enum class Policy { UCT, PUCT };
+
+  struct Options {
+    Policy policy = Policy::PUCT;
+    // The exploration constant, c in UCT and c_puct in PUCT
+    float exploration = 1.5f;
+    // Evaluator units per unit of logit when turning scores into win
+    // probabilities
+    float scale = 400;
+    // Temperature of the softmax for PUCT's priors, in evaluator units
+    float prior_temperature = 200;
+    // Random games to play out from each new leaf to score it, or 0 to
+    // score leaves with the evaluator
+    int rollouts = 0;
+    int threads = 1;
+    size_t max_nodes = 1<<21;
+    // Stop after this many playouts even if there's time left, or 0 to
+    // only go by time
+    long max_playouts = 0;
+  };
+
+private:
+  enum State : uint8_t {
+    LEAF, EXPANDING, EXPANDED,
+    // Game over, from the point of view of the player who moved here
+    WIN, LOSS, DRAW,
+  };
+
+  // Values are summed in fixed point so they can be added atomically
+  static constexpr double VALUE_ONE = 1<<16;
+
+  struct Node {
+    Move<SIZE> move;
+    float prior;
+    std::atomic<uint8_t> state;
+    std::atomic<uint32_t> first_child;
+    std::atomic<uint32_t> num_children;
+    std::atomic<int32_t> visits;
+    // Sum of the values of the visits, for the player who moved here
+    std::atomic<int64_t> value;
+
+    void init(const Move<SIZE>& m, float p) {
+      move = m;
+      prior = p;
+      state.store(LEAF, std::memory_order_relaxed);
+      first_child.store(0, std::memory_order_relaxed);
+      num_children.store(0, std::memory_order_relaxed);
+      visits.store(0, std::memory_order_relaxed);
+      value.store(0, std::memory_order_relaxed);
+    }
+
+    double q() const {
+      int n = visits.load(std::memory_order_relaxed);
+      return n ? value.load(std::memory_order_relaxed)/VALUE_ONE/n : 0.5;
+    }
+  };
+
+  struct Arena {
+    std::unique_ptr<Node[]> nodes;
+    size_t capacity;
+    std::atomic<size_t> used;
+
+    explicit Arena(size_t capacity) : nodes(new Node[capacity]), capacity(capacity), used(0) {}
+
+    // Reserve n nodes in a row, returning the first, or 0 if full (0 is
+    // always the root, so it's never anyone's child)
+    inline uint32_t alloc(size_t n) {
+      if(used.load(std::memory_order_relaxed) + n > capacity) return 0;
+      size_t first = used.fetch_add(n, std::memory_order_relaxed);
+      return first + n <= capacity ? first : 0;
+    }
+
+    void reset() {
+      used.store(1, std::memory_order_relaxed);
+      nodes[0].init(Move<SIZE>(), 1);
+    }
+
+    Node& operator[](uint32_t i) { return nodes[i]; }
+  };
+
+  Options options;
+  std::unique_ptr<Arena> tree, spare;
+  Board<SIZE> root_board;
+  bool have_tree = false;
+
+  std::atomic<bool> stop;
+  std::atomic<long> playouts;
+
+  // Where searches say how they went, if anywhere
+  std::ostream* log = &std::cout;
+
+  static inline double sigmoid(double x) {
+    return 1/(1+std::exp(-x));
+  }
+
+  // Probability that the player who just moved wins, by the evaluator
+  // or random playouts
+  double evaluate(const Board<SIZE>& b) const {
+    if(options.rollouts > 0) {
+      static thread_local Playout<SIZE> playout(std::hash<std::thread::id>()(std::this_thread::get_id()));
+      return playout.estimate(b, !b.curPlayer, options.rollouts);
+    }
+    return 1-sigmoid(Evaluator::eval(b, b.curPlayer)/options.scale);
+  }
+
+  // Add children to a leaf this thread has claimed. Returns false if
+  // the arena is full.
+  bool expand(Node& n, const Board<SIZE>& b) {
+    if(tree->used.load(std::memory_order_relaxed) >= tree->capacity) return false;
+    std::vector<Move<SIZE>> moves;
+    typename Board<SIZE>::Map map(b);
+    b.forEachMove(map, [&moves](Move<SIZE> m) {
+      moves.push_back(m);
+      return CONTINUE;
+    });
+    if(moves.empty()) return false;
+
+    uint32_t first = tree->alloc(moves.size());
+    if(!first) return false;
+
+    // Priors: a softmax over the children's evaluations for PUCT,
+    // uniform for UCT
+    std::vector<float> priors(moves.size(), 1.0f/moves.size());
+    if(options.policy == Policy::PUCT) {
+      std::vector<float> s(moves.size());
+      float best = -1e30f;
+      for(size_t i = 0; i < moves.size(); i++) {
+        Board<SIZE> child = b;
+        child.execute(moves[i]);
+        s[i] = -Evaluator::eval(child, child.curPlayer)/options.prior_temperature;
+        best = std::max(best, s[i]);
+      }
+      float sum = 0;
+      for(size_t i = 0; i < moves.size(); i++) sum += priors[i] = std::exp(s[i]-best);
+      for(auto& p : priors) p /= sum;
+    }
+
+    for(size_t i = 0; i < moves.size(); i++) {
+      (*tree)[first+i].init(moves[i], priors[i]);
+    }
+    n.first_child.store(first, std::memory_order_relaxed);
+    n.num_children.store(moves.size(), std::memory_order_relaxed);
+    n.state.store(EXPANDED, std::memory_order_release);
+    return true;
+  }
+
+  uint32_t select(Node& n) {
+    uint32_t first = n.first_child.load(std::memory_order_relaxed);
+    uint32_t count = n.num_children.load(std::memory_order_relaxed);
+    int parent_visits = std::max(1, n.visits.load(std::memory_order_relaxed));
+    // Unvisited children are assumed as good as their parent is for the
+    // player to move there
+    double fpu = 1-n.q();
+    double log_n = std::log((double)parent_visits);
+    double sqrt_n = std::sqrt((double)parent_visits);
+
+    uint32_t best = first;
+    double best_score = -1e30;
+    for(uint32_t i = first; i < first+count; i++) {
+      Node& c = (*tree)[i];
+      int visits = c.visits.load(std::memory_order_relaxed);
+      double score;
+      if(options.policy == Policy::UCT) {
+        score = visits ? c.q() + options.exploration*std::sqrt(log_n/visits) : 1e9 - i;
+      } else {
+        score = (visits ? c.q() : fpu) + options.exploration*c.prior*sqrt_n/(1+visits);
+      }
+      if(score > best_score) {
+        best_score = score;
+        best = i;
+      }
+    }
+    return best;
+  }
+
+  // One descent from the root, adding a node if it reaches a leaf
+  void playout() {
+    Board<SIZE> b = root_board;
+    uint32_t path[256];
+    int depth = 0;
+    uint32_t idx = 0;
+    (*tree)[0].visits.fetch_add(1, std::memory_order_relaxed);
+    path[depth++] = 0;
+
+    double v;
+    while(true) {
+      Node& n = (*tree)[idx];
+      uint8_t state = n.state.load(std::memory_order_acquire);
+      if(state == EXPANDED && depth < 256) {
+        idx = select(n);
+        Node& c = (*tree)[idx];
+        // Counting the visit now is the virtual loss
+        c.visits.fetch_add(1, std::memory_order_relaxed);
+        // execute keeps undo information in the move, so don't share it
+        Move<SIZE> m = c.move;
+        b.execute(m);
+        path[depth++] = idx;
+        continue;
+      }
+
+      if(state == WIN || state == LOSS || state == DRAW) {
+        v = state == WIN ? 1 : state == LOSS ? 0 : 0.5;
+      } else if(state == LEAF) {
+        GameStatus status = b.status();
+        if(status.over) {
+          uint8_t result = status.winner == TIE ? DRAW : status.winner == !b.curPlayer ? WIN : LOSS;
+          n.state.store(result, std::memory_order_release);
+          v = result == WIN ? 1 : result == LOSS ? 0 : 0.5;
+        } else {
+          uint8_t expected = LEAF;
+          if(n.state.compare_exchange_strong(expected, EXPANDING, std::memory_order_acquire)) {
+            if(!expand(n, b)) {
+              n.state.store(LEAF, std::memory_order_release);
+            }
+          }
+          v = evaluate(b);
+        }
+      } else {
+        // Someone else is expanding this node
+        v = evaluate(b);
+      }
+      break;
+    }
+
+    // Values alternate between the players on the way back up
+    for(int i = depth-1; i >= 0; i--) {
+      (*tree)[path[i]].value.fetch_add((int64_t)(v*VALUE_ONE), std::memory_order_relaxed);
+      v = 1-v;
+    }
+    playouts.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  static bool same(Board<SIZE> a, Board<SIZE> b) {
+    return a.curPlayer == b.curPlayer && a.hash() == b.hash() && a == b;
+  }
+
+  // Find the node for state within two moves of the last root, or 0
+  uint32_t find(const Board<SIZE>& state) {
+    if(same(root_board, state)) return 0;
+    Node& root = (*tree)[0];
+    if(root.state.load() != EXPANDED) return 0;
+    uint32_t first = root.first_child.load(), count = root.num_children.load();
+    for(uint32_t i = first; i < first+count; i++) {
+      Node& c = (*tree)[i];
+      Board<SIZE> b = root_board;
+      Move<SIZE> m = c.move;
+      b.execute(m);
+      if(same(b, state)) return i;
+      if(c.state.load() != EXPANDED) continue;
+      uint32_t gfirst = c.first_child.load(), gcount = c.num_children.load();
+      for(uint32_t j = gfirst; j < gfirst+gcount; j++) {
+        Board<SIZE> g = b;
+        Move<SIZE> gm = (*tree)[j].move;
+        g.execute(gm);
+        if(same(g, state)) return j;
+      }
+    }
+    return 0;
+  }
+
+  // Copy the subtree under node `from' into the spare arena as its
+  // root, as far as the budget goes, and swap the arenas
+  void reuse(uint32_t from, size_t budget) {
+    Arena& src = *tree;
+    Arena& dst = *spare;
+    dst.reset();
+    auto copy_stats = [](Node& to, Node& n) {
+      to.visits.store(n.visits.load());
+      to.value.store(n.value.load());
+      uint8_t s = n.state.load();
+      to.state.store(s == EXPANDED || s == EXPANDING ? (uint8_t)LEAF : s);
+    };
+    copy_stats(dst[0], src[from]);
+
+    std::vector<std::pair<uint32_t, uint32_t>> queue;
+    queue.push_back(std::make_pair(from, 0));
+    for(size_t q = 0; q < queue.size(); q++) {
+      Node& n = src[queue[q].first];
+      Node& to = dst[queue[q].second];
+      if(n.state.load() != EXPANDED) continue;
+      uint32_t count = n.num_children.load();
+      if(dst.used.load() + count > budget) continue;
+      uint32_t first = dst.alloc(count);
+      if(!first) continue;
+      uint32_t src_first = n.first_child.load();
+      for(uint32_t i = 0; i < count; i++) {
+        Node& c = src[src_first+i];
+        dst[first+i].init(c.move, c.prior);
+        copy_stats(dst[first+i], c);
+        queue.push_back(std::make_pair(src_first+i, first+i));
+      }
+      to.first_child.store(first);
+      to.num_children.store(count);
+      to.state.store(EXPANDED);
+    }
+    std::swap(tree, spare);
+  }
+
+public:
+  explicit mcts(Options o = Options()) : options(o), stop(false), playouts(0) {}
+
+  // Write how searches went, and the line they expect, to out (std::cout
+  // unless told otherwise), or nowhere if it's null
+  void set_log(std::ostream* out) {
+    log = out;
+  }
+
+  // Playouts made by the last search
+  long num_playouts() const { return playouts.load(); }
+
+  void set_options(const Options& o) {
+    if(o.max_nodes != options.max_nodes) {
+      tree.reset();
+      spare.reset();
+      have_tree = false;
+    }
+    options = o;
+  }
+
+  // Search for `seconds', returning the best move's score (in evaluator
+  // units, for the player to move). Setting *cancel from another thread
+  // ends the search early.
+  Score search(Board<SIZE>& state, Move<SIZE>& bestMove, double seconds, const std::atomic<bool>* cancel = nullptr) {
+    auto start = std::chrono::steady_clock::now();
+    if(!tree) {
+      tree = std::unique_ptr<Arena>(new Arena(options.max_nodes));
+      spare = std::unique_ptr<Arena>(new Arena(options.max_nodes));
+    }
+
+    uint32_t reused = have_tree ? find(state) : 0;
+    if(have_tree && (reused || same(root_board, state))) {
+      reuse(reused, options.max_nodes/2);
+      if(log) {
+        *log << "Reusing " << tree->used.load() << " nodes with "
+             << (*tree)[0].visits.load() << " visits" << std::endl;
+      }
+    } else {
+      tree->reset();
+    }
+    root_board = state;
+    have_tree = true;
+
+    stop = false;
+    playouts = 0;
+    auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                              std::chrono::duration<double>(seconds));
+    std::vector<std::thread> workers;
+    for(int t = 0; t < options.threads; t++) {
+      workers.emplace_back([this, deadline, cancel]() {
+        int n = 0;
+        while(!stop.load(std::memory_order_relaxed)) {
+          playout();
+          // Checking the clock costs more than a playout on small boards
+          if(++n % 64 == 0 && std::chrono::steady_clock::now() >= deadline) stop = true;
+          if(cancel && cancel->load(std::memory_order_relaxed)) stop = true;
+          if(options.max_playouts && playouts.load(std::memory_order_relaxed) >= options.max_playouts) stop = true;
+        }
+      });
+    }
+    for(auto& w : workers) w.join();
+
+    std::chrono::duration<double> time_span = std::chrono::steady_clock::now()-start;
+    if(log) {
+      *log << playouts << " playouts in " << time_span.count() << "s" << std::endl;
+      *log << playouts/time_span.count() << " playouts/s" << std::endl;
+      *log << tree->used.load() << "/" << tree->capacity << " nodes used" << std::endl;
+    }
+
+    // Play the most visited move, and show the line it expects
+    Node* n = &(*tree)[0];
+    Score score = 0;
+    bool first = true;
+    while(n->state.load() == EXPANDED) {
+      uint32_t c = n->first_child.load(), count = n->num_children.load();
+      Node* best = nullptr;
+      for(uint32_t i = c; i < c+count; i++) {
+        Node& child = (*tree)[i];
+        if(!best || child.visits.load() > best->visits.load()) best = &child;
+      }
+      if(!best || !best->visits.load()) break;
+      if(first) {
+        bestMove = best->move;
+        double q = std::min(std::max(best->q(), 1e-6), 1-1e-6);
+        double s = options.scale*std::log(q/(1-q));
+        score = (Score)std::min(std::max(s, (double)Evaluator::LOSS+1), (double)Evaluator::WIN-1);
+        first = false;
+      }
+      if(log) *log << ptn::to_str(best->move) << " ";
+      n = best;
+    }
+    if(log) *log << std::endl;
+    return score;
+  }
+};
@@ -0,0 +1,156 @@
+// Plays MCTS against alphabeta with the same time per move.
+//
+// For each position in a file (tps per line, optionally followed by a
+// result as in corpus.hpp) it plays a game with each engine on each side
+// and reports MCTS's score and the Elo difference it implies. MCTS
+// scores leaves with the evaluator, or with random playouts if given a
+// number of rollouts per leaf.
+//
+// alphabeta has no clock of its own, so it deepens one ply at a time
+// until the next ply would likely run over the budget, guessing from how
+// long the last one took. The time each engine actually used is reported
+// alongside the result.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
+#include "tak/tak.hpp"
+#include "tak/tps.hpp"
+#include "alphabeta.hpp"
+#include "mcts.hpp"
+#include "incremental.hpp"
+#include "biteval.hpp"
+#include "corpus.hpp"
+#include "match.hpp"
+
+template<uint8_t SIZE>
+struct AlphaBetaEngine {
+  alphabeta<SIZE, IncrementalEval> ab;
+  double budget;
+  double seconds = 0;
+  long moves = 0, depths = 0;
+
+  explicit AlphaBetaEngine(double budget) : budget(budget) {
+    ab.set_log(nullptr);
+  }
+
+  Move<SIZE> think(Board<SIZE> board) {
+    Move<SIZE> move;
+    auto start = std::chrono::steady_clock::now();
+    int d = 1;
+    double prev = 0;
+    for(;; d++) {
+      auto iteration = std::chrono::steady_clock::now();
+      ab.search(board, move, d);
+      double last = match::since(iteration);
+      // Guess the next ply grows by as much as this one did
+      double growth = prev > 0 ? std::max(4.0, last/prev) : 4.0;
+      if(match::since(start) + growth*last > budget || d >= 64) break;
+      prev = last;
+    }
+    seconds += match::since(start);
+    depths += d;
+    moves++;
+    return move;
+  }
+};
+
+template<uint8_t SIZE>
+struct MCTSEngine {
+  mcts<SIZE, BitEval> tree;
+  double budget;
+  double seconds = 0;
+  long moves = 0;
+
+  MCTSEngine(double budget, int threads, int rollouts) : budget(budget) {
+    typename mcts<SIZE, BitEval>::Options options;
+    options.threads = threads;
+    options.rollouts = rollouts;
+    tree.set_options(options);
+    tree.set_log(nullptr);
+  }
+
+  Move<SIZE> think(Board<SIZE> board) {
+    Move<SIZE> move;
+    auto start = std::chrono::steady_clock::now();
+    tree.search(board, move, budget);
+    seconds += match::since(start);
+    moves++;
+    return move;
+  }
+};
+
+template<uint8_t SIZE>
+static int bench(const std::vector<std::string>& lines, double budget, int threads, int rollouts) {
+  std::vector<Board<SIZE>> positions;
+  for(const std::string& line : lines) {
+    Board<SIZE> board;
+    std::string tps_str;
+    float result;
+    if(!corpus::parse_line(line, tps_str, result)) tps_str = line;
+    if(tps::from_str(tps_str, board)) {
+      positions.push_back(board);
+    }
+  }
+  if(positions.empty()) {
+    std::cout << "No positions" << std::endl;
+    return -1;
+  }
+
+  AlphaBetaEngine<SIZE> ab(budget);
+  MCTSEngine<SIZE> mc(budget, threads, rollouts);
+
+  double score = 0;
+  int games = 0;
+  for(const Board<SIZE>& b : positions) {
+    score += match::play(b, mc, ab);
+    score += 1-match::play(b, ab, mc);
+    games += 2;
+    std::cout << "MCTS scored " << score << "/" << games << "\r" << std::flush;
+  }
+  double p = score/games;
+  std::cout << "MCTS scored " << score << "/" << games << " (" << 100*p << "%)";
+  if(p > 0 && p < 1) {
+    std::cout << ", " << match::elo(p) << " Elo";
+  }
+  std::cout << std::endl;
+  std::cout << "alphabeta: " << ab.seconds/ab.moves << "s/move, depth "
+            << (double)ab.depths/ab.moves << " on average" << std::endl;
+  std::cout << "MCTS: " << mc.seconds/mc.moves << "s/move with " << threads << " threads" << std::endl;
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if(argc < 3) {
+    std::cout << "usage: mctsbench <size> <positions> [seconds per move] [mcts threads] [rollouts per leaf]" << std::endl;
+    return -1;
+  }
+
+  int size = std::atoi(argv[1]);
+  double budget = argc > 3 ? std::atof(argv[3]) : 1;
+  int threads = argc > 4 ? std::atoi(argv[4]) : std::thread::hardware_concurrency();
+  int rollouts = argc > 5 ? std::atoi(argv[5]) : 0;
+  if(threads < 1) threads = 1;
+
+  std::vector<std::string> lines;
+  if(!corpus::read_lines(argv[2], lines)) {
+    std::cout << "Failed to open " << argv[2] << std::endl;
+    return -1;
+  }
+  Eval::load_weights("weights.txt");
+
+  switch(size) {
+  case 3: return bench<3>(lines, budget, threads, rollouts);
+  case 4: return bench<4>(lines, budget, threads, rollouts);
+  case 5: return bench<5>(lines, budget, threads, rollouts);
+  case 6: return bench<6>(lines, budget, threads, rollouts);
+  case 7: return bench<7>(lines, budget, threads, rollouts);
+  case 8: return bench<8>(lines, budget, threads, rollouts);
+  default:
+    std::cout << "Boards of size < 3 or > 8 not supported!" << std::endl;
+    return -1;
+  }
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <string>
+#include <sstream>
+#include <ostream>
+#include <fstream>
+#include <chrono>
+
+// Where the time went on one of the bot's moves, from reading the
+// opponent's move (or the start of the game) to our reply being sent.
+// Durations are in seconds.
+struct MoveMetrics {
+  using Time = std::chrono::steady_clock::time_point;
+
+  int game = 0;
+  // What picked the move: table, book, mcts or alphabeta
+  const char* source = "";
+  // Wall clock time the server's message arrived, in seconds since the epoch
+  double received_at = 0;
+  Time received;
+  // Reading the message, up to queueing the search
+  double parse = 0;
+  // Waiting for a core
+  double queued = 0;
+  double search = 0;
+  // How long each depth of an alphabeta search took
+  std::vector<double> iterations;
+  // Nodes searched (playouts for MCTS), and of those how many were cut
+  // off by the ttable
+  long nodes = 0;
+  long ttable_hits = 0;
+  // From the move being found to it being written to the socket
+  Time found;
+  double send = 0;
+  double total = 0;
+
+  static double since(Time t) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-t).count();
+  }
+};
+
+// Counts of values in buckets with exponentially growing upper bounds,
+// Prometheus style
+class Histogram {
+public:
+  Histogram(double first, double factor, int count) : counts(count+1, 0), sum(0), total(0) {
+    double b = first;
+    for(int i = 0; i < count; i++, b *= factor) bounds.push_back(b);
+  }
+
+  void add(double v) {
+    size_t i = 0;
+    while(i < bounds.size() && v > bounds[i]) i++;
+    counts[i]++;
+    sum += v;
+    total++;
+  }
+
+  // In the text exposition format, with labels (without braces) on
+  // every line if there are any
+  void write(std::ostream& out, const std::string& name, const std::string& labels = "") const {
+    std::string sep = labels.empty() ? "" : ",";
+    long cumulative = 0;
+    for(size_t i = 0; i < bounds.size(); i++) {
+      cumulative += counts[i];
+      out << name << "_bucket{" << labels << sep << "le=\"" << bounds[i] << "\"} " << cumulative << "\n";
+    }
+    out << name << "_bucket{" << labels << sep << "le=\"+Inf\"} " << total << "\n";
+    std::string braces = labels.empty() ? "" : "{" + labels + "}";
+    out << name << "_sum" << braces << " " << sum << "\n";
+    out << name << "_count" << braces << " " << total << "\n";
+  }
+
+private:
+  std::vector<double> bounds;
+  std::vector<long> counts;
+  double sum;
+  long total;
+};
+
+// Everything the bot has measured about its moves. Only ever touched
+// from the io thread: the searches fill in a MoveMetrics of their own
+// and it's added here once the move has been sent, so nothing a search
+// does waits on this.
+class Metrics {
+public:
+  Metrics() :
+    total(0.001, 2, 20), parse(0.00001, 4, 10), queued(0.001, 2, 20),
+    search(0.001, 2, 20), send(0.00001, 4, 10), nodes(1000, 4, 12),
+    node_count(0), hit_count(0) {}
+
+  // Also write each move as a line of JSON to path
+  bool open_log(const std::string& path) {
+    log.open(path, std::ios::app);
+    return log.is_open();
+  }
+
+  void add(const MoveMetrics& m) {
+    total.add(m.total);
+    parse.add(m.parse);
+    queued.add(m.queued);
+    search.add(m.search);
+    send.add(m.send);
+    nodes.add(m.nodes);
+    for(size_t d = 0; d < m.iterations.size(); d++) {
+      auto it = iterations.find(d+1);
+      if(it == iterations.end()) it = iterations.insert(std::make_pair(d+1, Histogram(0.0001, 2, 24))).first;
+      it->second.add(m.iterations[d]);
+    }
+    sources[m.source]++;
+    node_count += m.nodes;
+    hit_count += m.ttable_hits;
+    if(log.is_open()) {
+      write_json(log, m);
+      log << std::endl;
+    }
+  }
+
+  static void write_json(std::ostream& out, const MoveMetrics& m) {
+    out << "{\"received\":" << std::fixed << m.received_at << std::defaultfloat
+        << ",\"game\":" << m.game << ",\"source\":\"" << m.source << "\""
+        << ",\"parse\":" << m.parse << ",\"queued\":" << m.queued
+        << ",\"search\":" << m.search << ",\"iterations\":[";
+    for(size_t d = 0; d < m.iterations.size(); d++) {
+      out << (d ? "," : "") << m.iterations[d];
+    }
+    out << "],\"nodes\":" << m.nodes << ",\"ttable_hits\":" << m.ttable_hits
+        << ",\"ttable_hit_rate\":" << (m.nodes ? (double)m.ttable_hits/m.nodes : 0)
+        << ",\"send\":" << m.send << ",\"total\":" << m.total << "}";
+  }
+
+  // All of it in the Prometheus text exposition format
+  std::string prometheus() const {
+    std::ostringstream out;
+    out << "# TYPE cutak_move_seconds histogram\n";
+    total.write(out, "cutak_move_seconds");
+    out << "# TYPE cutak_parse_seconds histogram\n";
+    parse.write(out, "cutak_parse_seconds");
+    out << "# TYPE cutak_queue_seconds histogram\n";
+    queued.write(out, "cutak_queue_seconds");
+    out << "# TYPE cutak_search_seconds histogram\n";
+    search.write(out, "cutak_search_seconds");
+    out << "# TYPE cutak_send_seconds histogram\n";
+    send.write(out, "cutak_send_seconds");
+    out << "# TYPE cutak_iteration_seconds histogram\n";
+    for(auto& i : iterations) {
+      i.second.write(out, "cutak_iteration_seconds", "depth=\"" + std::to_string(i.first) + "\"");
+    }
+    out << "# TYPE cutak_search_nodes histogram\n";
+    nodes.write(out, "cutak_search_nodes");
+    out << "# TYPE cutak_nodes_total counter\n";
+    out << "cutak_nodes_total " << node_count << "\n";
+    out << "# TYPE cutak_ttable_hits_total counter\n";
+    out << "cutak_ttable_hits_total " << hit_count << "\n";
+    out << "# TYPE cutak_moves_total counter\n";
+    for(auto& s : sources) {
+      out << "cutak_moves_total{source=\"" << s.first << "\"} " << s.second << "\n";
+    }
+    return out.str();
+  }
+
+private:
+  Histogram total, parse, queued, search, send, nodes;
+  // By depth
+  std::map<int, Histogram> iterations;
+  std::map<std::string, long> sources;
+  long node_count, hit_count;
+  std::ofstream log;
+};
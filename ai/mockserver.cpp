@@ -0,0 +1,394 @@
+// A stand-in for the Playtak server, to test the bot end to end without
+// the real one. It listens on localhost for one client and speaks the
+// part of the protocol ServerMsg and ClientMsg know about.
+//
+// Once the client logs in it posts seeks for made up opponents, each of
+// them shouting for the bot to play, and starts a game for every seek
+// the client accepts, keeping a number of games going at once. The
+// opponents play random legal moves after a set delay. Games end as
+// usual, or as draws after a number of plies. Every move the bot makes
+// is checked, and the time between sending it the opponent's move (or
+// the start of the game, as white) and getting its reply is recorded.
+//
+// When all the games are done the latencies are reported, and it exits
+// with an error if the bot made an illegal move or took too long.
+// mocktest.sh runs the bot against it, as a test.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <map>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#define ASIO_STANDALONE
+#include "asio.hpp"
+#include "tak/tak.hpp"
+#include "tak/net/message.hpp"
+#include "tak/ptn.hpp"
+
+using asio::ip::tcp;
+using err_t = std::error_code;
+using namespace tak::net;
+
+struct Options {
+  // Games to play in all, and how many at once
+  int games = 8;
+  int concurrency = 4;
+  // Games still going after this many plies are drawn
+  int plies = 30;
+  // Seconds on each clock
+  int time = 600;
+  // Depth the opponents ask the bot to search to, 0 to leave it be
+  int depth = 0;
+  // Seconds the opponents take over each move
+  double delay = 0;
+  // Seconds to wait for one of the bot's moves before giving up on it
+  double timeout = 120;
+  unsigned seed = 1;
+};
+
+template<uint8_t SIZE>
+class Server : public ServerMsg::Visitor {
+public:
+  Server(asio::io_service& io, int port, Options options) :
+    io(io), acceptor(io, tcp::endpoint(asio::ip::address_v4::loopback(), port)), sock(io),
+    options(options), rng(options.seed), next_seek(1), next_game(1), started(0), finished(0),
+    errors(0), wins(0), losses(0), draws(0)
+  {
+    std::cout << "Listening on localhost:" << port << std::endl;
+    acceptor.async_accept(sock, [this](err_t err) {
+      if(!err) {
+        std::cout << "Client connected" << std::endl;
+        // Don't hold back the opponent's move until the time before it's acked
+        sock.set_option(tcp::no_delay(true));
+        send("Login or Register");
+        readline();
+      } else {
+        std::cout << "Error accepting client: " << err.message() << std::endl;
+        this->io.stop();
+      }
+    });
+  }
+
+  // Prints what happened, true if the bot did everything right
+  bool report() {
+    std::cout << std::endl;
+    std::cout << finished << "/" << options.games << " games played, the bot won "
+              << wins << ", lost " << losses << " and drew " << draws << std::endl;
+    if(latencies.size()) {
+      std::sort(latencies.begin(), latencies.end());
+      double total = 0;
+      for(double l : latencies) total += l;
+      auto at = [this](double p) { return latencies[(size_t)(p*(latencies.size()-1))]*1000; };
+      std::cout << latencies.size() << " moves, latency in ms: mean " << total/latencies.size()*1000
+                << ", p50 " << at(0.5) << ", p90 " << at(0.9) << ", p99 " << at(0.99)
+                << ", max " << at(1) << std::endl;
+    }
+    std::cout << errors << " errors" << std::endl;
+    return !errors && finished == options.games;
+  }
+
+private:
+  using Time = std::chrono::steady_clock::time_point;
+
+  struct Game {
+    int id;
+    Board<SIZE> board;
+    Player bot;
+    std::string opponent;
+    int plies = 0;
+    // Seconds left on the bot's clock
+    double clock;
+    // When the bot was last given the move
+    Time sent;
+    // Either the opponent thinking or the bot's time running out
+    std::unique_ptr<asio::steady_timer> timer;
+  };
+
+  struct OpenSeek {
+    int id;
+    std::string opponent;
+  };
+
+  asio::io_service& io;
+  tcp::acceptor acceptor;
+  tcp::socket sock;
+  asio::streambuf buf;
+  std::queue<std::string> msg_queue;
+
+  Options options;
+  std::mt19937 rng;
+  std::map<int, OpenSeek> seeks;
+  std::map<int, std::unique_ptr<Game>> games;
+  int next_seek, next_game;
+  int started, finished;
+
+  // Seconds from giving the bot the move to its reply
+  std::vector<double> latencies;
+  int errors;
+  int wins, losses, draws;
+
+  void send(const std::string& msg) {
+    bool send_in_progress = msg_queue.size() > 0;
+    msg_queue.push(msg + "\n");
+    if(!send_in_progress) {
+      do_send();
+    }
+  }
+
+  void do_send() {
+    asio::async_write(sock, asio::buffer(msg_queue.front()), [this](err_t err, std::size_t) {
+      if(!err) {
+        msg_queue.pop();
+        if(msg_queue.size()) {
+          do_send();
+        }
+      } else {
+        std::cout << "Error sending msg: " << err.message() << std::endl;
+        io.stop();
+      }
+    });
+  }
+
+  void readline() {
+    asio::async_read_until(sock, buf, '\n', [this](err_t err, std::size_t n) {
+      if(!err) {
+        const char* line = asio::buffer_cast<const char*>(buf.data());
+        size_t length = n-1;
+        if(length && line[length-1] == '\r') length--;
+        handle(util::string_view(line, length));
+        buf.consume(n);
+        readline();
+      } else {
+        std::cout << "Client disconnected: " << err.message() << std::endl;
+        io.stop();
+      }
+    });
+  }
+
+  void handle(util::string_view msg) {
+    if(msg.starts_with("Login ")) {
+      util::string_view rest = msg.substr(6);
+      std::string name = rest.substr(0, rest.find(' ')).str();
+      send("Welcome " + name + "!");
+      for(int i = 0; i < options.concurrency && started + (int)seeks.size() < options.games; i++) {
+        post_seek();
+      }
+    } else if(msg == "PING") {
+      send("OK");
+    } else if(msg.starts_with("Accept ")) {
+      accept(std::atoi(msg.substr(7).str().c_str()));
+    } else if(msg.starts_with("Game#")) {
+      // Moves look the same both ways
+      ServerMsg(msg).handle(*this);
+    } else if(!msg.starts_with("Client ") && !msg.starts_with("Shout ") && !msg.starts_with("Seek ")) {
+      std::cout << "Ignoring `" << msg << "'" << std::endl;
+    }
+  }
+
+  // A made up opponent seeks a game and asks the bot to join it
+  void post_seek() {
+    int id = next_seek++;
+    OpenSeek seek = { id, "opponent" + std::to_string(id) };
+    seeks[seek.id] = seek;
+    send("Seek new " + std::to_string(seek.id) + " " + seek.opponent + " " + std::to_string(SIZE) + " " + std::to_string(options.time));
+    send("Shout <" + seek.opponent + "> cutak_bot: play" + (options.depth ? " " + std::to_string(options.depth) : ""));
+  }
+
+  void accept(int seek_id) {
+    auto it = seeks.find(seek_id);
+    if(it == seeks.end()) {
+      send("NOK");
+      return;
+    }
+    OpenSeek seek = it->second;
+    seeks.erase(it);
+    send("Seek remove " + std::to_string(seek.id) + " " + seek.opponent + " " + std::to_string(SIZE) + " " + std::to_string(options.time));
+
+    std::unique_ptr<Game> game(new Game());
+    game->id = next_game++;
+    game->opponent = seek.opponent;
+    game->bot = started++ % 2 == 0 ? WHITE : BLACK;
+    game->clock = options.time;
+    game->timer = std::unique_ptr<asio::steady_timer>(new asio::steady_timer(io));
+    Game& g = *game;
+    games[g.id] = std::move(game);
+
+    std::string white = g.bot == WHITE ? "cutak_bot" : g.opponent;
+    std::string black = g.bot == WHITE ? g.opponent : "cutak_bot";
+    send("Game Start " + std::to_string(g.id) + " " + std::to_string(SIZE) + " " + white + " vs " + black +
+         (g.bot == WHITE ? " white" : " black"));
+    if(g.bot == WHITE) {
+      wait_for_bot(g);
+    } else {
+      opponent_move(g);
+    }
+  }
+
+  void wait_for_bot(Game& g) {
+    g.sent = std::chrono::steady_clock::now();
+    int id = g.id;
+    g.timer->expires_from_now(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                std::chrono::duration<double>(options.timeout)));
+    g.timer->async_wait([this, id](err_t err) {
+      auto it = games.find(id);
+      if(err || it == games.end()) return;
+      std::cout << "Game " << id << ": no move from the bot in " << options.timeout << "s" << std::endl;
+      errors++;
+      abandon(*it->second);
+    });
+  }
+
+  // Reply with a random move once the opponent's done "thinking"
+  void opponent_move(Game& g) {
+    int id = g.id;
+    g.timer->expires_from_now(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                std::chrono::duration<double>(options.delay)));
+    g.timer->async_wait([this, id](err_t err) {
+      auto it = games.find(id);
+      if(err || it == games.end()) return;
+      Game& g = *it->second;
+      std::vector<Move<SIZE>> moves;
+      typename Board<SIZE>::Map map(g.board);
+      g.board.forEachMove(map, [&moves](Move<SIZE> m) {
+        moves.push_back(m);
+        return CONTINUE;
+      });
+      Move<SIZE> m = moves[std::uniform_int_distribution<size_t>(0, moves.size()-1)(rng)];
+      g.board.execute(m);
+      g.plies++;
+      DynamicMove move = m;
+      int bot_time = (int)g.clock, opponent_time = options.time;
+      send("Game#" + std::to_string(id) + " Time " + std::to_string(g.bot == WHITE ? bot_time : opponent_time) +
+           " " + std::to_string(g.bot == WHITE ? opponent_time : bot_time));
+      std::string text = ClientMsg::move(id, move).text();
+      text.pop_back();
+      send(text);
+      if(!over(g)) wait_for_bot(g);
+    });
+  }
+
+  virtual void move_msg(int id, DynamicMove move) {
+    auto it = games.find(id);
+    if(it == games.end()) {
+      std::cout << "Move for unknown game " << id << std::endl;
+      errors++;
+      return;
+    }
+    Game& g = *it->second;
+    std::chrono::duration<double> latency = std::chrono::steady_clock::now()-g.sent;
+    Move<SIZE> m = move;
+    if(g.board.curPlayer != g.bot || !g.board.valid(m)) {
+      std::cout << "Game " << id << ": illegal move " << ptn::to_str(m) << " from the bot" << std::endl;
+      errors++;
+      abandon(g);
+      return;
+    }
+    g.timer->cancel();
+    latencies.push_back(latency.count());
+    g.clock -= latency.count();
+    g.board.execute(m);
+    g.plies++;
+    if(!over(g)) opponent_move(g);
+  }
+
+  // End g if it's over, true if it was
+  bool over(Game& g) {
+    GameStatus status = g.board.status();
+    if(status.over) {
+      const char* result;
+      if(status.winner == WHITE) result = status.condition == ROAD_VICTORY ? "R-0" : "F-0";
+      else if(status.winner == BLACK) result = status.condition == ROAD_VICTORY ? "0-R" : "0-F";
+      else result = "1/2-1/2";
+      if(status.winner == g.bot) wins++;
+      else if(status.winner == NEITHER) draws++;
+      else losses++;
+      done(g, std::string("Over ") + result);
+      return true;
+    }
+    if(g.plies >= options.plies) {
+      draws++;
+      done(g, "Over 1/2-1/2");
+      return true;
+    }
+    return false;
+  }
+
+  void abandon(Game& g) {
+    done(g, "Abandoned");
+  }
+
+  void done(Game& g, const std::string& how) {
+    int id = g.id;
+    send("Game#" + std::to_string(id) + " " + how);
+    g.timer->cancel();
+    games.erase(id);
+    finished++;
+    if(started + (int)seeks.size() < options.games) {
+      post_seek();
+    }
+    if(finished == options.games) {
+      io.stop();
+    }
+  }
+};
+
+template<uint8_t SIZE>
+static int serve(int port, Options options) {
+  asio::io_service io;
+  Server<SIZE> server(io, port, options);
+  io.run();
+  return server.report() ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  if(argc < 3) {
+    std::cout << "usage: mockserver <size> <port> [--games n] [--concurrency n] [--plies n] [--time s] [--depth n] [--delay s] [--timeout s] [--seed n]" << std::endl;
+    return -1;
+  }
+  int size = std::atoi(argv[1]);
+  int port = std::atoi(argv[2]);
+  Options options;
+  for(int i = 3; i+1 < argc; i++) {
+    std::string arg = argv[i];
+    if(arg == "--games") {
+      options.games = std::atoi(argv[++i]);
+    } else if(arg == "--concurrency") {
+      options.concurrency = std::atoi(argv[++i]);
+    } else if(arg == "--plies") {
+      options.plies = std::atoi(argv[++i]);
+    } else if(arg == "--time") {
+      options.time = std::atoi(argv[++i]);
+    } else if(arg == "--depth") {
+      options.depth = std::atoi(argv[++i]);
+    } else if(arg == "--delay") {
+      options.delay = std::atof(argv[++i]);
+    } else if(arg == "--timeout") {
+      options.timeout = std::atof(argv[++i]);
+    } else if(arg == "--seed") {
+      options.seed = std::atoi(argv[++i]);
+    } else {
+      std::cout << "Unknown option " << arg << std::endl;
+      return -1;
+    }
+  }
+  if(options.games < 1 || options.concurrency < 1) {
+    std::cout << "Need at least one game" << std::endl;
+    return -1;
+  }
+
+  switch(size) {
+  case 3: return serve<3>(port, options);
+  case 4: return serve<4>(port, options);
+  case 5: return serve<5>(port, options);
+  case 6: return serve<6>(port, options);
+  case 7: return serve<7>(port, options);
+  case 8: return serve<8>(port, options);
+  default:
+    std::cout << "Boards of size < 3 or > 8 not supported!" << std::endl;
+    return -1;
+  }
+}
@@ -0,0 +1,47 @@
+#!/bin/sh
+# Plays the bot against mockserver on localhost and fails if the server
+# finds anything wrong with how it played (see mockserver.cpp):
+#
+#   mocktest.sh <bot> <mockserver> [size] [port] [mockserver options...]
+#
+# The bot runs in a directory of its own, with a made up login and an
+# empty whitelist, and is stopped once the server is done.
+bot=$1
+server=$2
+size=${3:-5}
+port=${4:-10999}
+[ $# -gt 4 ] && shift 4 || set --
+[ $# -gt 0 ] || set -- --games 4 --concurrency 2 --plies 12 --depth 3 --timeout 60
+
+dir=$(mktemp -d) || exit 1
+trap 'kill $bot_pid $server_pid 2>/dev/null; exec 3>&-; rm -rf "$dir"' EXIT
+printf 'cutak_bot\npassword\n' > "$dir/auth.txt"
+: > "$dir/whitelist.txt"
+
+"$server" "$size" "$port" "$@" > "$dir/server.log" 2>&1 &
+server_pid=$!
+tries=0
+until grep -q "^Listening" "$dir/server.log"; do
+  tries=$((tries+1))
+  if [ $tries -gt 100 ] || ! kill -0 $server_pid 2>/dev/null; then
+    cat "$dir/server.log"
+    exit 1
+  fi
+  sleep 0.1
+done
+
+# The bot echoes what it reads from stdin, so give it a pipe that stays
+# open and quiet
+mkfifo "$dir/stdin"
+exec 3<>"$dir/stdin"
+(cd "$dir" && exec "$bot" localhost "$port" < stdin > bot.log 2>&1) &
+bot_pid=$!
+
+wait $server_pid
+status=$?
+cat "$dir/server.log"
+if [ $status -ne 0 ]; then
+  echo "mockserver exited with $status, the end of the bot's log:"
+  tail -n 20 "$dir/bot.log"
+fi
+exit $status
@@ -0,0 +1,133 @@
+// Measures how fast server messages are parsed, on recorded traffic
+// (one message per line, as the server sent them) or a built in sample
+// of a busy game list if there's none.
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include "tak/tak.hpp"
+#include "tak/net/message.hpp"
+
+using namespace tak::net;
+
+static const char* SAMPLE[] = {
+  "Welcome!",
+  "Login or Register",
+  "Welcome cutak_bot!",
+  "Online 42",
+  "Seek new 1032 alphatak_bot 5 600 W",
+  "Seek new 1033 Guest1204 6 900",
+  "Seek remove 1032 alphatak_bot 5 600 W",
+  "GameList Add Game#2217 nelhob vs TakticianBot, 5x5, 900, 10, 0 half-moves played, nelhob to move",
+  "GameList Add Game#2218 Abyss vs Guest311, 6x6, 1200, 20, 3 half-moves played, Guest311 to move",
+  "GameList Remove Game#2201 fwwwwibib vs Ally, 5x5, 600, 5, 37 half-moves played, Ally to move",
+  "Game Start 2219 5 cutak_bot vs alphatak_bot white",
+  "Game#2219 P A1",
+  "Game#2219 Time 598 600",
+  "Game#2219 P E5 C",
+  "Game#2219 P C3 W",
+  "Game#2219 M C3 C5 1 1",
+  "Game#2219 M B2 E2 2 1 1",
+  "Game#2219 Time 541 577",
+  "Game#2219 OfferDraw",
+  "Game#2219 RemoveDraw",
+  "Game#2219 RequestUndo",
+  "Game#2219 Undo",
+  "Shout <Abyss> cutak_bot: play 5",
+  "Shout <Guest311> good game everyone",
+  "Message Server will restart in 10 minutes",
+  "Game#2219 Over R-0",
+  "Game#2217 Abandoned",
+  "Observe Game#2218 6 Abyss vs Guest311, 6x6, 1200, 3 half-moves played, Guest311 to move",
+  "Error You've been logged out",
+  "OK",
+  "NOK",
+};
+
+// Counts what it's told, and touches the strings so they're not free
+struct Counter : ServerMsg::Visitor {
+  long known = 0, unknown = 0, chars = 0;
+
+  void welcome_msg() override { known++; }
+  void login_prompt_msg() override { known++; }
+  void login_success_msg(util::string_view name) override { known++; chars += name.size(); }
+  void game_add_msg(int id, util::string_view p1, util::string_view p2, int size, int time, int incr, int moves, util::string_view cur) override {
+    known++;
+    chars += p1.size() + p2.size() + cur.size() + id + size + time + incr + moves;
+  }
+  void game_remove_msg(int id) override { known++; chars += id; }
+  void game_start_msg(int, int, util::string_view p1, util::string_view p2, Player) override {
+    known++;
+    chars += p1.size() + p2.size();
+  }
+  void move_msg(int, DynamicMove move) override { known++; chars += move.x(); }
+  void time_msg(int, int white_time, int) override { known++; chars += white_time; }
+  void game_over_msg(int, GameStatus) override { known++; }
+  void draw_offer_msg(int) override { known++; }
+  void draw_cancel_msg(int) override { known++; }
+  void undo_req_msg(int) override { known++; }
+  void undo_cancel_msg(int) override { known++; }
+  void undo_msg(int) override { known++; }
+  void game_abandon_msg(int) override { known++; }
+  void seek_new_msg(Seek seek) override { known++; chars += seek.player.size(); }
+  void seek_remove_msg(Seek seek) override { known++; chars += seek.player.size(); }
+  void observe_game_msg(int, util::string_view p1, util::string_view p2, int, int, int, util::string_view) override {
+    known++;
+    chars += p1.size() + p2.size();
+  }
+  void shout_msg(util::string_view, util::string_view msg) override { known++; chars += msg.size(); }
+  void server_msg(util::string_view msg) override { known++; chars += msg.size(); }
+  void error_msg(util::string_view what) override { known++; chars += what.size(); }
+  void online_msg(int) override { known++; }
+  void nok_msg() override { known++; }
+  void ok_msg() override { known++; }
+  void unknown_msg(util::string_view) override { unknown++; }
+};
+
+int main(int argc, char** argv) {
+  double seconds = argc > 2 ? std::atof(argv[2]) : 3;
+
+  // All of the traffic in one buffer, the way the bot reads it
+  std::string traffic;
+  if(argc > 1 && std::string(argv[1]) != "-") {
+    std::ifstream f(argv[1]);
+    if(!f.is_open()) {
+      std::cout << "Failed to open " << argv[1] << std::endl;
+      return -1;
+    }
+    std::string line;
+    while(std::getline(f, line)) {
+      if(line.size() && line.back() == '\r') line.pop_back();
+      if(line.size()) traffic += line + "\n";
+    }
+  } else {
+    for(const char* line : SAMPLE) traffic += std::string(line) + "\n";
+  }
+  std::vector<util::string_view> lines;
+  for(size_t begin = 0, end; (end = traffic.find('\n', begin)) != std::string::npos; begin = end+1) {
+    lines.push_back(util::string_view(traffic.data()+begin, end-begin));
+  }
+  if(lines.empty()) {
+    std::cout << "No messages" << std::endl;
+    return -1;
+  }
+
+  Counter counter;
+  long passes = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> time_span;
+  do {
+    for(util::string_view line : lines) ServerMsg(line).handle(counter);
+    passes++;
+    time_span = std::chrono::steady_clock::now()-start;
+  } while(time_span.count() < seconds);
+
+  long messages = passes*lines.size();
+  std::cout << messages << " messages in " << time_span.count() << "s" << std::endl;
+  std::cout << messages/time_span.count() << " messages/s, "
+            << passes*traffic.size()/time_span.count()/(1<<20) << " MB/s" << std::endl;
+  std::cout << counter.unknown/passes << " of " << lines.size() << " messages not understood" << std::endl;
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include "nnue.hpp"
+#include <fstream>
+#include <cstring>
+
+// File layout: a header, then the Network fields in order, little endian
+struct Header {
+  char magic[4];
+  uint8_t size;
+  uint8_t hidden;
+  uint8_t depth;
+  uint8_t pad;
+};
+
+static const char MAGIC[4] = { 'T', 'N', 'N', '1' };
+
+template<uint8_t SIZE>
+static bool read(std::ifstream& f, NNUE::Network<SIZE>& net) {
+  f.read(reinterpret_cast<char*>(net.input), sizeof(net.input));
+  f.read(reinterpret_cast<char*>(net.bias), sizeof(net.bias));
+  f.read(reinterpret_cast<char*>(net.output), sizeof(net.output));
+  f.read(reinterpret_cast<char*>(&net.output_bias), sizeof(net.output_bias));
+  f.read(reinterpret_cast<char*>(&net.tempo), sizeof(net.tempo));
+  return f.good();
+}
+
+template<uint8_t SIZE>
+static int load_size(std::ifstream& f, const std::string& path) {
+  // Read into a copy so a truncated file doesn't leave half a network.
+  // It's static since it's too big for the stack, and C++11's new
+  // doesn't honour the Network's alignment.
+  static NNUE::Network<SIZE> net;
+  if(!read(f, net)) {
+    std::cout << "Failed to read network from " << path << std::endl;
+    return 0;
+  }
+  // Networks with larger weights than MAX_WEIGHT could overflow the
+  // accumulator on a full board
+  const int max = NNUE::Network<SIZE>::MAX_WEIGHT;
+  bool fits = true;
+  for(int f = 0; f < NNUE::Network<SIZE>::INPUTS; f++) {
+    for(int h = 0; h < NNUE::HIDDEN; h++) {
+      fits = fits && net.input[f][h] >= -max && net.input[f][h] <= max;
+    }
+  }
+  for(int h = 0; h < NNUE::HIDDEN; h++) {
+    fits = fits && net.bias[h] >= -max && net.bias[h] <= max;
+  }
+  if(!fits) {
+    std::cout << path << " has weights outside +-" << max << ", which could overflow on a "
+              << (int)SIZE << "x" << (int)SIZE << " board" << std::endl;
+    return 0;
+  }
+  net.loaded = true;
+  NNUE::network<SIZE>() = net;
+  return SIZE;
+}
+
+int NNUE::load(const std::string& path) {
+  std::ifstream f(path, std::ios::binary);
+  if(!f.is_open()) {
+    return 0;
+  }
+
+  Header h;
+  f.read(reinterpret_cast<char*>(&h), sizeof(h));
+  if(!f.good() || std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0) {
+    std::cout << path << " isn't a network file" << std::endl;
+    return 0;
+  }
+  if(h.hidden != HIDDEN || h.depth != DEPTH) {
+    std::cout << path << " has " << (int)h.hidden << " hidden units and depth " << (int)h.depth
+              << ", expected " << HIDDEN << " and " << DEPTH << std::endl;
+    return 0;
+  }
+
+  switch(h.size) {
+  case 3: return load_size<3>(f, path);
+  case 4: return load_size<4>(f, path);
+  case 5: return load_size<5>(f, path);
+  case 6: return load_size<6>(f, path);
+  case 7: return load_size<7>(f, path);
+  case 8: return load_size<8>(f, path);
+  default:
+    std::cout << path << " is for an unsupported board size " << (int)h.size << std::endl;
+    return 0;
+  }
+}
+
+template<uint8_t SIZE>
+bool NNUE::save(const std::string& path, const Network<SIZE>& net) {
+  std::ofstream f(path, std::ios::binary);
+  if(!f.is_open()) {
+    return false;
+  }
+
+  Header h;
+  std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.size = SIZE;
+  h.hidden = HIDDEN;
+  h.depth = DEPTH;
+  h.pad = 0;
+  f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  f.write(reinterpret_cast<const char*>(net.input), sizeof(net.input));
+  f.write(reinterpret_cast<const char*>(net.bias), sizeof(net.bias));
+  f.write(reinterpret_cast<const char*>(net.output), sizeof(net.output));
+  f.write(reinterpret_cast<const char*>(&net.output_bias), sizeof(net.output_bias));
+  f.write(reinterpret_cast<const char*>(&net.tempo), sizeof(net.tempo));
+  return f.good();
+}
+
+template bool NNUE::save<3>(const std::string&, const Network<3>&);
+template bool NNUE::save<4>(const std::string&, const Network<4>&);
+template bool NNUE::save<5>(const std::string&, const Network<5>&);
+template bool NNUE::save<6>(const std::string&, const Network<6>&);
+template bool NNUE::save<7>(const std::string&, const Network<7>&);
+template bool NNUE::save<8>(const std::string&, const Network<8>&);
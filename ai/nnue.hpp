@@ -0,0 +1,229 @@
+#pragma once
+
+#include "eval.hpp"
+#include <iostream>
+#include <string>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define NNUE_AVX2
+#include <immintrin.h>
+#endif
+
+// A small quantized neural network evaluator, in the style of NNUE.
+//
+// The inputs are sparse: for each square, what's on top (owner and
+// piece type) and who owns each of the DEPTH pieces under it. They feed
+// a single hidden layer whose pre-activations live in the Accumulator,
+// so a move only has to take out and put back the columns for the
+// squares it touches. The hidden layer is clipped to [0, 1] and summed
+// into the score, along with a bonus for the side to move.
+//
+// Everything after training is fixed point: the input layer and the
+// accumulator in int16 (1.0 = QA), the output layer in int8 (1.0 = QB).
+// The input weights and biases are kept within MAX_WEIGHT, so even with
+// every input set the accumulator can't overflow.
+// The network's output is a logit of white winning; SCALE converts it
+// to Eval's units.
+//
+// Networks are per board size and loaded with NNUE::load (see
+// nnuetrain.cpp for training them). Until one is loaded for a size
+// every position evaluates to 0.
+//
+// Build with EVAL_DEBUG to check the accumulator against a recomputation.
+struct NNUE : Eval {
+  static const int HIDDEN = 32;
+  static const int DEPTH = 3;
+  // 6 top pieces (2 owners x flat/wall/cap) and 2 owners for each piece under it
+  static const int KINDS = 6 + 2*DEPTH;
+  static const int QA = 127;
+  static const int QB = 64;
+  static const int SCALE = 400;
+  static const bool EVAL_EQUIVALENT = false;
+
+  template<uint8_t SIZE>
+  struct Network {
+    static const int INPUTS = SIZE*SIZE*KINDS;
+    // The most inputs a position can set: a top piece and DEPTH under it
+    // on every square
+    static const int MAX_SET = SIZE*SIZE*(1+DEPTH);
+    // The largest input weight or bias, so that a bias plus MAX_SET
+    // weights fits in int16. 2.0 on small boards, less on large ones
+    // (1.0 on 8x8).
+    static const int MAX_WEIGHT = 32767/(MAX_SET+1) < 2*QA ? 32767/(MAX_SET+1) : 2*QA;
+
+    alignas(32) int16_t input[INPUTS][HIDDEN];
+    alignas(32) int16_t bias[HIDDEN];
+    alignas(32) int8_t output[HIDDEN];
+    // In units of QA*QB
+    int32_t output_bias;
+    int32_t tempo;
+    bool loaded;
+  };
+
+  template<uint8_t SIZE>
+  static Network<SIZE>& network() {
+    static Network<SIZE> net = Network<SIZE>();
+    return net;
+  }
+
+  template<uint8_t SIZE>
+  static bool loaded() {
+    return network<SIZE>().loaded;
+  }
+
+  // Load a network written by save. Returns the board size it's for, or 0
+  static int load(const std::string& path);
+
+  template<uint8_t SIZE>
+  static bool save(const std::string& path, const Network<SIZE>& net);
+
+  // The inputs that are set for stack s on square i. Returns how many.
+  template<uint8_t SIZE>
+  static inline int features(const Stack& s, int i, int f[1+DEPTH]) {
+    if(!s.height) return 0;
+    int base = i*KINDS;
+    int n = 0;
+    f[n++] = base + s.owner()*3 + (int)s.top;
+    uint64_t owners = s.owners;
+    for(int d = 0; d < DEPTH && d+1 < s.height; d++) {
+      owners >>= 1;
+      f[n++] = base + 6 + 2*d + (owners&1);
+    }
+    return n;
+  }
+
+  template<uint8_t SIZE>
+  struct Accumulator {
+    alignas(32) int16_t v[HIDDEN];
+
+    explicit Accumulator(const Board<SIZE>& state) {
+      const Network<SIZE>& net = network<SIZE>();
+      for(int h = 0; h < HIDDEN; h++) v[h] = net.bias[h];
+      update<1>(state, Geometry<SIZE>::all());
+    }
+
+    inline void before(const Board<SIZE>& state, uint64_t changed) {
+      update<-1>(state, changed);
+    }
+
+    inline void after(const Board<SIZE>& state, uint64_t changed) {
+      update<1>(state, changed);
+    }
+
+  private:
+    template<int SIGN>
+    inline void update(const Board<SIZE>& state, uint64_t squares) {
+      const Network<SIZE>& net = network<SIZE>();
+      for(uint64_t m = squares; m; m &= m-1) {
+        int i = __builtin_ctzll(m);
+        int f[1+DEPTH];
+        int n = features<SIZE>(state.board[i], i, f);
+        for(int j = 0; j < n; j++) {
+          const int16_t* col = net.input[f[j]];
+#ifdef NNUE_AVX2
+          if(has_avx2()) {
+            add_avx2<SIGN>(v, col);
+            continue;
+          }
+#endif
+          for(int h = 0; h < HIDDEN; h++) v[h] += SIGN*col[h];
+        }
+      }
+    }
+  };
+
+  template<uint8_t SIZE>
+  static Score eval(const Board<SIZE>& state, const Accumulator<SIZE>& acc, uint8_t player) {
+    const Network<SIZE>& net = network<SIZE>();
+#ifdef EVAL_DEBUG
+    Accumulator<SIZE> full(state);
+    for(int h = 0; h < HIDDEN; h++) {
+      if(acc.v[h] != full.v[h]) {
+        std::cout << "Error: nnue accumulator " << acc.v[h] << " != full " << full.v[h] << std::endl;
+        break;
+      }
+    }
+    // The same in int32, which would differ if int16 had wrapped
+    for(int h = 0; h < HIDDEN; h++) {
+      int32_t wide = net.bias[h];
+      for(int i = 0; i < SIZE*SIZE; i++) {
+        int f[1+DEPTH];
+        int n = features<SIZE>(state.board[i], i, f);
+        for(int j = 0; j < n; j++) wide += net.input[f[j]][h];
+      }
+      if(wide != full.v[h]) {
+        std::cout << "Error: nnue accumulator overflowed, " << wide << " wrapped to " << full.v[h] << std::endl;
+        break;
+      }
+    }
+#endif
+    int32_t sum;
+#ifdef NNUE_AVX2
+    if(has_avx2()) {
+      sum = output_avx2(acc.v, net.output);
+    } else
+#endif
+    {
+      sum = 0;
+      for(int h = 0; h < HIDDEN; h++) {
+        int a = acc.v[h] < 0 ? 0 : acc.v[h] > QA ? QA : acc.v[h];
+        sum += a*net.output[h];
+      }
+    }
+    sum += net.output_bias + (state.curPlayer == WHITE ? net.tempo : -net.tempo);
+
+    int s = (int64_t)sum*SCALE/(QA*QB);
+    if(player == BLACK) s = -s;
+    if(s >= WIN) s = WIN-1;
+    if(s <= LOSS) s = LOSS+1;
+    return s;
+  }
+
+  template<uint8_t SIZE>
+  static Score eval(const Board<SIZE>& state, uint8_t player) {
+    return eval(state, Accumulator<SIZE>(state), player);
+  }
+
+#ifdef NNUE_AVX2
+  static inline bool has_avx2() {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+  }
+
+private:
+  static_assert(HIDDEN % 32 == 0, "the AVX2 kernels work on 32 hidden units at a time");
+
+  template<int SIGN>
+  __attribute__((target("avx2")))
+  static inline void add_avx2(int16_t* v, const int16_t* col) {
+    for(int h = 0; h < HIDDEN; h += 16) {
+      __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(v+h));
+      __m256i c = _mm256_load_si256(reinterpret_cast<const __m256i*>(col+h));
+      a = SIGN > 0 ? _mm256_add_epi16(a, c) : _mm256_sub_epi16(a, c);
+      _mm256_store_si256(reinterpret_cast<__m256i*>(v+h), a);
+    }
+  }
+
+  __attribute__((target("avx2")))
+  static inline int32_t output_avx2(const int16_t* v, const int8_t* w) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum = _mm256_setzero_si256();
+    for(int h = 0; h < HIDDEN; h += 32) {
+      __m256i lo = _mm256_load_si256(reinterpret_cast<const __m256i*>(v+h));
+      __m256i hi = _mm256_load_si256(reinterpret_cast<const __m256i*>(v+h+16));
+      // Clip to [0, QA] as bytes. packus interleaves the 128 bit lanes,
+      // so put them back in order to line up with the weights.
+      __m256i a = _mm256_min_epu8(_mm256_packus_epi16(lo, hi), _mm256_set1_epi8(QA));
+      a = _mm256_permute4x64_epi64(a, 0xD8);
+      __m256i b = _mm256_load_si256(reinterpret_cast<const __m256i*>(w+h));
+      // QA*|w|*2 fits in int16 since |w| <= 127
+      __m256i p = _mm256_maddubs_epi16(a, b);
+      sum = _mm256_add_epi32(sum, _mm256_madd_epi16(p, ones));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+    return _mm_cvtsi128_si32(s);
+  }
+#endif
+};
@@ -0,0 +1,121 @@
+// Compares the NNUE evaluator against the handcrafted one.
+//
+// For each position in a file (tps per line, optionally followed by a
+// result as in corpus.hpp) it searches to a fixed depth with both
+// evaluators and reports nodes per second, then plays a game from the
+// position with each evaluator on each side and reports the score and
+// the Elo difference it implies.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include "tak/tak.hpp"
+#include "tak/tps.hpp"
+#include "alphabeta.hpp"
+#include "incremental.hpp"
+#include "nnue.hpp"
+#include "corpus.hpp"
+#include "match.hpp"
+
+template<uint8_t SIZE, typename Evaluator>
+struct Engine {
+  alphabeta<SIZE, Evaluator> ab;
+  int depth;
+  long nodes = 0;
+  double seconds = 0;
+
+  explicit Engine(int depth) : depth(depth) {
+    ab.set_log(nullptr);
+  }
+
+  Move<SIZE> think(Board<SIZE> board) {
+    Move<SIZE> move;
+    auto start = std::chrono::steady_clock::now();
+    ab.search(board, move, depth);
+    seconds += match::since(start);
+    nodes += ab.nodes();
+    return move;
+  }
+};
+
+template<uint8_t SIZE>
+static int bench(const std::vector<std::string>& lines, int depth) {
+  std::vector<Board<SIZE>> positions;
+  for(const std::string& line : lines) {
+    Board<SIZE> board;
+    std::string tps_str;
+    float result;
+    if(!corpus::parse_line(line, tps_str, result)) tps_str = line;
+    if(tps::from_str(tps_str, board)) {
+      positions.push_back(board);
+    }
+  }
+  if(positions.empty()) {
+    std::cout << "No positions" << std::endl;
+    return -1;
+  }
+
+  Engine<SIZE, IncrementalEval> eval(depth);
+  Engine<SIZE, NNUE> nnue(depth);
+
+  // Speed, on the same positions at the same depth
+  for(const Board<SIZE>& b : positions) {
+    eval.think(b);
+    nnue.think(b);
+  }
+  std::cout << "Eval: " << eval.nodes << " nodes in " << eval.seconds << "s, "
+            << eval.nodes/eval.seconds << " nodes/s" << std::endl;
+  std::cout << "NNUE: " << nnue.nodes << " nodes in " << nnue.seconds << "s, "
+            << nnue.nodes/nnue.seconds << " nodes/s" << std::endl;
+
+  // Strength, playing each position from both sides
+  double score = 0;
+  int games = 0;
+  for(const Board<SIZE>& b : positions) {
+    score += match::play(b, nnue, eval);
+    score += 1-match::play(b, eval, nnue);
+    games += 2;
+    std::cout << "NNUE scored " << score << "/" << games << "\r" << std::flush;
+  }
+  double p = score/games;
+  std::cout << "NNUE scored " << score << "/" << games << " (" << 100*p << "%)";
+  if(p > 0 && p < 1) {
+    std::cout << ", " << match::elo(p) << " Elo";
+  }
+  std::cout << std::endl;
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if(argc < 4) {
+    std::cout << "usage: nnuebench <size> <positions> <network> [depth]" << std::endl;
+    return -1;
+  }
+
+  int size = std::atoi(argv[1]);
+  int depth = argc > 4 ? std::atoi(argv[4]) : 4;
+
+  std::vector<std::string> lines;
+  if(!corpus::read_lines(argv[2], lines)) {
+    std::cout << "Failed to open " << argv[2] << std::endl;
+    return -1;
+  }
+  if(NNUE::load(argv[3]) != size) {
+    std::cout << "Failed to load a " << size << "x" << size << " network from " << argv[3] << std::endl;
+    return -1;
+  }
+  Eval::load_weights("weights.txt");
+
+  switch(size) {
+  case 3: return bench<3>(lines, depth);
+  case 4: return bench<4>(lines, depth);
+  case 5: return bench<5>(lines, depth);
+  case 6: return bench<6>(lines, depth);
+  case 7: return bench<7>(lines, depth);
+  case 8: return bench<8>(lines, depth);
+  default:
+    std::cout << "Boards of size < 3 or > 8 not supported!" << std::endl;
+    return -1;
+  }
+}
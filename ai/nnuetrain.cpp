@@ -0,0 +1,302 @@
+// Trains the NNUE evaluator's network.
+//
+// Reads a corpus of positions labelled with game results (see
+// corpus.hpp), fits the network in floating point to predict the result
+// (as a logit of white winning, with cross entropy loss), then quantizes
+// it and writes it out in the format NNUE::load reads.
+//
+// Each position is shown in a random one of its eight orientations each
+// epoch, since they're all worth the same. A tenth of the positions are
+// held out to check for overfitting.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <memory>
+#include <cmath>
+#include <cstdlib>
+#include "tak/tak.hpp"
+#include "tak/tps.hpp"
+#include "nnue.hpp"
+#include "symmetry.hpp"
+#include "corpus.hpp"
+
+using corpus::parallel_for;
+
+static const int H = NNUE::HIDDEN;
+// Keep the output layer inside int8 (the input layer's limit depends on
+// the size, see NNUE::Network::MAX_WEIGHT)
+static const float MAX_OUTPUT_WEIGHT = 127.0f/NNUE::QB;
+
+template<uint8_t SIZE>
+struct Trainer {
+  static const int F = NNUE::Network<SIZE>::INPUTS;
+  // Keeps the quantized input layer and the accumulator inside int16
+  static constexpr float MAX_INPUT_WEIGHT = (float)NNUE::Network<SIZE>::MAX_WEIGHT/NNUE::QA;
+
+  struct Sample {
+    // Range of this position's inputs in `features'
+    uint32_t begin, end;
+    uint8_t player;
+    float result;
+  };
+
+  std::vector<uint16_t> features;
+  std::vector<Sample> train, test;
+
+  // The network, and Adam's moment estimates for it
+  struct Params {
+    std::vector<float> input, bias, output;
+    float output_bias, tempo;
+
+    Params() : input(F*H), bias(H), output(H), output_bias(0), tempo(0) {}
+
+    void clear() {
+      std::fill(input.begin(), input.end(), 0.0f);
+      std::fill(bias.begin(), bias.end(), 0.0f);
+      std::fill(output.begin(), output.end(), 0.0f);
+      output_bias = tempo = 0;
+    }
+  };
+  Params w, m, v;
+
+  bool load(const std::vector<std::string>& lines, int threads) {
+    std::vector<std::vector<uint16_t>> f(lines.size());
+    std::vector<Sample> s(lines.size());
+    std::vector<char> ok(lines.size());
+    parallel_for(lines.size(), threads, [&](size_t begin, size_t end, int) {
+      for(size_t i = begin; i < end; i++) {
+        std::string tps_str;
+        Board<SIZE> board;
+        if(!corpus::parse_line(lines[i], tps_str, s[i].result) ||
+           !tps::from_str(tps_str, board)) {
+          continue;
+        }
+        for(int sq = 0; sq < SIZE*SIZE; sq++) {
+          int fs[1+NNUE::DEPTH];
+          int n = NNUE::features<SIZE>(board.board[sq], sq, fs);
+          f[i].insert(f[i].end(), fs, fs+n);
+        }
+        s[i].player = board.curPlayer;
+        ok[i] = 1;
+      }
+    });
+
+    for(size_t i = 0; i < lines.size(); i++) {
+      if(!ok[i]) {
+        std::cout << "Skipping unparseable line " << i+1 << ": " << lines[i] << std::endl;
+        continue;
+      }
+      s[i].begin = features.size();
+      features.insert(features.end(), f[i].begin(), f[i].end());
+      s[i].end = features.size();
+      (i % 10 == 9 ? test : train).push_back(s[i]);
+    }
+    return train.size() && test.size();
+  }
+
+  void init() {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> in(-0.1f, 0.1f), out(-0.5f, 0.5f);
+    for(auto& x : w.input) x = in(rng);
+    for(auto& x : w.bias) x = 0.5f;
+    for(auto& x : w.output) x = out(rng);
+    w.output_bias = w.tempo = 0;
+  }
+
+  static inline int orient(int f, int s) {
+    return Symmetry<SIZE>::square(s, f/NNUE::KINDS)*NNUE::KINDS + f%NNUE::KINDS;
+  }
+
+  // Forward pass: the output logit, and the hidden layer before clipping
+  float forward(const Sample& s, int orientation, float z[H]) const {
+    for(int h = 0; h < H; h++) z[h] = w.bias[h];
+    for(uint32_t j = s.begin; j < s.end; j++) {
+      const float* col = &w.input[orient(features[j], orientation)*H];
+      for(int h = 0; h < H; h++) z[h] += col[h];
+    }
+    float o = w.output_bias + (s.player == WHITE ? w.tempo : -w.tempo);
+    for(int h = 0; h < H; h++) {
+      o += w.output[h]*std::min(std::max(z[h], 0.0f), 1.0f);
+    }
+    return o;
+  }
+
+  static inline float sigmoid(float o) {
+    return 1.0f/(1.0f+std::exp(-o));
+  }
+
+  // Mean squared error of the predicted result, comparable to tune's
+  double error(const std::vector<Sample>& samples, int threads) const {
+    std::vector<double> partial(threads);
+    parallel_for(samples.size(), threads, [&](size_t begin, size_t end, int t) {
+      float z[H];
+      for(size_t i = begin; i < end; i++) {
+        double d = samples[i].result - sigmoid(forward(samples[i], 0, z));
+        partial[t] += d*d;
+      }
+    });
+    double e = 0;
+    for(double p : partial) e += p;
+    return e/samples.size();
+  }
+
+  void step(Params& g, int it, float rate) {
+    const float beta1 = 0.9f, beta2 = 0.999f, eps = 1e-8f;
+    float c1 = 1-std::pow(beta1, it), c2 = 1-std::pow(beta2, it);
+    auto adam = [&](float& x, float gx, float& mx, float& vx, float limit) {
+      mx = beta1*mx + (1-beta1)*gx;
+      vx = beta2*vx + (1-beta2)*gx*gx;
+      x -= rate*(mx/c1)/(std::sqrt(vx/c2)+eps);
+      x = std::min(std::max(x, -limit), limit);
+    };
+    for(size_t i = 0; i < w.input.size(); i++) adam(w.input[i], g.input[i], m.input[i], v.input[i], MAX_INPUT_WEIGHT);
+    for(int h = 0; h < H; h++) {
+      adam(w.bias[h], g.bias[h], m.bias[h], v.bias[h], MAX_INPUT_WEIGHT);
+      adam(w.output[h], g.output[h], m.output[h], v.output[h], MAX_OUTPUT_WEIGHT);
+    }
+    adam(w.output_bias, g.output_bias, m.output_bias, v.output_bias, 1e6f);
+    adam(w.tempo, g.tempo, m.tempo, v.tempo, 1e6f);
+  }
+
+  void epoch(int threads, std::mt19937& rng, float rate, int& it) {
+    const size_t BATCH = 4096;
+    std::shuffle(train.begin(), train.end(), rng);
+    std::vector<int> orientation(train.size());
+    for(auto& o : orientation) o = rng() % Symmetry<SIZE>::NUM;
+
+    std::vector<Params> grads(threads);
+    for(size_t b = 0; b < train.size(); b += BATCH) {
+      size_t count = std::min(BATCH, train.size()-b);
+      parallel_for(count, threads, [&](size_t begin, size_t end, int t) {
+        Params& g = grads[t];
+        g.clear();
+        float z[H], dz[H];
+        for(size_t i = b+begin; i < b+end; i++) {
+          const Sample& s = train[i];
+          float d = (sigmoid(forward(s, orientation[i], z)) - s.result)/count;
+          g.output_bias += d;
+          g.tempo += s.player == WHITE ? d : -d;
+          for(int h = 0; h < H; h++) {
+            bool active = z[h] > 0 && z[h] < 1;
+            g.output[h] += d*std::min(std::max(z[h], 0.0f), 1.0f);
+            dz[h] = active ? d*w.output[h] : 0;
+            g.bias[h] += dz[h];
+          }
+          for(uint32_t j = s.begin; j < s.end; j++) {
+            float* col = &g.input[orient(features[j], orientation[i])*H];
+            for(int h = 0; h < H; h++) col[h] += dz[h];
+          }
+        }
+      });
+      for(int t = 1; t < threads; t++) {
+        for(size_t i = 0; i < grads[0].input.size(); i++) grads[0].input[i] += grads[t].input[i];
+        for(int h = 0; h < H; h++) {
+          grads[0].bias[h] += grads[t].bias[h];
+          grads[0].output[h] += grads[t].output[h];
+        }
+        grads[0].output_bias += grads[t].output_bias;
+        grads[0].tempo += grads[t].tempo;
+      }
+      step(grads[0], ++it, rate);
+    }
+  }
+
+  void quantize(NNUE::Network<SIZE>& net) const {
+    for(int f = 0; f < F; f++) {
+      for(int h = 0; h < H; h++) {
+        net.input[f][h] = std::lround(w.input[f*H+h]*NNUE::QA);
+      }
+    }
+    for(int h = 0; h < H; h++) {
+      net.bias[h] = std::lround(w.bias[h]*NNUE::QA);
+      net.output[h] = std::lround(w.output[h]*NNUE::QB);
+    }
+    net.output_bias = std::lround(w.output_bias*NNUE::QA*NNUE::QB);
+    net.tempo = std::lround(w.tempo*NNUE::QA*NNUE::QB);
+    net.loaded = true;
+  }
+
+  int run(const std::vector<std::string>& lines, const std::string& out, int threads, int epochs) {
+    if(!load(lines, threads)) {
+      std::cout << "Not enough positions to train on" << std::endl;
+      return -1;
+    }
+    std::cout << "Loaded " << train.size() << " training and " << test.size() << " test positions" << std::endl;
+
+    init();
+    std::mt19937 rng(2);
+    int it = 0;
+    for(int e = 1; e <= epochs; e++) {
+      // Step the rate down for the last few epochs
+      float rate = e > epochs*3/4 ? 1e-4f : 1e-3f;
+      epoch(threads, rng, rate, it);
+      std::cout << "Epoch " << e << ": train error " << error(train, threads)
+                << ", test error " << error(test, threads) << std::endl;
+    }
+
+    // Check how much quantizing costs, with the network the evaluator
+    // uses (a static, so it's aligned)
+    NNUE::Network<SIZE>& net = NNUE::network<SIZE>();
+    quantize(net);
+    double e = 0;
+    for(const Sample& s : test) {
+      Board<SIZE> board;
+      // Rebuild the accumulator straight from the features
+      NNUE::Accumulator<SIZE> acc(board);
+      for(uint32_t j = s.begin; j < s.end; j++) {
+        for(int h = 0; h < H; h++) acc.v[h] += net.input[features[j]][h];
+      }
+      board.curPlayer = s.player;
+      double d = s.result - sigmoid((float)NNUE::eval(board, acc, WHITE)/NNUE::SCALE);
+      e += d*d;
+    }
+    std::cout << "Quantized test error " << e/test.size() << std::endl;
+
+    if(!NNUE::save(out, net)) {
+      std::cout << "Failed to write " << out << std::endl;
+      return -1;
+    }
+    std::cout << "Wrote network to " << out << std::endl;
+    return 0;
+  }
+};
+
+template<uint8_t SIZE>
+static int train(const std::vector<std::string>& lines, const std::string& out, int threads, int epochs) {
+  std::unique_ptr<Trainer<SIZE>> t(new Trainer<SIZE>());
+  return t->run(lines, out, threads, epochs);
+}
+
+int main(int argc, char** argv) {
+  if(argc < 3) {
+    std::cout << "usage: nnuetrain <size> <corpus> [network out] [threads] [epochs]" << std::endl;
+    return -1;
+  }
+
+  int size = std::atoi(argv[1]);
+  std::string out = argc > 3 ? argv[3] : "nnue.bin";
+  int threads = argc > 4 ? std::atoi(argv[4]) : std::thread::hardware_concurrency();
+  int epochs = argc > 5 ? std::atoi(argv[5]) : 20;
+  if(threads < 1) threads = 1;
+
+  std::vector<std::string> lines;
+  if(!corpus::read_lines(argv[2], lines)) {
+    std::cout << "Failed to open " << argv[2] << std::endl;
+    return -1;
+  }
+
+  switch(size) {
+  case 3: return train<3>(lines, out, threads, epochs);
+  case 4: return train<4>(lines, out, threads, epochs);
+  case 5: return train<5>(lines, out, threads, epochs);
+  case 6: return train<6>(lines, out, threads, epochs);
+  case 7: return train<7>(lines, out, threads, epochs);
+  case 8: return train<8>(lines, out, threads, epochs);
+  default:
+    std::cout << "Boards of size < 3 or > 8 not supported!" << std::endl;
+    return -1;
+  }
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include "tak/tak.hpp"
+#include "biteval.hpp"
+#include <cstdint>
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(__POPCNT__)
+#define PLAYOUT_POPCNT
+#endif
+
+// Plays random games out to the end, for MCTS rollouts and for
+// estimating who's winning a position.
+//
+// Moves are sampled directly rather than by listing every move with
+// forEachMove: pick a random empty square or stack of the player's,
+// then a random piece to place there or a random one of the stack's
+// spreads from Table::moves. Every legal move can come up, though not
+// all equally often.
+//
+// The board's pieces are also kept as bit boards, updated from just the
+// squares each move touches, so checking for the end of the game is a
+// few mask operations and a road flood fill.
+template<uint8_t SIZE>
+class Playout {
+public:
+  using G = Geometry<SIZE>;
+
+  // Games longer than this are called draws
+  static const int MAX_PLIES = 16*SIZE*SIZE;
+
+  explicit Playout(uint64_t seed = 0x9E3779B97F4A7C15ull) : rng(seed ? seed : 1) {}
+
+  // Play state out randomly, returning the winner (or TIE)
+  uint8_t play(const Board<SIZE>& state) {
+#ifdef PLAYOUT_POPCNT
+    if(has_popcnt()) return play_popcnt(state);
+#endif
+    return run(state);
+  }
+
+  // Fraction of n random games from state won by player, draws counting
+  // half
+  double estimate(const Board<SIZE>& state, uint8_t player, int n) {
+    int score = 0;
+    for(int i = 0; i < n; i++) {
+      uint8_t winner = play(state);
+      score += winner == player ? 2 : winner == TIE ? 1 : 0;
+    }
+    return score/(2.0*n);
+  }
+
+  // A random legal move for the player to move, given the board's bits
+  __attribute__((always_inline))
+  inline Move<SIZE> random_move(const Board<SIZE>& state, const BitEval::Bits& b) {
+    uint64_t mine = state.curPlayer == BLACK ? b.black : b.occupied & ~b.black;
+    uint64_t empty = ~b.occupied & G::all();
+    // On the first round only flats can be placed (for the opponent)
+    uint64_t candidates = state.round == 1 ? empty : empty | mine;
+    uint64_t blockers = b.occupied & ~b.flat;
+
+    while(true) {
+      int i = nth_bit(candidates, below(__builtin_popcountll(candidates)));
+      if(empty & G::bit(i)) return place(state, i);
+
+      const Stack& s = state.board[i];
+      int carry = util::min((int)SIZE, (int)s.height);
+      // Pick evenly among all of this stack's spreads
+      Table::range moves[4] = {
+        Table::moves(carry, max_move(i, G::NORTH, s, b, blockers)),
+        Table::moves(carry, max_move(i, G::SOUTH, s, b, blockers)),
+        Table::moves(carry, max_move(i, G::EAST, s, b, blockers)),
+        Table::moves(carry, max_move(i, G::WEST, s, b, blockers)),
+      };
+      int total = moves[0].size() + moves[1].size() + moves[2].size() + moves[3].size();
+      if(total) {
+        int k = below(total);
+        int r = 0;
+        for(; k >= moves[r].size(); r++) k -= moves[r].size();
+        return Move<SIZE>(i, dir(static_cast<typename G::Ray>(r)), moves[r][k]);
+      }
+      // A stack boxed in on every side has no moves
+      candidates &= ~G::bit(i);
+    }
+  }
+
+  // Check if the game is over, and if so who won
+  __attribute__((always_inline))
+  static inline bool over(const Board<SIZE>& state, const BitEval::Bits& b, uint8_t& winner) {
+    uint64_t road = b.occupied & (b.flat | b.cap);
+    bool white_road = Board<SIZE>::hasRoad(road & ~b.black);
+    bool black_road = Board<SIZE>::hasRoad(road & b.black);
+    if(white_road || black_road) {
+      // With two roads, whoever just moved wins
+      winner = white_road && black_road ? (uint8_t)!state.curPlayer : (uint8_t)(black_road ? BLACK : WHITE);
+      return true;
+    }
+
+    if(b.occupied == G::all() ||
+       (state.white.flats == 0 && state.white.caps == 0) ||
+       (state.black.flats == 0 && state.black.caps == 0)) {
+      int w = __builtin_popcountll(b.flat & ~b.black & b.occupied);
+      int k = __builtin_popcountll(b.flat & b.black);
+      winner = w > k ? WHITE : k > w ? BLACK : TIE;
+      return true;
+    }
+    return false;
+  }
+
+  // Refresh the bits of the squares m touched, after executing it
+  __attribute__((always_inline))
+  static inline void update(const Board<SIZE>& state, BitEval::Bits& b, const Move<SIZE>& m) {
+    b.set(state.board[m.idx()], m.idx());
+    if(m.type() == Move<SIZE>::Type::MOVE) {
+      for(int n = 1; n <= m.range(); n++) {
+        uint8_t i = m.idx()+n*m.dir();
+        b.set(state.board[i], i);
+      }
+    }
+  }
+
+private:
+  uint64_t rng;
+
+  __attribute__((always_inline))
+  inline uint8_t run(Board<SIZE> state) {
+    BitEval::Bits b = BitEval::bits(state);
+    for(int ply = 0; ply < MAX_PLIES; ply++) {
+      uint8_t winner;
+      if(over(state, b, winner)) return winner;
+      Move<SIZE> m = random_move(state, b);
+      state.executeUnhashed(m);
+      update(state, b, m);
+    }
+    return TIE;
+  }
+
+#ifdef PLAYOUT_POPCNT
+  // The same, with everything inlined into it using the popcnt
+  // instruction instead of libgcc's bit counting
+  __attribute__((target("popcnt")))
+  uint8_t play_popcnt(const Board<SIZE>& state) {
+    return run(state);
+  }
+
+  static inline bool has_popcnt() {
+    static const bool popcnt = __builtin_cpu_supports("popcnt");
+    return popcnt;
+  }
+#endif
+
+  // xorshift64*
+  inline uint64_t next() {
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return rng * 0x2545F4914F6CDD1Dull;
+  }
+
+  // A random number in [0, n)
+  inline int below(int n) {
+    return static_cast<int>(((next() >> 32) * static_cast<uint64_t>(n)) >> 32);
+  }
+
+  __attribute__((always_inline))
+  static inline int nth_bit(uint64_t m, int n) {
+    for(; n > 0; n--) m &= m-1;
+    return __builtin_ctzll(m);
+  }
+
+  static inline typename Move<SIZE>::Dir dir(typename G::Ray r) {
+    switch(r) {
+    case G::NORTH: return Move<SIZE>::Dir::NORTH;
+    case G::SOUTH: return Move<SIZE>::Dir::SOUTH;
+    case G::EAST: return Move<SIZE>::Dir::EAST;
+    default: return Move<SIZE>::Dir::WEST;
+    }
+  }
+
+  __attribute__((always_inline))
+  inline Move<SIZE> place(const Board<SIZE>& state, int i) {
+    if(state.round == 1) return Move<SIZE>(i, Piece::FLAT);
+    int flats = state.curPlayer == WHITE ? state.white.flats : state.black.flats;
+    int caps = state.curPlayer == WHITE ? state.white.caps : state.black.caps;
+    // Flats and walls share a reserve, so they come and go together
+    int kinds = (flats > 0)*2 + (caps > 0);
+    int k = below(kinds);
+    if(flats == 0 || k == 2) return Move<SIZE>(i, Piece::CAP);
+    return Move<SIZE>(i, k ? Piece::WALL : Piece::FLAT);
+  }
+
+  // How far a stack on i can spread in direction r, in the form Map
+  // gives it to Table::moves: the number of open squares before a wall,
+  // cap or the edge (at most the stack's height), with the top bit set
+  // if a cap could go on to flatten a wall
+  __attribute__((always_inline))
+  static inline int max_move(int i, typename G::Ray r, const Stack& s, const BitEval::Bits& b, uint64_t blockers) {
+    uint64_t ray = G::ray(i, r);
+    uint64_t blocked = ray & blockers;
+    int open;
+    uint64_t nearest;
+    if(r == G::NORTH || r == G::EAST) {
+      // Squares further along the ray have higher bits
+      nearest = blocked & -blocked;
+      open = __builtin_popcountll(ray & (nearest-1));
+    } else {
+      nearest = blocked ? G::bit(63-__builtin_clzll(blocked)) : 0;
+      open = __builtin_popcountll(blocked ? ray & ~((nearest<<1)-1) : ray);
+    }
+    bool flatten = s.top == Piece::CAP && (nearest & ~b.cap);
+    return (flatten << 7) | util::min((int)s.height, open);
+  }
+};
@@ -0,0 +1,73 @@
+// Measures random playout speed, and what the playouts make of a
+// position (read as TPS on stdin, or the empty board if there's none).
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include "tak/tak.hpp"
+#include "tak/tps.hpp"
+#include "playout.hpp"
+
+template<uint8_t SIZE>
+static int bench(const std::string& tps_str, double seconds, int threads) {
+  Board<SIZE> board;
+  if(tps_str.size() && !tps::from_str(tps_str, board)) {
+    std::cout << "Failed to parse tps" << std::endl;
+    return -1;
+  }
+  std::cout << tps::to_str(board) << std::endl;
+
+  std::vector<long> results(3*threads);
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+  for(int t = 0; t < threads; t++) {
+    workers.emplace_back([&, t]() {
+      Playout<SIZE> playout(t+1);
+      while(std::chrono::steady_clock::now()-start < std::chrono::duration<double>(seconds)) {
+        for(int i = 0; i < 256; i++) results[3*t+playout.play(board)]++;
+      }
+    });
+  }
+  for(auto& w : workers) w.join();
+  std::chrono::duration<double> time_span = std::chrono::steady_clock::now()-start;
+
+  long games[3] = { 0, 0, 0 };
+  for(int t = 0; t < threads; t++) {
+    for(int r = 0; r < 3; r++) games[r] += results[3*t+r];
+  }
+  long total = games[WHITE]+games[BLACK]+games[TIE];
+  std::cout << total << " playouts in " << time_span.count() << "s" << std::endl;
+  std::cout << total/time_span.count() << " playouts/s, "
+            << total/time_span.count()/threads << " per thread" << std::endl;
+  std::cout << "White " << 100.0*games[WHITE]/total << "%, black "
+            << 100.0*games[BLACK]/total << "%, drawn " << 100.0*games[TIE]/total << "%" << std::endl;
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if(argc < 2) {
+    std::cout << "usage: playoutbench <size> [seconds] [threads] [< position.tps]" << std::endl;
+    return -1;
+  }
+  int size = std::atoi(argv[1]);
+  double seconds = argc > 2 ? std::atof(argv[2]) : 5;
+  int threads = argc > 3 ? std::atoi(argv[3]) : 1;
+  if(threads < 1) threads = 1;
+
+  std::string tps_str;
+  std::getline(std::cin, tps_str);
+
+  switch(size) {
+  case 3: return bench<3>(tps_str, seconds, threads);
+  case 4: return bench<4>(tps_str, seconds, threads);
+  case 5: return bench<5>(tps_str, seconds, threads);
+  case 6: return bench<6>(tps_str, seconds, threads);
+  case 7: return bench<7>(tps_str, seconds, threads);
+  case 8: return bench<8>(tps_str, seconds, threads);
+  default:
+    std::cout << "Boards of size < 3 or > 8 not supported!" << std::endl;
+    return -1;
+  }
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "eval.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+// Instrumentation for Eval: what each feature is worth and what it costs.
+//
+// ProfiledEval scores exactly like Eval, but runs terms_player with a
+// probe that counts the cycles spent on each feature and records the
+// distribution of each feature's contribution to the score. Plain Eval
+// uses NoProbe, so none of this costs anything unless ProfiledEval is
+// the evaluator being searched with.
+//
+// The counters are per thread.
+struct EvalProfile {
+  struct Counter {
+    uint64_t calls = 0;
+    uint64_t ticks = 0;
+
+    inline void add(uint64_t t) { calls++; ticks += t; }
+  };
+
+  struct Distribution {
+    uint64_t count = 0;
+    double sum = 0, sum_sq = 0;
+    int min = std::numeric_limits<int>::max();
+    int max = std::numeric_limits<int>::min();
+
+    inline void add(int v) {
+      count++;
+      sum += v;
+      sum_sq += (double)v*v;
+      min = std::min(min, v);
+      max = std::max(max, v);
+    }
+
+    double mean() const { return count ? sum/count : 0; }
+    double stddev() const {
+      return count ? std::sqrt(std::max(0.0, sum_sq/count - mean()*mean())) : 0;
+    }
+  };
+
+  Counter cost[Eval::NUM_TERMS];
+  // Each feature's weighted contribution, for the player being evaluated
+  // less the opponent's
+  Distribution value[Eval::NUM_TERMS];
+  Distribution score;
+
+  static EvalProfile& get() {
+    static thread_local EvalProfile profile;
+    return profile;
+  }
+
+  void reset() { *this = EvalProfile(); }
+
+  static const char* name(int t) {
+    static const char* names[Eval::NUM_TERMS] = {
+      "top_flats", "adj_flats", "flats", "caps", "influence", "captured_penalty"
+    };
+    return names[t];
+  }
+
+  // Timestamps from the cycle counter where there is one
+  static inline uint64_t now() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+
+  // What an empty begin/end pair reads as, to take off every measurement
+  static uint64_t overhead() {
+    static const uint64_t o = [] {
+      uint64_t best = std::numeric_limits<uint64_t>::max();
+      for(int i = 0; i < 1000; i++) {
+        uint64_t a = now();
+        uint64_t b = now();
+        best = std::min(best, b-a);
+      }
+      return best;
+    }();
+    return o;
+  }
+
+  void print() const {
+    uint64_t total = 0;
+    for(int t = 0; t < Eval::NUM_TERMS; t++) total += cost[t].ticks;
+    std::printf("%-17s %12s %12s %9s %7s %10s %10s %8s %8s\n",
+                "term", "calls", "ticks", "ticks/call", "share", "mean", "stddev", "min", "max");
+    for(int t = 0; t < Eval::NUM_TERMS; t++) {
+      const Counter& c = cost[t];
+      const Distribution& v = value[t];
+      std::printf("%-17s %12llu %12llu %9.1f %6.1f%% %10.1f %10.1f %8d %8d\n",
+                  name(t), (unsigned long long)c.calls, (unsigned long long)c.ticks,
+                  c.calls ? (double)c.ticks/c.calls : 0.0, total ? 100.0*c.ticks/total : 0.0,
+                  v.mean(), v.stddev(), v.count ? v.min : 0, v.count ? v.max : 0);
+    }
+    std::printf("%-17s %12llu %12s %9s %7s %10.1f %10.1f %8d %8d\n",
+                "score", (unsigned long long)score.count, "", "", "",
+                score.mean(), score.stddev(), score.count ? score.min : 0, score.count ? score.max : 0);
+  }
+};
+
+// Charges the time between begin and end to the feature
+struct CycleProbe {
+  static inline uint64_t& started() {
+    static thread_local uint64_t t;
+    return t;
+  }
+
+  static inline void begin(Eval::Term) {
+    started() = EvalProfile::now();
+  }
+
+  static inline void end(Eval::Term t) {
+    uint64_t ticks = EvalProfile::now()-started();
+    uint64_t o = EvalProfile::overhead();
+    EvalProfile::get().cost[t].add(ticks > o ? ticks-o : 0);
+  }
+};
+
+struct ProfiledEval : Eval {
+  // Each feature's weighted value, in the order of Term
+  static void weigh(const Terms& t, int v[NUM_TERMS]) {
+    const Weights& w = weights;
+    v[TOP_FLATS] = t.top_flats*w.top_flats;
+    v[ADJ_FLATS] = t.adj_flats*w.adj_flats;
+    v[FLATS] = t.flats*w.flats;
+    v[CAPS] = t.caps*w.caps;
+    v[INFLUENCE] = t.influence*w.influence;
+    v[CAPTURED_PENALTY] = t.captured_penalty*w.captured_penalty;
+  }
+
+  template<uint8_t SIZE>
+  static Score eval(const Board<SIZE>& state, uint8_t player) {
+    Terms mine = terms_player<SIZE, CycleProbe>(state, player);
+    Terms theirs = terms_player<SIZE, CycleProbe>(state, !player);
+    Score s = combine(mine) - combine(theirs);
+
+    EvalProfile& p = EvalProfile::get();
+    int a[NUM_TERMS], b[NUM_TERMS];
+    weigh(mine, a);
+    weigh(theirs, b);
+    for(int t = 0; t < NUM_TERMS; t++) p.value[t].add(a[t]-b[t]);
+    p.score.add(s);
+    return s;
+  }
+
+  template<uint8_t SIZE>
+  static Score eval(const Board<SIZE>& state, const Accumulator<SIZE>&, uint8_t player) {
+    return eval(state, player);
+  }
+
+  // Print what each feature contributes to the score of a position,
+  // net being player's contribution less the opponent's
+  template<uint8_t SIZE>
+  static void breakdown(const Board<SIZE>& state, uint8_t player) {
+    Terms t[2];
+    Eval::terms(state, t);
+    int v[2][NUM_TERMS];
+    weigh(t[WHITE], v[WHITE]);
+    weigh(t[BLACK], v[BLACK]);
+    int raw[2][NUM_TERMS] = {
+      { t[0].top_flats, t[0].adj_flats, t[0].flats, t[0].caps, t[0].influence, t[0].captured_penalty },
+      { t[1].top_flats, t[1].adj_flats, t[1].flats, t[1].caps, t[1].influence, t[1].captured_penalty },
+    };
+    int w[NUM_TERMS];
+    Terms ones;
+    ones.top_flats = ones.adj_flats = ones.flats = ones.caps = ones.influence = ones.captured_penalty = 1;
+    weigh(ones, w);
+
+    std::printf("%-17s %7s %7s %7s %9s %9s %9s\n",
+                "term", "weight", "white", "black", "white", "black", "net");
+    for(int i = 0; i < NUM_TERMS; i++) {
+      std::printf("%-17s %7d %7d %7d %9d %9d %9d\n", EvalProfile::name(i), w[i],
+                  raw[WHITE][i], raw[BLACK][i], v[WHITE][i], v[BLACK][i], v[player][i]-v[!player][i]);
+    }
+    // combine clamps, so the total can differ from the sum of the rows
+    std::printf("%-17s %7s %7s %7s %9d %9d %9d\n", "total", "", "", "",
+                combine(t[WHITE]), combine(t[BLACK]), Eval::eval(state, player));
+  }
+};
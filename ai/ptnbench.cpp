@@ -0,0 +1,471 @@
+// Measures how fast moves are read and written as PTN, and positions
+// as TPS, against the regex parsers and string building formatters
+// ptn.hpp and tps.hpp used to have, after checking they agree. The
+// moves are every legal move in the positions of some random games, and
+// for parsing also some that are mangled or don't fit the board. The
+// positions are those the games went through, which also have to come
+// back from TPS with the hash and reserves they had. Then the games are
+// read back as a PTN file.
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <regex>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include "tak/tak.hpp"
+#include "tak/ptn.hpp"
+#include "tak/tps.hpp"
+#include "tak/ptnfile.hpp"
+
+// What ptn::from_str, ptn::to_str, tps::from_str and tps::to_str were
+namespace old {
+
+template<uint8_t SIZE>
+std::string to_str(Move<SIZE> move) {
+  std::string m;
+  switch(move.type()) {
+  case Move<SIZE>::Type::MOVE: {
+    int x = 0;
+    for(int i = 1; i <= move.range(); i++) {
+      x += move.slides(i);
+    }
+    if(x > 1) {
+      m.push_back('0'+x);
+    }
+    m.push_back('a'+move.idx()%SIZE);
+    m.push_back('1'+move.idx()/SIZE);
+    m += ptn::to_str<SIZE>(move.dir());
+    if(move.range() != 1) {
+      for(int i = 1; i <= move.range(); i++) {
+        m.push_back('0'+move.slides(i));
+      }
+    }
+    return m;
+  }
+  case Move<SIZE>::Type::PLACE:
+    m += ptn::to_str(move.pieceType());
+    m.push_back('a'+move.idx()%SIZE);
+    m.push_back('1'+move.idx()/SIZE);
+    return m;
+  default:
+    return "?";
+  }
+}
+
+template<uint8_t SIZE>
+bool from_str(std::string ptn, Move<SIZE>& move) {
+  std::transform(ptn.begin(), ptn.end(), ptn.begin(), ::tolower);
+  std::regex place_rgx("([fsc]?)([a-f][1-8])");
+  std::regex move_rgx("([1-8]?)([a-f][1-8])([-+<>])([1-8]*)");
+  std::smatch match;
+
+  if(std::regex_match(ptn, match, place_rgx)) {
+    Piece type = Piece::FLAT;
+    if(match[1].str().size()) {
+      switch(match[1].str()[0]) {
+      case 'f': type = Piece::FLAT; break;
+      case 's': type = Piece::WALL; break;
+      case 'c': type = Piece::CAP; break;
+      }
+    }
+
+    uint8_t file = match[2].str()[0] - 'a';
+    uint8_t rank = match[2].str()[1] - '1';
+    if(file > SIZE-1 || rank > SIZE-1) return false;
+    uint8_t idx = file+rank*SIZE;
+    move = Move<SIZE>(idx, type);
+
+    return true;
+  } else if(std::regex_match(ptn, match, move_rgx)) {
+    typedef typename Move<SIZE>::Dir Dir;
+    uint8_t num_pieces = 1;
+    if(match[1].str().size()) {
+      num_pieces = match[1].str()[0]-'0';
+    }
+
+    uint8_t file = match[2].str()[0] - 'a';
+    uint8_t rank = match[2].str()[1] - '1';
+    if(file > SIZE-1 || rank > SIZE-1) return false;
+    uint8_t idx = file+rank*SIZE;
+
+    Dir dir;
+    switch(match[3].str()[0]) {
+    case '+': dir = Dir::NORTH; break;
+    case '-': dir = Dir::SOUTH; break;
+    case '>': dir = Dir::EAST; break;
+    case '<': dir = Dir::WEST; break;
+    default: return false;
+    }
+
+    uint8_t slides[SIZE-1] = { 0 };
+    uint8_t slides_sum = 0;
+    uint8_t range = match[4].str().size();
+    if(range > SIZE-1) return false;
+    for(int i = 0; i < range; i++) {
+      slides[i] = match[4].str()[i]-'0';
+      slides_sum += slides[i];
+    }
+
+    if(range == 0) {
+      range = 1;
+      slides[0] = num_pieces;
+      slides_sum = num_pieces;
+    }
+
+    if(slides_sum != num_pieces) return false;
+
+    move = Move<SIZE>(idx, dir, range, slides);
+
+    return true;
+  }
+
+  return false;
+}
+
+
+inline std::string to_str(Stack& stack) {
+  if(stack.height) {
+    std::string s;
+    uint64_t owners = stack.owners;
+    for(int i = stack.height-1; i >= 0; i--) {
+      if(owners&1) {
+        s.insert(0, "2");
+      } else {
+        s.insert(0, "1");
+      }
+      owners >>= 1;
+    }
+
+    if(stack.top == Piece::CAP) {
+      s += "C";
+    } else if(stack.top == Piece::WALL) {
+      s += "S";
+    }
+    return s;
+  } else {
+    return "x";
+  }
+}
+
+template<uint8_t SIZE>
+std::string to_str(Board<SIZE>& board) {
+  std::string b;
+  for(int j = SIZE-1; j >= 0; j--) {
+    int num_prev_empty = 0;
+    for(int i = 0; i < SIZE; i++) {
+      if(board.board[i+j*SIZE].height == 0) {
+        num_prev_empty++;
+        if(i == SIZE-1) {
+          b += "x"+(num_prev_empty > 1 ? std::to_string(num_prev_empty) : "");
+        }
+      } else {
+        if(num_prev_empty > 0) {
+          b += "x"+(num_prev_empty > 1 ? std::to_string(num_prev_empty) : "")+",";
+          num_prev_empty = 0;
+        }
+        b += to_str(board.board[i+j*SIZE]);
+        if(i < SIZE-1) b += ",";
+      }
+    }
+    if(j > 0) b += "/";
+  }
+
+  b += board.curPlayer == WHITE ? " 1 " : " 2 ";
+  b += std::to_string(board.round);
+
+  return b;
+}
+
+template<uint8_t SIZE>
+bool from_str(std::string tps, Board<SIZE>& board) {
+  std::string sq_reg = "(?:x[1-9]?|[12]+[SC]?)";
+  std::string row_reg = "(?:"+sq_reg+",){0,"+std::to_string(SIZE-1)+"}(?:"+sq_reg+")";
+  std::string board_reg = "(?:"+row_reg+"\\/){"+std::to_string(SIZE-1)+"}(?:"+row_reg+")";
+  std::string tps_str = "("+board_reg+") ([12]) ([0-9]+)";
+  std::regex tps_rgx(tps_str);
+
+  std::smatch match;
+  if(std::regex_search(tps, match, tps_rgx)) {
+    board.curPlayer = std::stoi(match[2].str()) - 1;
+    board.round = std::stoi(match[3].str());
+
+    std::istringstream b(match[1].str());
+    std::string row;
+    int y = SIZE-1;
+    while(std::getline(b, row, '/')) {
+      std::istringstream r(row);
+      std::string square;
+      int x = 0;
+      while(std::getline(r, square, ',')) {
+        if(square[0] == 'x') {
+          int num = 1;
+          if(square.size() > 1) {
+            num = square[1]-'0';
+          }
+          int end = x+num;
+          if((end-1)/SIZE != x/SIZE) return false;
+          for(; x < end; x++) {
+            int idx = x+y*SIZE;
+            board.board[idx].height = 0;
+            board.board[idx].owners = 0;
+            board.board[idx].top = Piece::FLAT;
+          }
+        } else {
+          int idx = x+y*SIZE;
+          for(char c : square) {
+            board.board[idx].top = Piece::FLAT;
+            if(c == '1') {
+              board.board[idx].owners <<= 1;
+              board.board[idx].height += 1;
+            } else if(c == '2') {
+              board.board[idx].owners <<= 1;
+              board.board[idx].owners |= 1;
+              board.board[idx].height += 1;
+            } else if(c == 'S') {
+              board.board[idx].top = Piece::WALL;
+            } else if(c == 'C') {
+              board.board[idx].top = Piece::CAP;
+            }
+          }
+          x++;
+        }
+      }
+
+      y--;
+    }
+
+    return true;
+  } else {
+    return false;
+  }
+}
+
+}
+
+template<typename F>
+static double measure(double seconds, long& calls, F f) {
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> time_span;
+  calls = 0;
+  do {
+    calls += f();
+    time_span = std::chrono::steady_clock::now()-start;
+  } while(time_span.count() < seconds);
+  return time_span.count();
+}
+
+template<uint8_t SIZE>
+static int bench(double seconds, int games) {
+  // Every move of every position of some random games, which are also
+  // written down as PTN
+  std::vector<Move<SIZE>> moves;
+  std::vector<Board<SIZE>> boards;
+  std::string file;
+  std::mt19937 rng(1);
+  for(int g = 0; g < games; g++) {
+    Board<SIZE> b;
+    file += "[Size \"" + std::to_string(SIZE) + "\"]\n\n";
+    while(!b.status().over) {
+      std::vector<Move<SIZE>> legal;
+      typename Board<SIZE>::Map map(b);
+      b.forEachMove(map, [&legal](Move<SIZE> m) {
+        legal.push_back(m);
+        return CONTINUE;
+      });
+      if(legal.empty()) break;
+      moves.insert(moves.end(), legal.begin(), legal.end());
+      boards.push_back(b);
+      Move<SIZE> m = legal[rng() % legal.size()];
+      if(b.curPlayer == WHITE) file += std::to_string(b.round) + ".";
+      file += " " + ptn::to_str(m) + (b.curPlayer == WHITE ? "" : "\n");
+      b.execute(m);
+    }
+    boards.push_back(b);
+    file += "\n\n";
+  }
+  std::vector<std::string> strs;
+  for(const Move<SIZE>& m : moves) strs.push_back(old::to_str(m));
+
+  // Some that shouldn't parse, or only do in the other case or with a
+  // count of one spelled out, plus all of the squares up to h8
+  std::vector<std::string> inputs = strs;
+  for(size_t i = 0; i < strs.size(); i += 7) {
+    std::string s = strs[i];
+    inputs.push_back(s.substr(0, s.size()-1));
+    inputs.push_back(s + "1");
+    inputs.push_back(" " + s);
+    inputs.push_back("9" + s);
+    std::string upper = s;
+    std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+    inputs.push_back(upper);
+  }
+  for(char f = 'a'; f <= 'h'; f++) {
+    for(char r = '0'; r <= '9'; r++) {
+      inputs.push_back(std::string(1, f) + r);
+      inputs.push_back(std::string("1") + f + r + "+");
+      inputs.push_back(std::string("1") + f + r + "+1");
+    }
+  }
+  inputs.push_back("");
+  inputs.push_back("c");
+  inputs.push_back("Fa1x");
+  inputs.push_back("3a1>111");
+  inputs.push_back("2a1>0");
+
+  // The same moves from both, except that the new parser knows the g
+  // and h files of the bigger boards, and not to carry more than SIZE
+  long differ = 0;
+  for(const std::string& s : inputs) {
+    Move<SIZE> a, b;
+    bool ok_old = old::from_str<SIZE>(s, a), ok_new = ptn::from_str<SIZE>(s, b);
+    bool expected = ok_old;
+    if(ok_new && !ok_old && SIZE > 6) expected = true;
+    if(ok_old && !ok_new && std::isdigit(s[0]) && s[0]-'0' > SIZE) expected = false;
+    if(ok_new != expected || (ok_old && ok_new && !(a == b))) {
+      if(differ++ < 10) std::cout << "Parsers differ on \"" << s << "\"" << std::endl;
+    }
+  }
+  for(size_t i = 0; i < moves.size(); i++) {
+    if(ptn::to_str(moves[i]) != strs[i]) {
+      if(differ++ < 10) std::cout << "Formatters differ on " << strs[i] << std::endl;
+    }
+  }
+  // The positions back from TPS as they were, and written the same
+  std::vector<std::string> tps_strs;
+  for(Board<SIZE>& b : boards) {
+    std::string str = tps::to_str(b);
+    tps_strs.push_back(str);
+    Board<SIZE> c;
+    if(str != old::to_str(b) || !tps::from_str(str, c) || !(c == b) || c.round != b.round || c.hash() != b.hash()) {
+      if(differ++ < 10) std::cout << "TPS differs on " << str << std::endl;
+    }
+  }
+  // and the games from PTN
+  std::istringstream in(file);
+  ptn::Reader<SIZE> reader(in);
+  size_t read = 0;
+  while(reader.next_game()) {
+    Move<SIZE> m;
+    while(reader.next(m)) read++;
+    if(reader.error().size()) std::cout << reader.error() << std::endl;
+  }
+  if(read+games != boards.size()) {
+    differ++;
+    std::cout << "Read " << read << " moves of " << boards.size()-games << std::endl;
+  }
+
+  std::cout << moves.size() << " moves, " << inputs.size() << " strings, " << boards.size()
+            << " positions, " << differ << " differences" << std::endl;
+
+  // Parsing what the formatters wrote
+  long calls;
+  long sink = 0;
+  double s = measure(seconds, calls, [&]() {
+    for(const std::string& str : strs) {
+      Move<SIZE> m;
+      sink += old::from_str<SIZE>(str, m);
+    }
+    return strs.size();
+  });
+  double old_parse = calls/s;
+  s = measure(seconds, calls, [&]() {
+    for(const std::string& str : strs) {
+      Move<SIZE> m;
+      sink += ptn::from_str<SIZE>(str, m);
+    }
+    return strs.size();
+  });
+  double new_parse = calls/s;
+  s = measure(seconds, calls, [&]() {
+    for(const Move<SIZE>& m : moves) sink += old::to_str(m).size();
+    return moves.size();
+  });
+  double old_format = calls/s;
+  s = measure(seconds, calls, [&]() {
+    char buf[ptn::MAX_LEN];
+    for(const Move<SIZE>& m : moves) sink += ptn::write(m, buf);
+    return moves.size();
+  });
+  double new_format = calls/s;
+
+  s = measure(seconds, calls, [&]() {
+    for(const std::string& str : tps_strs) {
+      Board<SIZE> b;
+      sink += old::from_str<SIZE>(str, b);
+    }
+    return tps_strs.size();
+  });
+  double old_tps_parse = calls/s;
+  s = measure(seconds, calls, [&]() {
+    for(const std::string& str : tps_strs) {
+      Board<SIZE> b;
+      sink += tps::from_str<SIZE>(str, b);
+    }
+    return tps_strs.size();
+  });
+  double new_tps_parse = calls/s;
+  s = measure(seconds, calls, [&]() {
+    for(Board<SIZE>& b : boards) sink += old::to_str(b).size();
+    return boards.size();
+  });
+  double old_tps_format = calls/s;
+  s = measure(seconds, calls, [&]() {
+    std::string str;
+    for(const Board<SIZE>& b : boards) {
+      str.clear();
+      tps::write(b, str);
+      sink += str.size();
+    }
+    return boards.size();
+  });
+  double new_tps_format = calls/s;
+  s = measure(seconds, calls, [&]() {
+    std::istringstream in(file);
+    ptn::Reader<SIZE> reader(in);
+    long n = 0;
+    while(reader.next_game()) {
+      Move<SIZE> m;
+      while(reader.next(m)) n++;
+    }
+    return n;
+  });
+  double reader_moves = calls/s;
+
+  std::cout << "parse:  regex " << old_parse << " moves/s, now " << new_parse << " moves/s ("
+            << new_parse/old_parse << "x)" << std::endl;
+  std::cout << "format: string " << old_format << " moves/s, now " << new_format << " moves/s ("
+            << new_format/old_format << "x)" << std::endl;
+  std::cout << "TPS parse:  regex " << old_tps_parse << " positions/s, now " << new_tps_parse << " positions/s ("
+            << new_tps_parse/old_tps_parse << "x)" << std::endl;
+  std::cout << "TPS format: string " << old_tps_format << " positions/s, now " << new_tps_format << " positions/s ("
+            << new_tps_format/old_tps_format << "x)" << std::endl;
+  std::cout << "PTN file: " << reader_moves << " moves/s, " << reader_moves*file.size()/read/(1<<20)
+            << " MB/s" << std::endl;
+  return sink && !differ ? 0 : -1;
+}
+
+int main(int argc, char** argv) {
+  if(argc < 2) {
+    std::cout << "usage: ptnbench <size> [seconds] [games]" << std::endl;
+    return -1;
+  }
+  int size = std::atoi(argv[1]);
+  double seconds = argc > 2 ? std::atof(argv[2]) : 1;
+  int games = argc > 3 ? std::atoi(argv[3]) : 20;
+
+  switch(size) {
+  case 3: return bench<3>(seconds, games);
+  case 4: return bench<4>(seconds, games);
+  case 5: return bench<5>(seconds, games);
+  case 6: return bench<6>(seconds, games);
+  case 7: return bench<7>(seconds, games);
+  case 8: return bench<8>(seconds, games);
+  default:
+    std::cout << "Boards of size < 3 or > 8 not supported!" << std::endl;
+    return -1;
+  }
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs the bot's searches, for any number of games at once, on a fixed
+// number of cores.
+//
+// Each search is queued with the game it's for and how much time that
+// game has left on our clock. Whenever a core frees up the game with the
+// least time left goes first. Searches that can use several threads get
+// a share of the cores in proportion to how short their game is on time
+// compared to the other games waiting on a search, but never more than
+// are free, so the machine is never oversubscribed.
+class Scheduler {
+public:
+  // Searches get run(threads), with the number of threads they may use
+  using Job = std::function<void(int)>;
+
+  // Lets another thread stop a search, whether it's still queued or
+  // already running. The job checks cancelled before starting, and
+  // attaches a way to stop itself while it runs.
+  struct Cancel {
+    std::atomic<bool> cancelled;
+    std::mutex lock;
+    // Stops the search that's running, if one is
+    std::function<void()> stop;
+
+    Cancel() : cancelled(false) {}
+
+    void cancel() {
+      std::lock_guard<std::mutex> guard(lock);
+      cancelled = true;
+      if(stop) stop();
+    }
+
+    // Hook up the search about to run, false if it's too late for it
+    bool attach(std::function<void()> s) {
+      std::lock_guard<std::mutex> guard(lock);
+      if(cancelled) return false;
+      stop = s;
+      return true;
+    }
+
+    void detach() {
+      std::lock_guard<std::mutex> guard(lock);
+      stop = nullptr;
+    }
+  };
+
+  // Assumed for games we haven't been told the clock of yet
+  static const int DEFAULT_CLOCK = 600;
+
+  explicit Scheduler(int cores) : cores(std::max(1, cores)), free(this->cores), stopping(false) {
+    for(int i = 0; i < this->cores; i++) {
+      workers.emplace_back([this]() { work(); });
+    }
+  }
+
+  ~Scheduler() {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stopping = true;
+    }
+    ready.notify_all();
+    for(auto& w : workers) w.join();
+  }
+
+  // Queue a search for game id, which has clock seconds left (0 if not
+  // known). Only parallel searches get more than one thread.
+  void submit(int id, double clock, bool parallel, Job run) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      queue.push_back({ id, parallel, std::move(run) });
+      clocks[id] = clock > 0 ? clock : DEFAULT_CLOCK;
+    }
+    ready.notify_one();
+  }
+
+  void set_clock(int id, double clock) {
+    std::lock_guard<std::mutex> guard(lock);
+    if(clocks.count(id) && clock > 0) clocks[id] = clock;
+  }
+
+  // Forget game id, dropping any of its searches that haven't started
+  void cancel(int id) {
+    std::lock_guard<std::mutex> guard(lock);
+    queue.erase(std::remove_if(queue.begin(), queue.end(), [id](const Queued& q) { return q.id == id; }),
+                queue.end());
+    if(!running.count(id)) clocks.erase(id);
+  }
+
+  int size() const { return cores; }
+
+private:
+  struct Queued {
+    int id;
+    bool parallel;
+    Job run;
+  };
+
+  const int cores;
+  int free;
+  bool stopping;
+  std::mutex lock;
+  std::condition_variable ready;
+  std::vector<Queued> queue;
+  // Time left for every game with a search queued or running
+  std::map<int, double> clocks;
+  // Threads in use by each game's running search
+  std::map<int, int> running;
+  std::vector<std::thread> workers;
+
+  void work() {
+    std::unique_lock<std::mutex> guard(lock);
+    while(true) {
+      ready.wait(guard, [this]() { return stopping || (queue.size() && free > 0); });
+      if(stopping) return;
+
+      auto next = std::min_element(queue.begin(), queue.end(), [this](const Queued& a, const Queued& b) {
+        return clocks[a.id] < clocks[b.id];
+      });
+      Queued job = std::move(*next);
+      queue.erase(next);
+
+      int threads = 1;
+      if(job.parallel) {
+        // Shorter clocks weigh more
+        double total = 0;
+        for(auto& c : clocks) total += 1/c.second;
+        threads = (int)(cores*(1/clocks[job.id])/total + 0.5);
+        threads = std::max(1, std::min(threads, free));
+      }
+      free -= threads;
+      running[job.id] = threads;
+
+      guard.unlock();
+      job.run(threads);
+      guard.lock();
+
+      free += threads;
+      running.erase(job.id);
+      if(std::none_of(queue.begin(), queue.end(), [&job](const Queued& q) { return q.id == job.id; })) {
+        clocks.erase(job.id);
+      }
+      ready.notify_all();
+    }
+  }
+};
@@ -0,0 +1,405 @@
+// Plays two engine configurations against each other, to tell whether a
+// change makes the bot stronger.
+//
+// Games run concurrently, one per thread. Each opening is played twice
+// with the engines swapping colours, and the openings come from random
+// moves, an opening book (see book.hpp) or a file of positions (tps per
+// line, optionally followed by a result as in corpus.hpp). Every game
+// gets fresh engines, so nothing learned in one game carries over to
+// the next.
+//
+// An engine is given as a kind and options, e.g. ab:eval=nnue,sym=1 or
+// mcts:eval=bit,rollouts=2. Moves are limited by time, by nodes (playouts
+// for MCTS), or for alphabeta by a fixed depth.
+//
+// Results are reported as engine A's score with the Elo difference it
+// implies and its 95% error, and with --sprt the games stop as soon as a
+// sequential probability ratio test can tell elo0 from elo1.
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include "tak/tak.hpp"
+#include "tak/tps.hpp"
+#include "alphabeta.hpp"
+#include "mcts.hpp"
+#include "eval.hpp"
+#include "incremental.hpp"
+#include "biteval.hpp"
+#include "nnue.hpp"
+#include "corpus.hpp"
+#include "book.hpp"
+#include "match.hpp"
+
+// What a move may cost, the same for both engines
+struct Limits {
+  double seconds = 0;
+  long nodes = 0;
+};
+
+// An engine configuration, parsed from kind[:key=value,...]
+struct Config {
+  std::string spec;
+  std::string kind = "ab";
+  std::string eval = "incremental";
+  int depth = 0;
+  bool symmetric = false, cache = false;
+  std::string policy = "puct";
+  double exploration = 1.5;
+  int rollouts = 0;
+
+  bool parse(const std::string& s) {
+    spec = s;
+    size_t colon = s.find(':');
+    kind = s.substr(0, colon);
+    if(kind != "ab" && kind != "mcts") return false;
+    if(kind == "mcts") eval = "bit";
+    std::istringstream opts(colon == std::string::npos ? "" : s.substr(colon+1));
+    std::string opt;
+    while(std::getline(opts, opt, ',')) {
+      size_t eq = opt.find('=');
+      if(eq == std::string::npos) return false;
+      std::string key = opt.substr(0, eq), value = opt.substr(eq+1);
+      if(key == "eval") eval = value;
+      else if(key == "depth") depth = std::atoi(value.c_str());
+      else if(key == "sym") symmetric = std::atoi(value.c_str());
+      else if(key == "cache") cache = std::atoi(value.c_str());
+      else if(key == "policy") policy = value;
+      else if(key == "c") exploration = std::atof(value.c_str());
+      else if(key == "rollouts") rollouts = std::atoi(value.c_str());
+      else return false;
+    }
+    return eval == "eval" || eval == "incremental" || eval == "bit" || eval == "nnue";
+  }
+};
+
+template<uint8_t SIZE>
+struct Engine {
+  virtual ~Engine() {}
+  virtual Move<SIZE> think(Board<SIZE>& board) = 0;
+};
+
+template<uint8_t SIZE, typename Evaluator>
+struct AlphaBetaEngine : Engine<SIZE> {
+  alphabeta<SIZE, Evaluator> ab;
+  Limits limits;
+  int depth;
+
+  AlphaBetaEngine(const Config& config, Limits limits) : limits(limits), depth(config.depth) {
+    ab.set_symmetric(config.symmetric);
+    ab.set_eval_cache(config.cache);
+    ab.set_log(nullptr);
+  }
+
+  Move<SIZE> think(Board<SIZE>& board) override {
+    Move<SIZE> move;
+    if(depth > 0) {
+      ab.search(board, move, depth);
+      return move;
+    }
+    // Otherwise deepen until the next ply would likely go over the
+    // budget, guessing it grows by as much as the last one did
+    auto start = std::chrono::steady_clock::now();
+    double prev = 0;
+    long prev_nodes = 0;
+    for(int d = 1; d < 64; d++) {
+      auto iteration = std::chrono::steady_clock::now();
+      ab.search(board, move, d);
+      double last = match::since(iteration);
+      long nodes = ab.nodes();
+      if(limits.nodes) {
+        double growth = prev_nodes > 0 ? std::max(2.0, (double)nodes/prev_nodes) : 4.0;
+        if(nodes*growth > limits.nodes) break;
+      } else {
+        double growth = prev > 0 ? std::max(4.0, last/prev) : 4.0;
+        if(match::since(start) + growth*last > limits.seconds) break;
+      }
+      prev = last;
+      prev_nodes = nodes;
+    }
+    return move;
+  }
+};
+
+template<uint8_t SIZE, typename Evaluator>
+struct MCTSEngine : Engine<SIZE> {
+  mcts<SIZE, Evaluator> tree;
+  Limits limits;
+
+  MCTSEngine(const Config& config, Limits limits) : limits(limits) {
+    typename mcts<SIZE, Evaluator>::Options options;
+    options.policy = config.policy == "uct" ? mcts<SIZE, Evaluator>::Policy::UCT : mcts<SIZE, Evaluator>::Policy::PUCT;
+    options.exploration = config.exploration;
+    options.rollouts = config.rollouts;
+    options.max_playouts = limits.nodes;
+    // Games run in parallel already
+    options.threads = 1;
+    tree.set_options(options);
+    tree.set_log(nullptr);
+  }
+
+  Move<SIZE> think(Board<SIZE>& board) override {
+    Move<SIZE> move;
+    // A node limit alone still needs a clock, so give it plenty
+    tree.search(board, move, limits.nodes ? 1e6 : limits.seconds);
+    return move;
+  }
+};
+
+template<uint8_t SIZE, typename Evaluator>
+static std::unique_ptr<Engine<SIZE>> make(const Config& config, Limits limits) {
+  if(config.kind == "mcts") return std::unique_ptr<Engine<SIZE>>(new MCTSEngine<SIZE, Evaluator>(config, limits));
+  return std::unique_ptr<Engine<SIZE>>(new AlphaBetaEngine<SIZE, Evaluator>(config, limits));
+}
+
+template<uint8_t SIZE>
+static std::unique_ptr<Engine<SIZE>> make(const Config& config, Limits limits) {
+  if(config.eval == "eval") return make<SIZE, Eval>(config, limits);
+  if(config.eval == "bit") return make<SIZE, BitEval>(config, limits);
+  if(config.eval == "nnue") return make<SIZE, NNUE>(config, limits);
+  return make<SIZE, IncrementalEval>(config, limits);
+}
+
+// Where the games start
+template<uint8_t SIZE>
+struct Openings {
+  std::vector<Board<SIZE>> positions;
+  int plies = 2;
+
+  // The opening for the n'th pair of games
+  Board<SIZE> get(size_t n) const {
+    if(positions.size()) return positions[n % positions.size()];
+    std::mt19937_64 rng(n+1);
+    while(true) {
+      Board<SIZE> b;
+      Book<SIZE>& book = Book<SIZE>::get();
+      for(int ply = 0; ply < plies && !b.status().over; ply++) {
+        Move<SIZE> m;
+        if(book.loaded()) {
+          if(!book.choose(b, m, rng())) break;
+        } else {
+          std::vector<Move<SIZE>> moves;
+          typename Board<SIZE>::Map map(b);
+          b.forEachMove(map, [&moves](Move<SIZE> m) {
+            moves.push_back(m);
+            return CONTINUE;
+          });
+          m = moves[rng() % moves.size()];
+        }
+        b.execute(m);
+      }
+      if(!b.status().over) return b;
+    }
+  }
+};
+
+// Results for engine A
+struct Score {
+  long wins = 0, draws = 0, losses = 0;
+
+  long games() const { return wins+draws+losses; }
+  double mean() const { return (wins + 0.5*draws)/games(); }
+  // Variance of a single game's score
+  double variance() const {
+    double m = mean();
+    return (wins*(1-m)*(1-m) + draws*(0.5-m)*(0.5-m) + losses*m*m)/games();
+  }
+
+  static double elo(double p) { return match::elo(p); }
+  static double expected(double elo) { return 1/(1+std::pow(10, -elo/400)); }
+
+  // Log likelihood ratio of elo1 against elo0, treating the score as
+  // normally distributed
+  double llr(double elo0, double elo1) const {
+    double var = variance();
+    if(!games() || var <= 0) return 0;
+    double s0 = expected(elo0), s1 = expected(elo1);
+    return (s1-s0)*(2*mean()-s0-s1)/(2*var/games());
+  }
+};
+
+struct SPRT {
+  bool enabled = false;
+  double elo0 = 0, elo1 = 5, alpha = 0.05, beta = 0.05;
+  double lower() const { return std::log(beta/(1-alpha)); }
+  double upper() const { return std::log((1-beta)/alpha); }
+};
+
+static void report(std::ostream& out, const Score& s, const SPRT& sprt) {
+  long n = s.games();
+  out << "Games " << n << ": +" << s.wins << " =" << s.draws << " -" << s.losses;
+  double m = s.mean();
+  if(m > 0 && m < 1) {
+    double error = 1.96*std::sqrt(s.variance()/n);
+    double lo = std::max(m-error, 1e-6), hi = std::min(m+error, 1-1e-6);
+    out << ", Elo " << Score::elo(m) << " +/- " << (Score::elo(hi)-Score::elo(lo))/2;
+  }
+  if(s.wins+s.losses) {
+    out << ", LOS " << 100*0.5*(1+std::erf((s.wins-s.losses)/std::sqrt(2.0*(s.wins+s.losses)))) << "%";
+  }
+  if(sprt.enabled) {
+    out << ", LLR " << s.llr(sprt.elo0, sprt.elo1) << " (" << sprt.lower() << ", " << sprt.upper() << ")";
+  }
+  out << std::endl;
+}
+
+template<uint8_t SIZE>
+static int run(const Config& a, const Config& b, Limits limits, Openings<SIZE> openings,
+               long max_games, int concurrency, SPRT sprt) {
+  if((a.eval == "nnue" || b.eval == "nnue") && !NNUE::loaded<SIZE>()) {
+    std::cout << "No network loaded for this size" << std::endl;
+    return -1;
+  }
+
+  std::cout << a.spec << " vs " << b.spec << std::endl;
+
+  Score score;
+  std::mutex lock;
+  std::atomic<long> next(0);
+  std::atomic<bool> done(false);
+  std::vector<std::thread> workers;
+  for(int t = 0; t < concurrency; t++) {
+    workers.emplace_back([&]() {
+      long game;
+      while(!done && (game = next++) < max_games) {
+        // Pairs of games share an opening, with A playing white first
+        Board<SIZE> start = openings.get(game/2);
+        auto ea = make<SIZE>(a, limits);
+        auto eb = make<SIZE>(b, limits);
+        bool a_white = game % 2 == 0;
+        double r = a_white ? match::play(start, *ea, *eb) : 1-match::play(start, *eb, *ea);
+
+        std::lock_guard<std::mutex> guard(lock);
+        if(done) break;
+        if(r == 1) score.wins++;
+        else if(r == 0) score.losses++;
+        else score.draws++;
+        report(std::cout, score, sprt);
+        if(sprt.enabled) {
+          double llr = score.llr(sprt.elo0, sprt.elo1);
+          if(llr <= sprt.lower() || llr >= sprt.upper()) {
+            std::cout << "SPRT: " << (llr >= sprt.upper() ? "H1" : "H0") << " accepted, "
+                      << a.spec << " is " << (llr >= sprt.upper() ? "at least " : "no more than ")
+                      << (llr >= sprt.upper() ? sprt.elo1 : sprt.elo0) << " Elo stronger" << std::endl;
+            done = true;
+          }
+        }
+      }
+    });
+  }
+  for(auto& w : workers) w.join();
+
+  std::cout << "Final: ";
+  report(std::cout, score, sprt);
+  return 0;
+}
+
+template<uint8_t SIZE>
+static int load_openings(const std::string& source, int plies, Openings<SIZE>& openings) {
+  openings.plies = plies;
+  if(source == "random") return 0;
+  if(source.compare(0, 5, "book:") == 0) {
+    if(!Book<SIZE>::get().open(source.substr(5))) {
+      std::cout << "Failed to open book " << source.substr(5) << std::endl;
+      return -1;
+    }
+    return 0;
+  }
+  std::vector<std::string> lines;
+  if(!corpus::read_lines(source, lines)) {
+    std::cout << "Failed to open " << source << std::endl;
+    return -1;
+  }
+  for(const std::string& line : lines) {
+    Board<SIZE> board;
+    std::string tps_str;
+    float result;
+    if(!corpus::parse_line(line, tps_str, result)) tps_str = line;
+    if(tps::from_str(tps_str, board)) openings.positions.push_back(board);
+  }
+  if(openings.positions.empty()) {
+    std::cout << "No positions in " << source << std::endl;
+    return -1;
+  }
+  return 0;
+}
+
+template<uint8_t SIZE>
+static int selfplay(const Config& a, const Config& b, Limits limits, const std::string& source, int plies,
+                    long max_games, int concurrency, SPRT sprt) {
+  Openings<SIZE> openings;
+  if(load_openings(source, plies, openings)) return -1;
+  return run<SIZE>(a, b, limits, openings, max_games, concurrency, sprt);
+}
+
+int main(int argc, char** argv) {
+  if(argc < 4) {
+    std::cout << "usage: selfplay <size> <engine A> <engine B> [--time <seconds per move>] [--nodes <n>]" << std::endl;
+    std::cout << "                [--games <n>] [--concurrency <n>] [--openings random|book:<file>|<positions>]" << std::endl;
+    std::cout << "                [--plies <opening plies>] [--sprt <elo0> <elo1> [alpha] [beta]]" << std::endl;
+    std::cout << "engines: ab[:eval=eval|incremental|bit|nnue,depth=<n>,sym=0|1,cache=0|1]" << std::endl;
+    std::cout << "         mcts[:eval=eval|incremental|bit|nnue,policy=uct|puct,c=<exploration>,rollouts=<n>]" << std::endl;
+    return -1;
+  }
+
+  int size = std::atoi(argv[1]);
+  Config a, b;
+  if(!a.parse(argv[2]) || !b.parse(argv[3])) {
+    std::cout << "Bad engine " << (a.parse(argv[2]) ? argv[3] : argv[2]) << std::endl;
+    return -1;
+  }
+
+  Limits limits;
+  long max_games = 1000;
+  int concurrency = std::thread::hardware_concurrency();
+  std::string source = "random";
+  int plies = 2;
+  SPRT sprt;
+  for(int i = 4; i < argc; i++) {
+    std::string arg = argv[i];
+    bool more = i+1 < argc;
+    if(arg == "--time" && more) limits.seconds = std::atof(argv[++i]);
+    else if(arg == "--nodes" && more) limits.nodes = std::atol(argv[++i]);
+    else if(arg == "--games" && more) max_games = std::atol(argv[++i]);
+    else if(arg == "--concurrency" && more) concurrency = std::atoi(argv[++i]);
+    else if(arg == "--openings" && more) source = argv[++i];
+    else if(arg == "--plies" && more) plies = std::atoi(argv[++i]);
+    else if(arg == "--sprt" && i+2 < argc) {
+      sprt.enabled = true;
+      sprt.elo0 = std::atof(argv[++i]);
+      sprt.elo1 = std::atof(argv[++i]);
+      if(i+1 < argc && argv[i+1][0] != '-') sprt.alpha = std::atof(argv[++i]);
+      if(i+1 < argc && argv[i+1][0] != '-') sprt.beta = std::atof(argv[++i]);
+    } else {
+      std::cout << "Unknown option " << arg << std::endl;
+      return -1;
+    }
+  }
+  if(concurrency < 1) concurrency = 1;
+  if(limits.seconds <= 0 && !limits.nodes) limits.seconds = 0.1;
+
+  Eval::load_weights("weights.txt");
+  std::string net = "nnue" + std::to_string(size) + ".bin";
+  NNUE::load(net);
+
+  switch(size) {
+  case 3: return selfplay<3>(a, b, limits, source, plies, max_games, concurrency, sprt);
+  case 4: return selfplay<4>(a, b, limits, source, plies, max_games, concurrency, sprt);
+  case 5: return selfplay<5>(a, b, limits, source, plies, max_games, concurrency, sprt);
+  case 6: return selfplay<6>(a, b, limits, source, plies, max_games, concurrency, sprt);
+  case 7: return selfplay<7>(a, b, limits, source, plies, max_games, concurrency, sprt);
+  case 8: return selfplay<8>(a, b, limits, source, plies, max_games, concurrency, sprt);
+  default:
+    std::cout << "Boards of size < 3 or > 8 not supported!" << std::endl;
+    return -1;
+  }
+}
@@ -0,0 +1,73 @@
+// Solves 3x3 and 4x4 positions (the empty board, or one read as TPS on
+// stdin) and writes out a table of everything proven on the way, for the
+// bot to play from.
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include "tak/tak.hpp"
+#include "tak/ptn.hpp"
+#include "tak/tps.hpp"
+#include "solver.hpp"
+
+template<uint8_t SIZE>
+static int solve(const std::string& tps_str, const std::string& out, int threads, int max_plies) {
+  Board<SIZE> board;
+  if(tps_str.size() && !tps::from_str(tps_str, board)) {
+    std::cout << "Failed to parse tps" << std::endl;
+    return -1;
+  }
+  std::cout << tps::to_str(board) << std::endl;
+
+  auto start = std::chrono::steady_clock::now();
+  Solver<SIZE> solver(threads);
+  int plies = 0;
+  Solved result = solver.solve(board, max_plies, plies, [&solver](int d) {
+    std::cout << "Nothing forced within " << d << " plies (" << solver.positions() << " positions)" << std::endl;
+  });
+  std::chrono::duration<double> time_span = std::chrono::steady_clock::now()-start;
+
+  if(result == Solved::WIN || result == Solved::LOSS) {
+    std::cout << "The player to move " << (result == Solved::WIN ? "wins" : "loses") << " in " << plies << " plies";
+  } else {
+    std::cout << "Not decided within " << max_plies << " plies";
+  }
+  std::cout << " (" << solver.positions() << " positions in " << time_span.count() << "s)" << std::endl;
+
+  size_t written;
+  if(!solver.write(out, written)) {
+    std::cout << "Failed to write " << out << std::endl;
+    return -1;
+  }
+  std::cout << "Wrote " << written << " solved positions to " << out << std::endl;
+
+  SolvedTable<SIZE> table;
+  Move<SIZE> move;
+  if(table.open(out) && table.best_move(board, move, result, plies)) {
+    std::cout << "Best move: " << ptn::to_str(move) << std::endl;
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if(argc < 2) {
+    std::cout << "usage: solve <size> [table out] [threads] [max plies] [< position.tps]" << std::endl;
+    return -1;
+  }
+  int size = std::atoi(argv[1]);
+  std::string out = argc > 2 ? argv[2] : "solved" + std::string(argv[1]) + ".bin";
+  int threads = argc > 3 ? std::atoi(argv[3]) : std::thread::hardware_concurrency();
+  int max_plies = argc > 4 ? std::atoi(argv[4]) : SolvedTable<3>::MAX_PLIES;
+
+  std::string tps_str;
+  std::getline(std::cin, tps_str);
+
+  switch(size) {
+  case 3: return solve<3>(tps_str, out, threads, max_plies);
+  case 4: return solve<4>(tps_str, out, threads, max_plies);
+  default:
+    std::cout << "Only 3x3 and 4x4 boards can be solved" << std::endl;
+    return -1;
+  }
+}
@@ -0,0 +1,232 @@
+#pragma once
+
+#include "tak/tak.hpp"
+#include "symmetry.hpp"
+#include "mapped.hpp"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Tables of solved positions for the small boards, written by solve and
+// read by the bot.
+
+// A dense, exact encoding of a position, the same for all eight
+// orientations of it.
+//
+// Each stack is written bottom to top as a 1 and the owner of each
+// piece, then a 0, then the top piece's type if there was a piece. With
+// the player to move in front, that says everything about a position: no
+// piece ever leaves the board, so the reserves are whatever isn't on it.
+// The key of a position is the smallest encoding of its orientations.
+template<uint8_t SIZE>
+struct Position {
+  enum {
+    TOP_BITS = num_caps<SIZE>::value > 0 ? 2 : 1,
+    PIECES = 2*(num_flats<SIZE>::value + num_caps<SIZE>::value),
+    BITS = 1 + 2*PIECES + SIZE*SIZE*(1+TOP_BITS),
+    WORDS = (BITS+63)/64,
+  };
+
+  struct Key {
+    uint64_t w[WORDS];
+
+    bool operator<(const Key& o) const {
+      for(int i = WORDS-1; i >= 0; i--) {
+        if(w[i] != o.w[i]) return w[i] < o.w[i];
+      }
+      return false;
+    }
+    bool operator==(const Key& o) const {
+      for(int i = 0; i < WORDS; i++) {
+        if(w[i] != o.w[i]) return false;
+      }
+      return true;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& k) const {
+      uint64_t h = 0;
+      for(int i = 0; i < WORDS; i++) {
+        h ^= k.w[i] + 0x9e3779b97f4a7c15ull + (h<<6) + (h>>2);
+      }
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdull;
+      h ^= h >> 33;
+      return h;
+    }
+  };
+
+  // The encoding of b turned by symmetry s
+  static Key encode(const Board<SIZE>& b, int s) {
+    Key k;
+    std::memset(k.w, 0, sizeof(k.w));
+    int n = 0;
+    auto put = [&k, &n](uint64_t bits, int count) {
+      for(int i = 0; i < count; i++, n++) {
+        k.w[n/64] |= ((bits>>i)&1) << (n%64);
+      }
+    };
+
+    put(b.curPlayer, 1);
+    int from = Symmetry<SIZE>::inverse(s);
+    for(int i = 0; i < SIZE*SIZE; i++) {
+      const Stack& stack = b.board[Symmetry<SIZE>::square(from, i)];
+      for(int h = stack.height-1; h >= 0; h--) {
+        put(1 | ((stack.owners>>h)&1)<<1, 2);
+      }
+      put(0, 1);
+      if(stack.height) put((uint8_t)stack.top, TOP_BITS);
+    }
+    return k;
+  }
+
+  static Key key(const Board<SIZE>& b) {
+    Key best = encode(b, 0);
+    for(int s = 1; s < Symmetry<SIZE>::NUM; s++) {
+      Key k = encode(b, s);
+      if(k < best) best = k;
+    }
+    return best;
+  }
+};
+
+// What a position is worth to the player to move
+enum class Solved : uint8_t {
+  UNKNOWN = 0, WIN = 1, LOSS = 2, DRAW = 3,
+};
+
+// A table of solved positions: a header, the keys in order, then one
+// byte per key with the result in the top two bits and the number of
+// plies to the end in the rest. The keys are searched where they lie in
+// the file, memory mapped where that's possible.
+template<uint8_t SIZE>
+class SolvedTable {
+public:
+  using P = Position<SIZE>;
+  using Key = typename P::Key;
+
+  struct Header {
+    char magic[4];
+    uint8_t size, words;
+    uint16_t pad;
+    uint64_t count;
+  };
+
+  static const int MAX_PLIES = 63;
+
+  static uint8_t pack(Solved r, int plies) {
+    return (uint8_t)r<<6 | std::min(plies, MAX_PLIES);
+  }
+
+  SolvedTable() = default;
+  SolvedTable(const SolvedTable&) = delete;
+  SolvedTable& operator=(const SolvedTable&) = delete;
+  ~SolvedTable() { close(); }
+
+  static bool write(const std::string& path, std::vector<std::pair<Key, uint8_t>>& entries) {
+    std::sort(entries.begin(), entries.end(),
+              [](const std::pair<Key, uint8_t>& a, const std::pair<Key, uint8_t>& b) { return a.first < b.first; });
+    std::ofstream out(path, std::ios::binary);
+    if(!out.is_open()) return false;
+    Header h = { { 'T', 'W', 'D', 'L' }, SIZE, P::WORDS, 0, entries.size() };
+    out.write((const char*)&h, sizeof(h));
+    for(auto& e : entries) out.write((const char*)e.first.w, sizeof(e.first.w));
+    for(auto& e : entries) out.write((const char*)&e.second, 1);
+    return out.good();
+  }
+
+  bool open(const std::string& path) {
+    close();
+    if(!file.open(path)) return false;
+    Header h;
+    if(file.size() < sizeof(h)) {
+      close();
+      return false;
+    }
+    std::memcpy(&h, file.data(), sizeof(h));
+    if(std::memcmp(h.magic, "TWDL", 4) || h.size != SIZE || h.words != P::WORDS ||
+       file.size() != sizeof(h) + h.count*(sizeof(Key)+1)) {
+      close();
+      return false;
+    }
+    count = h.count;
+    keys = (const Key*)(file.data() + sizeof(h));
+    values = (const uint8_t*)(keys + count);
+    return true;
+  }
+
+  void close() {
+    file.close();
+    keys = nullptr;
+    values = nullptr;
+    count = 0;
+  }
+
+  // The table the bot plays from
+  static SolvedTable& get() {
+    static SolvedTable table;
+    return table;
+  }
+
+  bool loaded() const { return keys != nullptr; }
+  size_t size() const { return count; }
+
+  Solved probe(const Board<SIZE>& b, int& plies) const {
+    if(!keys) return Solved::UNKNOWN;
+    Key k = P::key(b);
+    const Key* it = std::lower_bound(keys, keys+count, k);
+    if(it == keys+count || !(*it == k)) return Solved::UNKNOWN;
+    uint8_t v = values[it-keys];
+    plies = v & MAX_PLIES;
+    return (Solved)(v>>6);
+  }
+
+  // The best move from b by the table: the quickest win, or failing
+  // that a draw, or failing that the slowest loss. False if the table
+  // can't tell, because some move leads somewhere it doesn't know.
+  bool best_move(const Board<SIZE>& b, Move<SIZE>& best, Solved& result, int& plies) const {
+    if(!keys) return false;
+    // Rank moves by how good they are for the player to move: wins
+    // (sooner is better), then draws, then losses (later is better)
+    int best_rank = -1000;
+    bool unknown = false;
+    typename Board<SIZE>::Map map(b);
+    b.forEachMove(map, [&](Move<SIZE> m) {
+      Board<SIZE> c = b;
+      c.execute(m);
+      GameStatus status = c.status();
+      Solved r;
+      int p = 0;
+      if(status.over) {
+        r = status.winner == TIE ? Solved::DRAW : status.winner == b.curPlayer ? Solved::LOSS : Solved::WIN;
+      } else {
+        r = probe(c, p);
+      }
+      int rank;
+      switch(r) {
+      case Solved::LOSS: rank = 500-p; break;
+      case Solved::DRAW: rank = 0; break;
+      case Solved::WIN: rank = -500+p; break;
+      default: unknown = true; return CONTINUE;
+      }
+      if(rank > best_rank) {
+        best_rank = rank;
+        best = m;
+        result = r == Solved::LOSS ? Solved::WIN : r == Solved::WIN ? Solved::LOSS : Solved::DRAW;
+        plies = p+1;
+      }
+      return CONTINUE;
+    });
+    return best_rank > 0 || (!unknown && best_rank > -1000);
+  }
+
+private:
+  MappedFile file;
+  size_t count = 0;
+  const Key* keys = nullptr;
+  const uint8_t* values = nullptr;
+};
@@ -0,0 +1,281 @@
+#pragma once
+
+#include "tak/tak.hpp"
+#include "solved.hpp"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Solves small boards outright.
+//
+// The search proves wins: can the player to move force a road or flat
+// win within d plies? Every move is tried for the attacker and every
+// reply for the defender. d is deepened a ply at a time, odd depths
+// looking for a win for the player to move and even ones for a loss,
+// until the position is decided either way. Proofs only ever rest on
+// games that ended, so positions that can repeat don't need special
+// treatment.
+//
+// Everything proven is kept in a transposition table keyed by Position,
+// so the eight orientations of a position share their results. The
+// table is split into shards with their own locks so the root's moves
+// can be searched on all threads at once. Afterwards it's written out
+// as a SolvedTable: every position found to be a win or a loss, which
+// covers every reply the loser could try against the winning line.
+template<uint8_t SIZE>
+class Solver {
+public:
+  using P = Position<SIZE>;
+  using Key = typename P::Key;
+
+  // Told each depth that doesn't decide the position
+  using Progress = std::function<void(int plies)>;
+
+  explicit Solver(int threads = 1) : threads(std::max(1, threads)), shards(new Shard[NUM_SHARDS]), stop(false) {}
+
+  // Solve state, searching at most max_plies deep. Returns the result
+  // for the player to move, with the plies to the end in plies.
+  Solved solve(const Board<SIZE>& state, int max_plies, int& plies, Progress progress = nullptr) {
+    Board<SIZE> b = state;
+    if(b.status().over) return Solved::UNKNOWN;
+    for(int d = 1; d <= max_plies; d++) {
+      // Odd depths end on the mover's move, even on the opponent's
+      int p = d % 2 ? parallel(b, d, true) : parallel(b, d, false);
+      if(p) {
+        plies = p;
+        return d % 2 ? Solved::WIN : Solved::LOSS;
+      }
+      if(progress) progress(d);
+    }
+    return Solved::UNKNOWN;
+  }
+
+  size_t positions() const {
+    size_t n = 0;
+    for(int i = 0; i < NUM_SHARDS; i++) {
+      std::lock_guard<std::mutex> guard(shards[i].lock);
+      n += shards[i].entries.size();
+    }
+    return n;
+  }
+
+  // Write every proven position to path, written of them
+  bool write(const std::string& path, size_t& written) const {
+    std::vector<std::pair<Key, uint8_t>> out;
+    for(int i = 0; i < NUM_SHARDS; i++) {
+      std::lock_guard<std::mutex> guard(shards[i].lock);
+      for(auto& e : shards[i].entries) {
+        if(e.second.win) {
+          out.push_back(std::make_pair(e.first, SolvedTable<SIZE>::pack(Solved::WIN, e.second.win)));
+        } else if(e.second.loss) {
+          out.push_back(std::make_pair(e.first, SolvedTable<SIZE>::pack(Solved::LOSS, e.second.loss)));
+        }
+      }
+    }
+    written = out.size();
+    return SolvedTable<SIZE>::write(path, out);
+  }
+
+private:
+  // What's known about a position: plies within which the player to
+  // move wins or loses (0 if not known), and the deepest searches that
+  // found neither
+  struct Entry {
+    uint8_t win = 0, loss = 0, no_win = 0, no_loss = 0;
+  };
+
+  struct Shard {
+    std::mutex lock;
+    std::unordered_map<Key, Entry, typename P::KeyHash> entries;
+  };
+
+  static const int NUM_SHARDS = 256;
+
+  int threads;
+  std::unique_ptr<Shard[]> shards;
+  // Set once the root is decided, to wind the other threads up
+  std::atomic<bool> stop;
+
+  inline Shard& shard(const Key& k) const {
+    return shards[typename P::KeyHash()(k) % NUM_SHARDS];
+  }
+
+  Entry get(const Key& k) const {
+    Shard& s = shard(k);
+    std::lock_guard<std::mutex> guard(s.lock);
+    auto it = s.entries.find(k);
+    return it == s.entries.end() ? Entry() : it->second;
+  }
+
+  template<typename Func>
+  void update(const Key& k, Func f) {
+    Shard& s = shard(k);
+    std::lock_guard<std::mutex> guard(s.lock);
+    f(s.entries[k]);
+  }
+
+  // Search the root's moves on all threads. If win, find a move that
+  // wins within d plies, otherwise check that every move loses within d.
+  // Returns the plies, or 0.
+  int parallel(const Board<SIZE>& root, int d, bool win) {
+    std::vector<Move<SIZE>> moves;
+    typename Board<SIZE>::Map map(root);
+    root.forEachMove(map, [&moves](Move<SIZE> m) {
+      moves.push_back(m);
+      return CONTINUE;
+    });
+
+    std::atomic<size_t> next(0);
+    int best = win ? 0 : 1;
+    std::mutex lock;
+    uint8_t me = root.curPlayer;
+    stop = false;
+    std::vector<std::thread> workers;
+    for(int t = 0; t < threads; t++) {
+      workers.emplace_back([&]() {
+        size_t i;
+        while(!stop && (i = next++) < moves.size()) {
+          Board<SIZE> c = root;
+          c.execute(moves[i]);
+          GameStatus status = c.status();
+          // Plies to the end through this move if it goes the way we're
+          // looking for, or 0
+          int p;
+          if(status.over) {
+            p = (status.winner == me) == win && status.winner != TIE ? 1 : 0;
+          } else {
+            p = win ? lose(c, d-1) : this->win(c, d-1);
+            if(p) p++;
+          }
+          std::lock_guard<std::mutex> guard(lock);
+          if(stop) break;
+          if(win && p) {
+            // Any win will do, the depth is already as short as it gets
+            best = p;
+            stop = true;
+          } else if(!win && !p) {
+            // One escape is enough to disprove the loss
+            best = 0;
+            stop = true;
+          } else if(!win) {
+            best = std::max(best, p);
+          }
+        }
+      });
+    }
+    for(auto& w : workers) w.join();
+    stop = false;
+
+    int p = best;
+    if(!p) return 0;
+    Key k = P::key(root);
+    update(k, [win, p](Entry& e) {
+      if(win) e.win = p;
+      else e.loss = p;
+    });
+    return p;
+  }
+
+  // Plies within which the player to move can force a win, if that's
+  // at most d, or 0
+  int win(Board<SIZE>& b, int d) {
+    if(d < 1 || stop) return 0;
+    Key k = P::key(b);
+    Entry e = get(k);
+    if(e.win && e.win <= d) return e.win;
+    if(e.no_win >= d) return 0;
+
+    // Wins on the spot first, then everything else
+    std::vector<Board<SIZE>> children;
+    bool won = false;
+    uint8_t me = b.curPlayer;
+    typename Board<SIZE>::Map map(b);
+    b.forEachMove(map, [&](Move<SIZE> m) {
+      Board<SIZE> c = b;
+      c.execute(m);
+      GameStatus status = c.status();
+      if(status.over) {
+        if(status.winner == me) {
+          won = true;
+          return BREAK;
+        }
+      } else {
+        children.push_back(c);
+      }
+      return CONTINUE;
+    });
+
+    int best = won ? 1 : 0;
+    if(!best && d >= 3) {
+      for(Board<SIZE>& c : children) {
+        int p = lose(c, d-1);
+        if(p) {
+          best = p+1;
+          break;
+        }
+      }
+    }
+    if(stop) return 0;
+
+    update(k, [best, d](Entry& e) {
+      if(best) e.win = e.win ? std::min<int>(e.win, best) : best;
+      else e.no_win = std::max<int>(e.no_win, d);
+    });
+    return best;
+  }
+
+  // Plies within which the player to move is sure to lose, if that's at
+  // most d, or 0
+  int lose(Board<SIZE>& b, int d) {
+    if(d < 1 || stop) return 0;
+    Key k = P::key(b);
+    Entry e = get(k);
+    if(e.loss && e.loss <= d) return e.loss;
+    if(e.no_loss >= d) return 0;
+
+    // Any move that ends the game without losing it, or escapes, is
+    // enough to disprove the loss, so look at the quick ones first
+    std::vector<Board<SIZE>> children;
+    bool escaped = false;
+    int worst = 1;
+    uint8_t me = b.curPlayer;
+    typename Board<SIZE>::Map map(b);
+    b.forEachMove(map, [&](Move<SIZE> m) {
+      Board<SIZE> c = b;
+      c.execute(m);
+      GameStatus status = c.status();
+      if(status.over) {
+        if(status.winner == me || status.winner == TIE) {
+          escaped = true;
+          return BREAK;
+        }
+      } else {
+        children.push_back(c);
+      }
+      return CONTINUE;
+    });
+
+    if(!escaped) {
+      for(Board<SIZE>& c : children) {
+        int p = win(c, d-1);
+        if(!p) {
+          escaped = true;
+          break;
+        }
+        worst = std::max(worst, p+1);
+      }
+    }
+    if(stop) return 0;
+
+    int result = escaped ? 0 : worst;
+    update(k, [result, d](Entry& e) {
+      if(result) e.loss = e.loss ? std::min<int>(e.loss, result) : result;
+      else e.no_loss = std::max<int>(e.no_loss, d);
+    });
+    return result;
+  }
+};
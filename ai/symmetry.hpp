@@ -0,0 +1,132 @@
+#pragma once
+
+#include "tak/tak.hpp"
+
+// The eight rotations and reflections of a square board.
+// Positions that map onto each other under one of these are
+// equivalent, so they can share transposition table entries.
+template<uint8_t SIZE>
+struct Symmetry {
+  static const int NUM = 8;
+
+  // Where square idx ends up under symmetry s
+  static inline uint8_t square(int s, uint8_t idx) {
+    return squares().map[s][idx];
+  }
+
+  // The symmetry that undoes s
+  static inline int inverse(int s) {
+    // Only the quarter turns aren't their own inverse
+    return s == 1 ? 3 : s == 3 ? 1 : s;
+  }
+
+  // Apply symmetry s to a move
+  static Move<SIZE> transform(int s, Move<SIZE> m) {
+    if(s == 0) return m;
+    uint8_t idx = square(s, m.idx());
+    if(m.type() == Move<SIZE>::Type::PLACE) {
+      return Move<SIZE>(idx, m.pieceType());
+    }
+    // A move always covers at least one square, so the first step is on the board
+    uint8_t step = square(s, (uint8_t)(m.idx()+m.dir()));
+    uint8_t slides[SIZE-1];
+    for(int i = 0; i < SIZE-1; i++) {
+      slides[i] = m.slides(i+1);
+    }
+    return Move<SIZE>(idx, (typename Move<SIZE>::Dir)(uint8_t)(step-idx), m.range(), slides);
+  }
+
+  // One hash of the board per symmetry. The set of hashes is the same for
+  // all eight orientations of a position, so the smallest one is a key
+  // shared by all of them.
+  struct Hashes {
+    uint64_t h[NUM];
+
+    Hashes() {
+      for(int s = 0; s < NUM; s++) h[s] = 0;
+    }
+
+    explicit Hashes(const Board<SIZE>& b) : Hashes() {
+      for(int i = 0; i < SIZE*SIZE; i++) {
+        toggle(b.board[i], i);
+      }
+    }
+
+    // Hashes for the board `after' reached by playing m from `before'
+    Hashes after(const Board<SIZE>& before, const Board<SIZE>& after, Move<SIZE> m) const {
+      Hashes n = *this;
+      n.toggle(before.board[m.idx()], m.idx());
+      n.toggle(after.board[m.idx()], m.idx());
+      if(m.type() == Move<SIZE>::Type::MOVE) {
+        for(int i = 1; i <= m.range(); i++) {
+          uint8_t idx = m.idx()+i*m.dir();
+          n.toggle(before.board[idx], idx);
+          n.toggle(after.board[idx], idx);
+        }
+      }
+      return n;
+    }
+
+    // The canonical hash, and the symmetry that takes this
+    // board to the orientation the hash describes
+    uint64_t canonical(int& orientation) const {
+      orientation = 0;
+      for(int s = 1; s < NUM; s++) {
+        if(h[s] < h[orientation]) orientation = s;
+      }
+      return h[orientation];
+    }
+
+  private:
+    inline void toggle(const Stack& stack, uint8_t idx) {
+      uint64_t content = 0;
+      if(stack.height) {
+        content = util::fnv64(0xcbf29ce484222325)
+                   .hash(stack.height)
+                   .hash((uint8_t)stack.top)
+                   .hash(stack.owners).get();
+      }
+      for(int s = 0; s < NUM; s++) {
+        h[s] ^= mix(content ^ util::get_base(square(s, idx)));
+      }
+    }
+
+    // 64 bit finalizer from MurmurHash3, the per square terms
+    // need to be nonlinear or the xor would cancel the squares out
+    static inline uint64_t mix(uint64_t k) {
+      k ^= k >> 33;
+      k *= 0xff51afd7ed558ccd;
+      k ^= k >> 33;
+      k *= 0xc4ceb9fe1a85ec53;
+      k ^= k >> 33;
+      return k;
+    }
+  };
+
+private:
+  struct Squares {
+    uint8_t map[NUM][SIZE*SIZE];
+
+    Squares() {
+      const int n = SIZE-1;
+      for(int y = 0; y < SIZE; y++) {
+        for(int x = 0; x < SIZE; x++) {
+          int i = x+y*SIZE;
+          map[0][i] = x + y*SIZE;         // identity
+          map[1][i] = (n-y) + x*SIZE;     // quarter turn
+          map[2][i] = (n-x) + (n-y)*SIZE; // half turn
+          map[3][i] = y + (n-x)*SIZE;     // three quarter turn
+          map[4][i] = (n-x) + y*SIZE;     // mirror files
+          map[5][i] = x + (n-y)*SIZE;     // mirror ranks
+          map[6][i] = y + x*SIZE;         // main diagonal
+          map[7][i] = (n-y) + (n-x)*SIZE; // anti diagonal
+        }
+      }
+    }
+  };
+
+  static const Squares& squares() {
+    static const Squares s;
+    return s;
+  }
+};
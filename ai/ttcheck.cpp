@@ -0,0 +1,99 @@
+// Checks that every move the generator can emit comes back out of the
+// ttable the same as it went in, along with the entry's type, depth and
+// score. The moves are those of the positions of some random games, and
+// of boards with a stack of SIZE under a cap on every square (for the
+// longest spreads, which the random games hardly ever get to).
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include "tak/tak.hpp"
+#include "tak/ptn.hpp"
+#include "alphabeta.hpp"
+#include "eval.hpp"
+
+template<uint8_t SIZE>
+static int check(int games) {
+  using TT = typename alphabeta<SIZE, Eval>::Table;
+  using Entry = typename TT::Entry;
+  TT table(10);
+  std::mt19937_64 rng(1);
+  long checked = 0, wrong = 0;
+
+  auto round_trip = [&](const Board<SIZE>& b) {
+    std::vector<Move<SIZE>> legal;
+    typename Board<SIZE>::Map map(b);
+    b.forEachMove(map, [&legal](Move<SIZE> m) {
+      legal.push_back(m);
+      return CONTINUE;
+    });
+    for(Move<SIZE>& m : legal) {
+      uint64_t key = rng();
+      auto type = (typename Entry::Type)(1 + rng() % 3);
+      int depth = rng() % 64;
+      int16_t score = rng() % 20000;
+      table.put(key, Entry(type, depth, score, m));
+      auto e = table.get(key);
+      checked++;
+      if(!e) {
+        if(wrong++ < 10) std::cout << "Lost " << ptn::to_str(m) << std::endl;
+        continue;
+      }
+      Move<SIZE> back = e->move();
+      if(!(back == m) || e->type() != type || e->depth() != depth || e->score() != score) {
+        if(wrong++ < 10) {
+          std::cout << ptn::to_str(m) << " came back as " << ptn::to_str(back) << " (type " << (int)e->type()
+                    << ", depth " << e->depth() << ", score " << e->score() << ")" << std::endl;
+        }
+      }
+    }
+  };
+
+  std::mt19937 moves(1);
+  for(int g = 0; g < games; g++) {
+    Board<SIZE> b;
+    while(!b.status().over) {
+      round_trip(b);
+      std::vector<Move<SIZE>> legal;
+      typename Board<SIZE>::Map map(b);
+      b.forEachMove(map, [&legal](Move<SIZE> m) {
+        legal.push_back(m);
+        return CONTINUE;
+      });
+      if(legal.empty()) break;
+      b.execute(legal[moves() % legal.size()]);
+    }
+  }
+  for(int i = 0; i < SIZE*SIZE; i++) {
+    Board<SIZE> b;
+    b.round = 2;
+    b.board[i].height = SIZE;
+    b.board[i].owners = 0;
+    b.board[i].top = Piece::CAP;
+    round_trip(b);
+  }
+
+  std::cout << checked << " moves, " << wrong << " wrong" << std::endl;
+  return wrong ? -1 : 0;
+}
+
+int main(int argc, char** argv) {
+  if(argc < 2) {
+    std::cout << "usage: ttcheck <size> [games]" << std::endl;
+    return -1;
+  }
+  int size = std::atoi(argv[1]);
+  int games = argc > 2 ? std::atoi(argv[2]) : 50;
+
+  switch(size) {
+  case 3: return check<3>(games);
+  case 4: return check<4>(games);
+  case 5: return check<5>(games);
+  case 6: return check<6>(games);
+  case 7: return check<7>(games);
+  case 8: return check<8>(games);
+  default:
+    std::cout << "Boards of size < 3 or > 8 not supported!" << std::endl;
+    return -1;
+  }
+}
@@ -0,0 +1,201 @@
+// Texel style tuning of the evaluation weights.
+//
+// Reads a corpus of positions labelled with game results (see
+// corpus.hpp). The weights are fitted to minimize the squared error
+// between the result and a logistic function of the evaluation, and
+// written out in the format Eval::load_weights reads.
+//
+// The evaluation is linear in the weights (apart from clamping to
+// WIN/LOSS, which the fit ignores), so the features of every position are
+// extracted once up front and each iteration only has to sum them.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cmath>
+#include <cstdlib>
+#include "tak/tak.hpp"
+#include "tak/tps.hpp"
+#include "eval.hpp"
+#include "corpus.hpp"
+
+using corpus::parallel_for;
+
+static const int NUM_TERMS = Eval::NUM_TERMS;
+
+struct Sample {
+  // Difference in each feature between white and black
+  float d[NUM_TERMS];
+  float result;
+};
+
+static void weights_to_vec(const Eval::Weights& w, double v[NUM_TERMS]) {
+  int j = 0;
+#define WEIGHT(n) v[j++] = w.n;
+  EVAL_WEIGHTS
+#undef WEIGHT
+}
+
+static Eval::Weights vec_to_weights(const double v[NUM_TERMS]) {
+  Eval::Weights w;
+  int j = 0;
+#define WEIGHT(n) w.n = std::lround(v[j++]);
+  EVAL_WEIGHTS
+#undef WEIGHT
+  return w;
+}
+
+template<uint8_t SIZE>
+static std::vector<Sample> load(const std::vector<std::string>& lines, int threads) {
+  std::vector<Sample> samples(lines.size());
+  std::vector<char> ok(lines.size());
+  parallel_for(lines.size(), threads, [&](size_t begin, size_t end, int) {
+    for(size_t i = begin; i < end; i++) {
+      std::string tps_str;
+      Board<SIZE> board;
+      if(!corpus::parse_line(lines[i], tps_str, samples[i].result) ||
+         !tps::from_str(tps_str, board)) {
+        continue;
+      }
+      Eval::Terms t[2];
+      Eval::terms(board, t);
+      int j = 0;
+#define WEIGHT(n) samples[i].d[j++] = t[WHITE].n - t[BLACK].n;
+      EVAL_WEIGHTS
+#undef WEIGHT
+      ok[i] = 1;
+    }
+  });
+
+  size_t n = 0;
+  for(size_t i = 0; i < samples.size(); i++) {
+    if(ok[i]) samples[n++] = samples[i];
+    else std::cout << "Skipping unparseable line " << i+1 << ": " << lines[i] << std::endl;
+  }
+  samples.resize(n);
+  return samples;
+}
+
+static inline double sigmoid(double k, double s) {
+  return 1.0/(1.0+std::exp(-k*s));
+}
+
+// Mean squared error, and its gradient w.r.t. the weights if grad isn't null
+static double error(const std::vector<Sample>& samples, const double w[NUM_TERMS], double k, int threads, double grad[NUM_TERMS] = nullptr) {
+  std::vector<double> partial(threads*(NUM_TERMS+1), 0.0);
+  parallel_for(samples.size(), threads, [&](size_t begin, size_t end, int t) {
+    double e = 0;
+    double g[NUM_TERMS] = { 0 };
+    for(size_t i = begin; i < end; i++) {
+      const Sample& s = samples[i];
+      double score = 0;
+      for(int j = 0; j < NUM_TERMS; j++) score += w[j]*s.d[j];
+      double p = sigmoid(k, score);
+      double diff = s.result - p;
+      e += diff*diff;
+      if(grad) {
+        double c = -2*diff*p*(1-p)*k;
+        for(int j = 0; j < NUM_TERMS; j++) g[j] += c*s.d[j];
+      }
+    }
+    partial[t*(NUM_TERMS+1)] = e;
+    for(int j = 0; j < NUM_TERMS; j++) partial[t*(NUM_TERMS+1)+j+1] = g[j];
+  });
+
+  double e = 0;
+  if(grad) for(int j = 0; j < NUM_TERMS; j++) grad[j] = 0;
+  for(int t = 0; t < threads; t++) {
+    e += partial[t*(NUM_TERMS+1)];
+    if(grad) for(int j = 0; j < NUM_TERMS; j++) grad[j] += partial[t*(NUM_TERMS+1)+j+1];
+  }
+  if(grad) for(int j = 0; j < NUM_TERMS; j++) grad[j] /= samples.size();
+  return e/samples.size();
+}
+
+template<uint8_t SIZE>
+static int tune(const std::vector<std::string>& lines, const std::string& out, int threads, int iterations) {
+  auto samples = load<SIZE>(lines, threads);
+  if(samples.empty()) {
+    std::cout << "No positions to tune on" << std::endl;
+    return -1;
+  }
+  std::cout << "Loaded " << samples.size() << " positions" << std::endl;
+
+  double w[NUM_TERMS];
+  weights_to_vec(Eval::weights, w);
+
+  // Find the scaling of scores to win probability that fits the
+  // starting weights best (golden section search), then hold it fixed
+  double lo = 1e-5, hi = 1e-1;
+  const double phi = (std::sqrt(5.0)-1)/2;
+  for(int i = 0; i < 60; i++) {
+    double a = hi-phi*(hi-lo), b = lo+phi*(hi-lo);
+    if(error(samples, w, a, threads) < error(samples, w, b, threads)) hi = b;
+    else lo = a;
+  }
+  double k = (lo+hi)/2;
+  std::cout << "K = " << k << ", starting error " << error(samples, w, k, threads) << std::endl;
+
+  // Adam
+  const double rate = 1.0, beta1 = 0.9, beta2 = 0.999, eps = 1e-12;
+  double m[NUM_TERMS] = { 0 }, v[NUM_TERMS] = { 0 };
+  for(int it = 1; it <= iterations; it++) {
+    double g[NUM_TERMS];
+    double e = error(samples, w, k, threads, g);
+    for(int j = 0; j < NUM_TERMS; j++) {
+      m[j] = beta1*m[j] + (1-beta1)*g[j];
+      v[j] = beta2*v[j] + (1-beta2)*g[j]*g[j];
+      double mh = m[j]/(1-std::pow(beta1, it));
+      double vh = v[j]/(1-std::pow(beta2, it));
+      w[j] -= rate*mh/(std::sqrt(vh)+eps);
+    }
+    if(it % 100 == 0 || it == iterations) {
+      std::cout << "Iteration " << it << ": error " << e << std::endl;
+    }
+  }
+
+  Eval::Weights fitted = vec_to_weights(w);
+  double fitted_w[NUM_TERMS];
+  weights_to_vec(fitted, fitted_w);
+  std::cout << "Final error " << error(samples, fitted_w, k, threads) << std::endl;
+  if(!Eval::save_weights(out, fitted)) {
+    std::cout << "Failed to write " << out << std::endl;
+    return -1;
+  }
+  std::cout << "Wrote weights to " << out << std::endl;
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if(argc < 3) {
+    std::cout << "usage: tune <size> <corpus> [weights out] [threads] [iterations]" << std::endl;
+    return -1;
+  }
+
+  int size = std::atoi(argv[1]);
+  std::string out = argc > 3 ? argv[3] : "weights.txt";
+  int threads = argc > 4 ? std::atoi(argv[4]) : std::thread::hardware_concurrency();
+  int iterations = argc > 5 ? std::atoi(argv[5]) : 1000;
+  if(threads < 1) threads = 1;
+
+  // Start from whatever weights are being used now
+  Eval::load_weights(out);
+
+  std::vector<std::string> lines;
+  if(!corpus::read_lines(argv[2], lines)) {
+    std::cout << "Failed to open " << argv[2] << std::endl;
+    return -1;
+  }
+
+  switch(size) {
+  case 3: return tune<3>(lines, out, threads, iterations);
+  case 4: return tune<4>(lines, out, threads, iterations);
+  case 5: return tune<5>(lines, out, threads, iterations);
+  case 6: return tune<6>(lines, out, threads, iterations);
+  case 7: return tune<7>(lines, out, threads, iterations);
+  case 8: return tune<8>(lines, out, threads, iterations);
+  default:
+    std::cout << "Boards of size < 3 or > 8 not supported!" << std::endl;
+    return -1;
+  }
+}
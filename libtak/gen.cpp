@@ -225,6 +225,7 @@ int main(int argc, char** argv) {
   header << "    CUDA_CALLABLE inline iter begin() { return iter(begin_); }\n";
   header << "    CUDA_CALLABLE inline iter end() { return iter(end_); }\n";
   header << "    CUDA_CALLABLE inline int size() { return end_ - begin_; }\n";
+  header << "    CUDA_CALLABLE inline Index operator[](int i) { return Index((begin_+i)*8); }\n";
   header << "  };\n\n";
   header << "  CUDA_CALLABLE static range moves(int stack_height, int max_move) {\n";
   header << "    int start = get_table_idxs(stack_height);\n";
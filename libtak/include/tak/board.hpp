@@ -4,6 +4,7 @@
 #include "table.hpp"
 #include "move.hpp"
 #include "game.hpp"
+#include "geometry.hpp"
 #include <string>
 #include <algorithm>
 #include <iostream>
@@ -52,6 +53,15 @@ public:
     return util::fnv64(board_hash).hash(curPlayer).get();
   }
 
+  // Work out the hash from scratch, for boards set up a square at a
+  // time (like from TPS) rather than by moves
+  void rehash() {
+    board_hash = 0;
+    for(int i = 0; i < SIZE*SIZE; i++) {
+      board_hash ^= stackHash(i);
+    }
+  }
+
   uint64_t stackHash(uint8_t idx) {
     return util::fnv64(util::get_base(idx))
             .hash(board[idx].height)
@@ -122,75 +132,56 @@ public:
     }
   }
 
-  // Check if the given player has a road on board
-  CUDA_CALLABLE bool playerHasRoad(uint8_t player) const {
-    // Just for convenience...
-    const typename Move<SIZE>::Dir NORTH = Move<SIZE>::Dir::NORTH;
-    const typename Move<SIZE>::Dir SOUTH = Move<SIZE>::Dir::SOUTH;
-    const typename Move<SIZE>::Dir EAST = Move<SIZE>::Dir::EAST;
-    const typename Move<SIZE>::Dir WEST = Move<SIZE>::Dir::WEST;
-
-    // Bit vector of visited nodes
-    uint64_t visited = 0;
-    // Queue of currently waiting nodes
-    uint8_t queue[SIZE*SIZE];
-    uint8_t queueSize;
-
-    auto visit = [this, player, &queue, &queueSize, &visited](uint8_t n) {
-      if(board[n].height && (board[n].owner() == player) && (board[n].top != Piece::WALL)) {
-        uint64_t nm = ((uint64_t)1)<<n;
-        if((visited&nm) == 0) {
-          visited |= nm;
-          queue[queueSize++] = n;
-        }
-      }
-    };
-
-    // Search for a top<->bottom road
-    visited = queueSize = 0;
-    for(int i = 0; i < SIZE; i++) {
-      if(board[i].height && (board[i].owner() == player) && board[i].top != Piece::WALL) {
-        visited |= static_cast<uint64_t>(1)<<i;
-        queue[queueSize++] = i;
-      }
+  // Squares that could be part of a road for each player
+  CUDA_CALLABLE void roadSquares(uint64_t road[2]) const {
+    uint64_t usable = 0, black = 0;
+    UNROLL
+    for(int i = 0; i < SIZE*SIZE; i++) {
+      const Stack& s = board[i];
+      usable |= static_cast<uint64_t>((s.height != 0) & (s.top != Piece::WALL))<<i;
+      black |= static_cast<uint64_t>(s.owners&1)<<i;
     }
+    road[WHITE] = usable & ~black;
+    road[BLACK] = usable & black;
+  }
 
-    while(queueSize > 0) {
-      uint8_t node = queue[--queueSize];
-
-      if(node/SIZE == SIZE-1) {
-        return true;
+  // Check if the squares in road connect opposite edges of the board
+  CUDA_CALLABLE static bool hasRoad(uint64_t road) {
+    using G = Geometry<SIZE>;
+
+    // Flood out from one edge until the opposite one is reached or
+    // nothing more is connected
+    auto connects = [road](uint64_t from, uint64_t to) {
+      uint64_t reached = road & from;
+      while(reached) {
+        if(reached & to) return true;
+        uint64_t next = (reached | G::spread(reached)) & road;
+        if(next == reached) return false;
+        reached = next;
       }
+      return false;
+    };
 
-      if((uint8_t)(node+NORTH) < SIZE*SIZE) visit(node+NORTH);
-      if(((uint8_t)(node+EAST))/SIZE == node/SIZE) visit(node+EAST);
-      if(((uint8_t)(node+WEST))/SIZE == node/SIZE) visit(node+WEST);
-      if((uint8_t)(node+SOUTH) < SIZE*SIZE) visit(node+SOUTH);
-    }
-
-    // Search for a left<->right road
-    visited = queueSize = 0;
-    for(int i = 0; i < SIZE*SIZE; i += SIZE) {
-      if(board[i].height && board[i].owner() == player && board[i].top != Piece::WALL) {
-        visited |= static_cast<uint64_t>(1)<<i;
-        queue[queueSize++] = i;
-      }
+    // A road has to cross every row (or column) on the way, which
+    // rules most positions out without flooding at all
+    bool rows = true;
+    uint64_t cols = 0;
+    UNROLL
+    for(int y = 0; y < SIZE; y++) {
+      rows &= (road & G::row(y)) != 0;
+      cols |= road >> (y*SIZE);
     }
 
-    while(queueSize > 0) {
-      uint8_t node = queue[--queueSize];
-
-      if(node%SIZE == SIZE-1) {
-        return true;
-      }
-
-      if(((uint8_t)(node+EAST))/SIZE == node/SIZE) visit(node+EAST);
-      if((uint8_t)((node+NORTH)) < SIZE*SIZE) visit(node+NORTH);
-      if((uint8_t)((node+SOUTH)) < SIZE*SIZE) visit(node+SOUTH);
-      if(((uint8_t)(node+WEST))/SIZE == node/SIZE) visit(node+WEST);
-    }
+    // Search for a top<->bottom road, then a left<->right road
+    return (rows && connects(G::south_edge(), G::north_edge())) ||
+           ((cols & G::row(0)) == G::row(0) && connects(G::west_edge(), G::east_edge()));
+  }
 
-    return false;
+  // Check if the given player has a road on board
+  CUDA_CALLABLE bool playerHasRoad(uint8_t player) const {
+    uint64_t road[2];
+    roadSquares(road);
+    return hasRoad(road[player]);
   }
 
   // Check if the board is full
@@ -208,8 +199,10 @@ public:
     GameStatus s;
 
     // Check for roads
-    bool whiteRoad = playerHasRoad(WHITE);
-    bool blackRoad = playerHasRoad(BLACK);
+    uint64_t road[2];
+    roadSquares(road);
+    bool whiteRoad = hasRoad(road[WHITE]);
+    bool blackRoad = hasRoad(road[BLACK]);
 
     // If either player has a road
     if(whiteRoad || blackRoad) {
@@ -310,7 +303,6 @@ public:
       if(board[m.idx()].owner() != curPlayer) {
         return false;
       }
-      if(m.pieceType() == Piece::INVALID) return false;
       int slide_sum = 0;
       for(int n = m.range(); n > 0; n--) {
         uint8_t i = m.idx()+n*m.dir();
@@ -330,35 +322,48 @@ public:
       }
       return true; }
     case Move<SIZE>::Type::PLACE:
-      return board[m.idx()].height == 0;
+      return m.pieceType() != Piece::INVALID && board[m.idx()].height == 0;
     default:
       return false;
     }
   }
 
   CUDA_CALLABLE void execute(Move<SIZE>& m) {
+    apply<true>(m);
+  }
+
+  // Execute a move without keeping the hash up to date, for boards that
+  // are thrown away afterwards (like random playouts). hash() is wrong
+  // from then on.
+  CUDA_CALLABLE void executeUnhashed(Move<SIZE>& m) {
+    apply<false>(m);
+  }
+
+private:
+  template<bool HASH>
+  CUDA_CALLABLE inline void apply(Move<SIZE>& m) {
     switch(m.type()) {
     case Move<SIZE>::Type::MOVE: {
-      board_hash ^= stackHash(m.idx());
+      if(HASH) board_hash ^= stackHash(m.idx());
 
-      board_hash ^= stackHash((uint8_t)(m.idx()+m.range()*m.dir()));
+      if(HASH) board_hash ^= stackHash((uint8_t)(m.idx()+m.range()*m.dir()));
       int nDropped = m.slides(m.range());
       uint8_t dropped = board[m.idx()].pop(nDropped);
       board[(uint8_t)(m.idx()+m.range()*m.dir())].push(nDropped, dropped);
 
       for(int n = m.range()-1; n > 0; n--) {
-        board_hash ^= stackHash((uint8_t)(m.idx()+n*m.dir()));
+        if(HASH) board_hash ^= stackHash((uint8_t)(m.idx()+n*m.dir()));
         nDropped = m.slides(n);
         dropped = board[m.idx()].pop(nDropped);
         board[(uint8_t)(m.idx()+n*m.dir())].push(nDropped, dropped);
         board[(uint8_t)(m.idx()+n*m.dir())].top = Piece::FLAT;
-        board_hash ^= stackHash((uint8_t)(m.idx()+n*m.dir()));
+        if(HASH) board_hash ^= stackHash((uint8_t)(m.idx()+n*m.dir()));
       }
       m.undo() = board[(uint8_t)(m.idx()+m.range()*m.dir())].top;
       board[(uint8_t)(m.idx()+m.range()*m.dir())].top = board[m.idx()].top;
       board[m.idx()].top = Piece::FLAT;
-      board_hash ^= stackHash((uint8_t)(m.idx()+m.range()*m.dir()));
-      board_hash ^= stackHash(m.idx());
+      if(HASH) board_hash ^= stackHash((uint8_t)(m.idx()+m.range()*m.dir()));
+      if(HASH) board_hash ^= stackHash(m.idx());
       break;
                                  }
     case Move<SIZE>::Type::PLACE:
@@ -375,12 +380,12 @@ public:
       default:
         break;
       }
-      board_hash ^= stackHash(m.idx());
+      if(HASH) board_hash ^= stackHash(m.idx());
       // Place for opposite player if round 1, otherwise place for current player
       board[m.idx()].owners = round == 1 ? !curPlayer : curPlayer;
       board[m.idx()].top = m.pieceType();
       board[m.idx()].height = 1;
-      board_hash ^= stackHash(m.idx());
+      if(HASH) board_hash ^= stackHash(m.idx());
       break;
     }
 
@@ -389,11 +394,16 @@ public:
     curPlayer = !curPlayer;
   }
 
+public:
   CUDA_CALLABLE void undo(Move<SIZE>& m) {
     curPlayer = !curPlayer;
     round -= curPlayer == BLACK;
     switch(m.type()) {
     case Move<SIZE>::Type::MOVE:
+      board_hash ^= stackHash(m.idx());
+      for(int n = 1; n <= m.range(); n++) {
+        board_hash ^= stackHash((uint8_t)(m.idx()+n*m.dir()));
+      }
       board[m.idx()].top = board[(uint8_t)(m.idx()+m.range()*m.dir())].top;
       board[(uint8_t)(m.idx()+m.range()*m.dir())].top = m.undo();
       for(int n = 1; n <= m.range(); n++) {
@@ -401,6 +411,10 @@ public:
         uint8_t dropped = board[(uint8_t)(m.idx()+n*m.dir())].pop(nDropped);
         board[m.idx()].push(nDropped, dropped);
       }
+      board_hash ^= stackHash(m.idx());
+      for(int n = 1; n <= m.range(); n++) {
+        board_hash ^= stackHash((uint8_t)(m.idx()+n*m.dir()));
+      }
       break;
     case Move<SIZE>::Type::PLACE:
       switch(m.pieceType()) {
@@ -416,10 +430,43 @@ public:
       default:
         break;
       }
+      board_hash ^= stackHash(m.idx());
       board[m.idx()].height = 0;
+      board[m.idx()].owners = 0;
+      board[m.idx()].top = Piece::FLAT;
+      board_hash ^= stackHash(m.idx());
       break;
     }
   }
+
+  // Bit mask of the squares a move changes
+  CUDA_CALLABLE static uint64_t squares(const Move<SIZE>& m) {
+    uint64_t mask = static_cast<uint64_t>(1)<<m.idx();
+    if(m.type() == Move<SIZE>::Type::MOVE) {
+      for(int n = 1; n <= m.range(); n++) {
+        mask |= static_cast<uint64_t>(1)<<(uint8_t)(m.idx()+n*m.dir());
+      }
+    }
+    return mask;
+  }
+
+  // Execute/undo a move, telling obs which squares change
+  // (obs.before() sees the board before the move, obs.after() after it)
+  template<typename Observer>
+  CUDA_CALLABLE void execute(Move<SIZE>& m, Observer& obs) {
+    uint64_t changed = squares(m);
+    obs.before(*this, changed);
+    execute(m);
+    obs.after(*this, changed);
+  }
+
+  template<typename Observer>
+  CUDA_CALLABLE void undo(Move<SIZE>& m, Observer& obs) {
+    uint64_t changed = squares(m);
+    obs.before(*this, changed);
+    undo(m);
+    obs.after(*this, changed);
+  }
 };
 
 template<uint8_t SIZE>
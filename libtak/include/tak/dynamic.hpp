@@ -54,7 +54,10 @@ public:
 
   inline DynamicMove(uint8_t x, uint8_t y, Piece pieceType) : x_(x), y_(y), type_(Type::PLACE), data(pieceType) {}
   inline DynamicMove(uint8_t x, uint8_t y, Dir dir, uint8_t range, std::vector<uint8_t> slides) :
-    x_(x), y_(y), type_(Type::MOVE), data(dir, range, slides) {}
+    x_(x), y_(y), type_(Type::MOVE), data(dir, range, slides.data(), slides.size()) {}
+  // The same, with num_slides slides read from slides
+  inline DynamicMove(uint8_t x, uint8_t y, Dir dir, uint8_t range, const uint8_t* slides, int num_slides) :
+    x_(x), y_(y), type_(Type::MOVE), data(dir, range, slides, num_slides) {}
 
   inline Type type() { return type_; }
   inline uint8_t x() { return x_; }
@@ -81,11 +84,11 @@ private:
     } movement;
 
     Data(Piece pieceType) : placement({ pieceType }) {}
-    Data(Dir dir, uint8_t range, std::vector<uint8_t> slides) {
+    Data(Dir dir, uint8_t range, const uint8_t* slides, int num_slides) {
       movement.dir = dir;
       movement.range = range;
       int i = 0;
-      for(; i < slides.size() && i < 7; i++) {
+      for(; i < num_slides && i < 7; i++) {
         movement.slides[i] = slides[i];
       }
 
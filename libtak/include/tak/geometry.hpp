@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+
+#include "util.hpp"
+
+// Compile time tables describing the squares of a SIZE x SIZE board,
+// so the hot loops don't have to divide to find rows and columns or
+// check neighbours with uint8_t wraparound tricks.
+//
+// Squares are numbered from a1 along each row, like Board::board.
+// Masks have bit i set for square i.
+template<uint8_t SIZE>
+struct Geometry {
+  enum : int { NUM_SQUARES = SIZE*SIZE };
+
+  enum Ray : uint8_t { NORTH = 0, SOUTH = 1, EAST = 2, WEST = 3 };
+
+  CUDA_CALLABLE static constexpr uint64_t bit(int i) {
+    return static_cast<uint64_t>(1)<<i;
+  }
+
+  CUDA_CALLABLE static constexpr uint64_t all() {
+    return NUM_SQUARES == 64 ? ~static_cast<uint64_t>(0) : bit(NUM_SQUARES)-1;
+  }
+
+  // Row y (rank y+1)
+  CUDA_CALLABLE static constexpr uint64_t row(int y) {
+    return ((static_cast<uint64_t>(1)<<SIZE)-1)<<(y*SIZE);
+  }
+
+  // Column x (file 'a'+x)
+  CUDA_CALLABLE static constexpr uint64_t col(int x, int y = 0) {
+    return y == SIZE ? 0 : bit(y*SIZE+x) | col(x, y+1);
+  }
+
+  CUDA_CALLABLE static constexpr uint64_t south_edge() { return row(0); }
+  CUDA_CALLABLE static constexpr uint64_t north_edge() { return row(SIZE-1); }
+  CUDA_CALLABLE static constexpr uint64_t west_edge() { return col(0); }
+  CUDA_CALLABLE static constexpr uint64_t east_edge() { return col(SIZE-1); }
+  CUDA_CALLABLE static constexpr uint64_t edges() {
+    return south_edge() | north_edge() | west_edge() | east_edge();
+  }
+
+  // Every square next to a square in m
+  CUDA_CALLABLE static inline uint64_t spread(uint64_t m) {
+    return ((m<<SIZE) | (m>>SIZE) | ((m&~east_edge())<<1) | ((m&~west_edge())>>1)) & all();
+  }
+
+  CUDA_CALLABLE static inline int x(int i) {
+#ifdef __CUDA_ARCH__
+    return i%SIZE;
+#else
+    return table.x[i];
+#endif
+  }
+
+  CUDA_CALLABLE static inline int y(int i) {
+#ifdef __CUDA_ARCH__
+    return i/SIZE;
+#else
+    return table.y[i];
+#endif
+  }
+
+  // The (up to four) squares next to square i
+  CUDA_CALLABLE static inline uint64_t neighbours(int i) {
+#ifdef __CUDA_ARCH__
+    return neighbours_of(i);
+#else
+    return table.neighbours[i];
+#endif
+  }
+
+  // Number of squares next to square i
+  CUDA_CALLABLE static inline int degree(int i) {
+#ifdef __CUDA_ARCH__
+    return degree_of(i);
+#else
+    return table.degree[i];
+#endif
+  }
+
+  // The squares from square i (not included) to the edge in direction r
+  CUDA_CALLABLE static inline uint64_t ray(int i, Ray r) {
+#ifdef __CUDA_ARCH__
+    return ray_of(i, r);
+#else
+    return table.rays[r][i];
+#endif
+  }
+
+private:
+  CUDA_CALLABLE static constexpr uint64_t neighbours_of(int i) {
+    return (i+SIZE < NUM_SQUARES ? bit(i+SIZE) : 0) |
+           (i >= SIZE ? bit(i-SIZE) : 0) |
+           (i%SIZE != SIZE-1 ? bit(i+1) : 0) |
+           (i%SIZE != 0 ? bit(i-1) : 0);
+  }
+
+  CUDA_CALLABLE static constexpr int degree_of(int i) {
+    return (i+SIZE < NUM_SQUARES) + (i >= SIZE) + (i%SIZE != SIZE-1) + (i%SIZE != 0);
+  }
+
+  CUDA_CALLABLE static constexpr uint64_t ray_of(int i, int r) {
+    return r == NORTH ? (i+SIZE < NUM_SQUARES ? bit(i+SIZE) | ray_of(i+SIZE, r) : 0) :
+           r == SOUTH ? (i >= SIZE ? bit(i-SIZE) | ray_of(i-SIZE, r) : 0) :
+           r == EAST ? (i%SIZE != SIZE-1 ? bit(i+1) | ray_of(i+1, r) : 0) :
+                       (i%SIZE != 0 ? bit(i-1) | ray_of(i-1, r) : 0);
+  }
+
+  template<int... I> struct Indices {};
+  template<int N, int... I> struct MakeIndices : MakeIndices<N-1, N-1, I...> {};
+  template<int... I> struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+  struct Table {
+    uint8_t x[NUM_SQUARES];
+    uint8_t y[NUM_SQUARES];
+    uint8_t degree[NUM_SQUARES];
+    uint64_t neighbours[NUM_SQUARES];
+    uint64_t rays[4][NUM_SQUARES];
+  };
+
+  template<int... I>
+  static constexpr Table make_table(Indices<I...>) {
+    return Table {
+      { (uint8_t)(I%SIZE)... },
+      { (uint8_t)(I/SIZE)... },
+      { (uint8_t)degree_of(I)... },
+      { neighbours_of(I)... },
+      { { ray_of(I, NORTH)... }, { ray_of(I, SOUTH)... },
+        { ray_of(I, EAST)... }, { ray_of(I, WEST)... } },
+    };
+  }
+
+  static constexpr Table table = make_table(typename MakeIndices<NUM_SQUARES>::type());
+};
+
+template<uint8_t SIZE>
+constexpr typename Geometry<SIZE>::Table Geometry<SIZE>::table;
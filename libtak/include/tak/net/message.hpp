@@ -48,18 +48,20 @@ private:
 
 class ServerMsg {
 public:
+  // Strings handed to the visitor point into the message, so they're
+  // only good until it's gone. Copy what needs keeping.
   class Visitor {
   public:
     inline virtual void welcome_msg() {}
     inline virtual void login_prompt_msg() {}
-    inline virtual void login_success_msg(std::string name) {}
+    inline virtual void login_success_msg(util::string_view name) {}
     inline virtual void game_add_msg(
-      int id, std::string player1, std::string player2,
-      int size, int time, int incr, int moves, std::string cur_player
+      int id, util::string_view player1, util::string_view player2,
+      int size, int time, int incr, int moves, util::string_view cur_player
     ) {}
     // There's more information in this message, but it seems useless
     inline virtual void game_remove_msg(int id) {}
-    inline virtual void game_start_msg(int id, int size, std::string player1, std::string player2, Player player) {}
+    inline virtual void game_start_msg(int id, int size, util::string_view player1, util::string_view player2, Player player) {}
     inline virtual void move_msg(int id, DynamicMove move) {}
     inline virtual void time_msg(int id, int white_time, int black_time) {}
     inline virtual void game_over_msg(int id, GameStatus status) {}
@@ -72,24 +74,26 @@ public:
     inline virtual void seek_new_msg(Seek seek) {}
     inline virtual void seek_remove_msg(Seek seek) {}
     inline virtual void observe_game_msg(
-      int id, std::string player1, std::string player2,
-      int size, int time, int moves, std::string cur_player
+      int id, util::string_view player1, util::string_view player2,
+      int size, int time, int moves, util::string_view cur_player
     ) {}
-    inline virtual void shout_msg(std::string player, std::string msg) {}
-    inline virtual void server_msg(std::string msg) {}
-    inline virtual void error_msg(std::string what) {}
+    inline virtual void shout_msg(util::string_view player, util::string_view msg) {}
+    inline virtual void server_msg(util::string_view msg) {}
+    inline virtual void error_msg(util::string_view what) {}
     inline virtual void online_msg(int num_players) {}
     inline virtual void nok_msg() {}
     inline virtual void ok_msg() {}
     // Unable to parse message
-    inline virtual void unknown_msg(std::string msg) {}
+    inline virtual void unknown_msg(util::string_view msg) {}
   };
 
-  ServerMsg(std::string msg);
+  // A line from the server, without its newline. The message only looks
+  // at it, so it has to outlive the message.
+  ServerMsg(util::string_view msg);
 
   void handle(Visitor& v);
 private:
-  std::string m;
+  util::string_view m;
 };
 
 
@@ -1,15 +1,18 @@
 #pragma once
 
-#include <regex>
 #include <string>
-#include <algorithm>
 
+#include "util.hpp"
 #include "game.hpp"
 #include "move.hpp"
 #include "dynamic.hpp"
 
 namespace ptn {
 
+// Room for the longest move (a count, the square, the direction and a
+// drop for each of the 7 squares an 8x8 spread can cover) and a NUL
+static const size_t MAX_LEN = 12;
+
 template<uint8_t SIZE>
 std::string to_str(typename Move<SIZE>::Dir dir) {
   switch(dir) {
@@ -21,7 +24,7 @@ std::string to_str(typename Move<SIZE>::Dir dir) {
   }
 }
 
-std::string to_str(DynamicMove::Dir dir) {
+inline std::string to_str(DynamicMove::Dir dir) {
   switch(dir) {
   case DynamicMove::Dir::NORTH: return "+";
   case DynamicMove::Dir::SOUTH: return "-";
@@ -40,137 +43,182 @@ inline std::string to_str(Piece piece) {
   }
 }
 
+namespace detail {
+
+inline char piece_char(Piece piece) {
+  switch(piece) {
+  case Piece::FLAT: return 'F';
+  case Piece::WALL: return 'S';
+  case Piece::CAP: return 'C';
+  default: return '?';
+  }
+}
+
 template<uint8_t SIZE>
-std::string to_str(Move<SIZE> move) {
-  std::string m;
-  switch(move.type()) {
-  case Move<SIZE>::Type::MOVE: {
-    int x = 0;
-    for(int i = 1; i <= move.range(); i++) { 
-      x += move.slides(i);
-    }
-    if(x > 1) {
-      m.push_back('0'+x);
-    }
-    m.push_back('a'+move.idx()%SIZE);
-    m.push_back('1'+move.idx()/SIZE);
-    m += to_str<SIZE>(move.dir());
-    if(move.range() != 1) {
-      for(int i = 1; i <= move.range(); i++) { 
-        m.push_back('0'+move.slides(i));
-      }
-    }
-    return m;
+inline char dir_char(typename Move<SIZE>::Dir dir) {
+  switch(dir) {
+  case Move<SIZE>::Dir::NORTH: return '+';
+  case Move<SIZE>::Dir::SOUTH: return '-';
+  case Move<SIZE>::Dir::EAST: return '>';
+  case Move<SIZE>::Dir::WEST: return '<';
+  default: return '?';
   }
+}
+
+inline char dir_char(DynamicMove::Dir dir) {
+  switch(dir) {
+  case DynamicMove::Dir::NORTH: return '+';
+  case DynamicMove::Dir::SOUTH: return '-';
+  case DynamicMove::Dir::EAST: return '>';
+  case DynamicMove::Dir::WEST: return '<';
+  default: return '?';
+  }
+}
+
+// The count is left out when it's one, and the drops when they all
+// land on the one square
+template<typename M>
+inline char* write_spread(M move, char* p, int x, int y, char dir) {
+  int count = 0;
+  for(int i = 1; i <= move.range(); i++) count += move.slides(i);
+  if(count > 1) *p++ = '0'+count;
+  *p++ = 'a'+x;
+  *p++ = '1'+y;
+  *p++ = dir;
+  if(move.range() != 1) {
+    for(int i = 1; i <= move.range(); i++) *p++ = '0'+move.slides(i);
+  }
+  return p;
+}
+
+inline char lower(char c) {
+  return c >= 'A' && c <= 'Z' ? c-'A'+'a' : c;
+}
+
+} // namespace detail
+
+// Write move to buf, which has room for MAX_LEN chars, NUL terminated.
+// Returns the length without the NUL.
+template<uint8_t SIZE>
+size_t write(const Move<SIZE>& move, char* buf) {
+  char* p = buf;
+  int x = move.idx()%SIZE, y = move.idx()/SIZE;
+  switch(move.type()) {
+  case Move<SIZE>::Type::MOVE:
+    p = detail::write_spread(move, p, x, y, detail::dir_char<SIZE>(move.dir()));
+    break;
   case Move<SIZE>::Type::PLACE:
-    m += to_str(move.pieceType());
-    m.push_back('a'+move.idx()%SIZE);
-    m.push_back('1'+move.idx()/SIZE);
-    return m;
+    *p++ = detail::piece_char(move.pieceType());
+    *p++ = 'a'+x;
+    *p++ = '1'+y;
+    break;
   default:
-    return "?";
+    *p++ = '?';
   }
+  *p = '\0';
+  return p-buf;
 }
 
-std::string to_str(DynamicMove move) {
-  std::string m;
+inline size_t write(DynamicMove move, char* buf) {
+  char* p = buf;
   switch(move.type()) {
-  case DynamicMove::Type::MOVE: {
-    int x = 0;
-    for(int i = 1; i <= move.range(); i++) { 
-      x += move.slides(i);
-    }
-    if(x > 1) {
-      m.push_back('0'+x);
-    }
-    m.push_back('a'+move.x());
-    m.push_back('1'+move.y());
-    m += to_str(move.dir());
-    if(move.range() != 1) {
-      for(int i = 1; i <= move.range(); i++) { 
-        m.push_back('0'+move.slides(i));
-      }
-    }
-    return m;
-  }
+  case DynamicMove::Type::MOVE:
+    p = detail::write_spread(move, p, move.x(), move.y(), detail::dir_char(move.dir()));
+    break;
   case DynamicMove::Type::PLACE:
-    m += to_str(move.pieceType());
-    m.push_back('a'+move.x());
-    m.push_back('1'+move.y());
-    return m;
+    *p++ = detail::piece_char(move.pieceType());
+    *p++ = 'a'+move.x();
+    *p++ = '1'+move.y();
+    break;
   default:
-    return "?";
+    *p++ = '?';
   }
+  *p = '\0';
+  return p-buf;
 }
 
 template<uint8_t SIZE>
-bool from_str(std::string ptn, Move<SIZE>& move) {
-  std::transform(ptn.begin(), ptn.end(), ptn.begin(), ::tolower);
-  std::regex place_rgx("([fsc]?)([a-f][1-8])");
-  std::regex move_rgx("([1-8]?)([a-f][1-8])([-+<>])([1-8]*)");
-  std::smatch match;
-
-  if(std::regex_match(ptn, match, place_rgx)) {
-    Piece type = Piece::FLAT;
-    if(match[1].str().size()) {
-      switch(match[1].str()[0]) {
-      case 'f': type = Piece::FLAT; break;
-      case 's': type = Piece::WALL; break;
-      case 'c': type = Piece::CAP; break;
-      }
-    }
-
-    uint8_t file = match[2].str()[0] - 'a';
-    uint8_t rank = match[2].str()[1] - '1';
-    if(file > SIZE-1 || rank > SIZE-1) return false;
-    uint8_t idx = file+rank*SIZE;
-    move = Move<SIZE>(idx, type);
+std::string to_str(Move<SIZE> move) {
+  char buf[MAX_LEN];
+  return std::string(buf, write(move, buf));
+}
 
-    return true;
-  } else if(std::regex_match(ptn, match, move_rgx)) {
-    typedef typename Move<SIZE>::Dir Dir;
-    uint8_t num_pieces = 1;
-    if(match[1].str().size()) {
-      num_pieces = match[1].str()[0]-'0';
-    }
+inline std::string to_str(DynamicMove move) {
+  char buf[MAX_LEN];
+  return std::string(buf, write(move, buf));
+}
 
-    uint8_t file = match[2].str()[0] - 'a';
-    uint8_t rank = match[2].str()[1] - '1';
-    if(file > SIZE-1 || rank > SIZE-1) return false;
-    uint8_t idx = file+rank*SIZE;
-
-    Dir dir;
-    switch(match[3].str()[0]) {
-    case '+': dir = Dir::NORTH; break;
-    case '-': dir = Dir::SOUTH; break;
-    case '>': dir = Dir::EAST; break;
-    case '<': dir = Dir::WEST; break;
+// Parse a placement ([FSC]a1) or a spread (3a1>12), in either case.
+// The whole of ptn has to be the move, and it has to be one that could
+// be made on a board of SIZE: on the board, carrying no more than SIZE
+// pieces, and dropping them all.
+template<uint8_t SIZE>
+bool from_str(util::string_view ptn, Move<SIZE>& move) {
+  const char* p = ptn.data();
+  const char* end = p + ptn.size();
+  if(p == end) return false;
+
+  // A count starts a spread, a piece a placement. c and f are files
+  // too, so it's only a piece if there's a file after it.
+  int count = 0;
+  bool piece = false;
+  Piece type = Piece::FLAT;
+  if(*p >= '1' && *p <= '8') {
+    count = *p++-'0';
+  } else if(end-p > 1 && detail::lower(p[1]) >= 'a' && detail::lower(p[1]) <= 'z') {
+    switch(detail::lower(*p)) {
+    case 'f': break;
+    case 's': type = Piece::WALL; break;
+    case 'c': type = Piece::CAP; break;
     default: return false;
     }
+    piece = true;
+    p++;
+  }
 
-    uint8_t slides[SIZE-1] = { 0 };
-    uint8_t slides_sum = 0;
-    uint8_t range = match[4].str().size();
-    if(range > SIZE-1) return false;
-    for(int i = 0; i < range; i++) {
-      slides[i] = match[4].str()[i]-'0';
-      slides_sum += slides[i];
-    }
-
-    if(range == 0) {
-      range = 1;
-      slides[0] = num_pieces;
-      slides_sum = num_pieces;
-    }
-
-    if(slides_sum != num_pieces) return false;
-
-    move = Move<SIZE>(idx, dir, range, slides);
+  if(end-p < 2) return false;
+  unsigned file = detail::lower(p[0])-'a';
+  unsigned rank = p[1]-'1';
+  if(file > SIZE-1u || rank > SIZE-1u) return false;
+  uint8_t idx = file+rank*SIZE;
+  p += 2;
 
+  if(p == end) {
+    if(count) return false;
+    move = Move<SIZE>(idx, type);
     return true;
   }
+  if(piece) return false;
+
+  typedef typename Move<SIZE>::Dir Dir;
+  Dir dir;
+  switch(*p++) {
+  case '+': dir = Dir::NORTH; break;
+  case '-': dir = Dir::SOUTH; break;
+  case '>': dir = Dir::EAST; break;
+  case '<': dir = Dir::WEST; break;
+  default: return false;
+  }
+
+  if(!count) count = 1;
+  if(count > SIZE) return false;
+  uint8_t slides[SIZE-1] = { 0 };
+  int range = 0, sum = 0;
+  for(; p != end; p++) {
+    int d = *p-'0';
+    if(d < 1 || d > 8 || range == SIZE-1) return false;
+    slides[range++] = d;
+    sum += d;
+  }
+  if(range == 0) {
+    range = 1;
+    slides[0] = count;
+    sum = count;
+  }
+  if(sum != count) return false;
 
-  return false;
+  move = Move<SIZE>(idx, dir, range, slides);
+  return true;
 }
 
 } // namespace ptn
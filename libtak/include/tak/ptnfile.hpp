@@ -0,0 +1,230 @@
+#pragma once
+
+#include <istream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdlib>
+
+#include "util.hpp"
+#include "board.hpp"
+#include "ptn.hpp"
+#include "tps.hpp"
+
+namespace ptn {
+
+// Reads the games in a stream of PTN a move at a time, so neither the
+// stream nor any one game has to fit in memory:
+//
+//   ptn::Reader<5> reader(in);
+//   while(reader.next_game()) {
+//     Move<5> m;
+//     while(reader.next(m)) {
+//       // reader.position() is the board m is played from
+//     }
+//   }
+//
+// Games start from the position in their TPS tag if they have one.
+// Move numbers, comments, the marks annotating moves, results and the
+// -- before black's first move in games starting with black are
+// skipped over, and the tags of the next game end the moves of the
+// last. Games on other sizes of board (by their Size tag) have no moves.
+template<uint8_t SIZE>
+class Reader {
+public:
+  explicit Reader(std::istream& in) :
+    in(in), pos(0), comment(false), at_tags(false), in_game(false), size_(0), moved(false), ply_(0) {}
+
+  // Skip what's left of this game and read the next one's tags. False
+  // at the end of the stream.
+  bool next_game() {
+    util::string_view token;
+    while(in_game && next_token(token)) {}
+    at_tags = false;
+    in_game = false;
+
+    tags.clear();
+    board = Board<SIZE>();
+    moved = false;
+    ply_ = 0;
+    result_.clear();
+    error_.clear();
+
+    bool any = false;
+    while(pos < line.size() || read_line()) {
+      while(pos < line.size() && is_space(line[pos])) pos++;
+      if(pos == line.size()) continue;
+      if(line[pos] != '[') break;
+      add_tag(util::string_view(line).substr(pos));
+      pos = line.size();
+      any = true;
+    }
+    if(!any && pos >= line.size()) return false;
+    in_game = true;
+
+    size_ = std::atoi(tag("Size").c_str());
+    result_ = tag("Result");
+    const std::string& t = tag("TPS");
+    if(t.size() && !tps::from_str(t, board)) {
+      error_ = "Bad TPS " + t;
+    }
+    return true;
+  }
+
+  // The next move of the game, with position() the board it's played
+  // from. False once there are no more, or if one isn't a legal move
+  // (which error() then says).
+  bool next(Move<SIZE>& move) {
+    if(moved) {
+      board.execute(last);
+      ply_++;
+      moved = false;
+    }
+    if(error_.size() || (size_ && size_ != SIZE)) return false;
+
+    util::string_view token;
+    while(next_token(token)) {
+      // Move numbers, the -- standing in for white's move when a game
+      // starts with black to move, and results
+      if(token.size() && token.data()[token.size()-1] == '.') continue;
+      if(token == "--") continue;
+      if(is_result(token)) {
+        result_.assign(token.data(), token.size());
+        continue;
+      }
+      // Marks annotating the move
+      size_t n = token.size();
+      while(n && is_mark(token.data()[n-1])) n--;
+      token = token.substr(0, n);
+      if(!token.size()) continue;
+
+      if(!from_str<SIZE>(token, last)) {
+        error_ = "Bad move " + std::string(token.data(), token.size());
+        return false;
+      }
+      if(!board.valid(last)) {
+        error_ = "Illegal move " + std::string(token.data(), token.size());
+        return false;
+      }
+      move = last;
+      moved = true;
+      return true;
+    }
+    return false;
+  }
+
+  // The position the last move read is played from, or after all of
+  // them once next has returned false
+  const Board<SIZE>& position() const { return board; }
+
+  // Moves played before position()
+  int ply() const { return ply_; }
+
+  // A tag of this game, empty if it doesn't have it
+  const std::string& tag(const std::string& name) const {
+    static const std::string none;
+    for(const auto& t : tags) {
+      if(t.first == name) return t.second;
+    }
+    return none;
+  }
+
+  // From the Size tag, 0 if there isn't one
+  int size() const { return size_; }
+
+  // The result after the moves, or in the Result tag if they haven't
+  // got to it yet. Empty if neither says.
+  const std::string& result() const { return result_; }
+
+  const std::string& error() const { return error_; }
+
+private:
+  std::istream& in;
+  std::string line;
+  size_t pos;
+  // In a comment carried on from an earlier line
+  bool comment;
+  // The line read is the next game's tags
+  bool at_tags;
+  // Between next_game and the end of that game's moves
+  bool in_game;
+
+  std::vector<std::pair<std::string, std::string>> tags;
+  int size_;
+  Board<SIZE> board;
+  // The move last returned by next, still to be played on board
+  Move<SIZE> last;
+  bool moved;
+  int ply_;
+  std::string result_;
+  std::string error_;
+
+  static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  }
+
+  static bool is_mark(char c) {
+    return c == '\'' || c == '!' || c == '?' || c == '"' || c == '*';
+  }
+
+  static bool is_result(util::string_view t) {
+    return t == "R-0" || t == "0-R" || t == "F-0" || t == "0-F" || t == "1-0" || t == "0-1" ||
+           t == "1/2-1/2" || t == "0-0";
+  }
+
+  bool read_line() {
+    pos = 0;
+    if(std::getline(in, line)) return true;
+    line.clear();
+    return false;
+  }
+
+  // [Name "Value"]
+  void add_tag(util::string_view t) {
+    size_t space = t.find(' ');
+    size_t open = t.find('"');
+    if(space == util::string_view::npos || open == util::string_view::npos) return;
+    size_t close = t.find('"', open+1);
+    if(close == util::string_view::npos) return;
+    tags.push_back(std::make_pair(std::string(t.data()+1, space-1),
+                                  std::string(t.data()+open+1, close-open-1)));
+  }
+
+  // The next word of the moves, which points into line and so only
+  // lasts until the next call. False at the next game's tags or the
+  // end of the stream.
+  bool next_token(util::string_view& token) {
+    if(at_tags) return false;
+    while(true) {
+      if(pos >= line.size()) {
+        if(!read_line()) return false;
+        if(!comment) {
+          size_t first = 0;
+          while(first < line.size() && is_space(line[first])) first++;
+          if(first < line.size() && line[first] == '[') {
+            at_tags = true;
+            return false;
+          }
+        }
+      }
+      if(comment) {
+        size_t close = line.find('}', pos);
+        pos = close == std::string::npos ? line.size() : close+1;
+        comment = close == std::string::npos;
+        continue;
+      }
+      while(pos < line.size() && is_space(line[pos])) pos++;
+      if(pos == line.size()) continue;
+      if(line[pos] == '{') {
+        comment = true;
+        continue;
+      }
+      size_t begin = pos;
+      while(pos < line.size() && !is_space(line[pos]) && line[pos] != '{') pos++;
+      token = util::string_view(line.data()+begin, pos-begin);
+      return true;
+    }
+  }
+};
+
+} // namespace ptn
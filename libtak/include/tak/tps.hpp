@@ -1,126 +1,169 @@
 #pragma once
 
-#include <sstream>
-#include <regex>
+#include <string>
+#include <cstdint>
+#include <utility>
+#include "util.hpp"
 #include "board.hpp"
 
 namespace tps {
-inline std::string to_str(Stack& stack) {
-  if(stack.height) {
-    std::string s;
-    uint64_t owners = stack.owners;
-    for(int i = stack.height-1; i >= 0; i--) {
-      if(owners&1) {
-        s.insert(0, "2");
-      } else {
-        s.insert(0, "1");
-      }
-      owners >>= 1;
-    }
 
-    if(stack.top == Piece::CAP) {
-      s += "C";
-    } else if(stack.top == Piece::WALL) {
-      s += "S";
-    }
-    return s;
-  } else {
-    return "x";
+// Append stack to out, bottom piece first
+inline void write(const Stack& stack, std::string& out) {
+  if(!stack.height) {
+    out += 'x';
+    return;
+  }
+  for(int i = stack.height-1; i >= 0; i--) {
+    out += (stack.owners>>i)&1 ? '2' : '1';
+  }
+  if(stack.top == Piece::CAP) {
+    out += 'C';
+  } else if(stack.top == Piece::WALL) {
+    out += 'S';
   }
 }
 
+inline std::string to_str(const Stack& stack) {
+  std::string s;
+  write(stack, s);
+  return s;
+}
+
+// Append board to out
 template<uint8_t SIZE>
-std::string to_str(Board<SIZE>& board) {
-  std::string b;
-  for(int j = SIZE-1; j >= 0; j--) {
+void write(const Board<SIZE>& board, std::string& out) {
+  auto empty = [&out](int n) {
+    out += 'x';
+    if(n > 1) out += '0'+n;
+  };
+  for(int y = SIZE-1; y >= 0; y--) {
     int num_prev_empty = 0;
-    for(int i = 0; i < SIZE; i++) {
-      if(board.board[i+j*SIZE].height == 0) {
+    for(int x = 0; x < SIZE; x++) {
+      const Stack& s = board.board[x+y*SIZE];
+      if(!s.height) {
         num_prev_empty++;
-        if(i == SIZE-1) {
-          b += "x"+(num_prev_empty > 1 ? std::to_string(num_prev_empty) : "");
-        }
-      } else {
-        if(num_prev_empty > 0) {
-          b += "x"+(num_prev_empty > 1 ? std::to_string(num_prev_empty) : "")+",";
-          num_prev_empty = 0;
-        }
-        b += to_str(board.board[i+j*SIZE]);
-        if(i < SIZE-1) b += ",";
+        continue;
       }
+      if(num_prev_empty) {
+        empty(num_prev_empty);
+        out += ',';
+        num_prev_empty = 0;
+      }
+      write(s, out);
+      if(x < SIZE-1) out += ',';
     }
-    if(j > 0) b += "/";
+    if(num_prev_empty) empty(num_prev_empty);
+    if(y > 0) out += '/';
   }
 
-  b += board.curPlayer == WHITE ? " 1 " : " 2 ";
-  b += std::to_string(board.round);
-
-  return b;
+  out += board.curPlayer == WHITE ? " 1 " : " 2 ";
+  char digits[10];
+  int n = 0;
+  uint32_t round = board.round;
+  do {
+    digits[n++] = '0'+round%10;
+    round /= 10;
+  } while(round);
+  while(n) out += digits[--n];
 }
 
 template<uint8_t SIZE>
-bool from_str(std::string tps, Board<SIZE>& board) {
-  std::string sq_reg = "(?:x[1-9]?|[12]+[SC]?)";
-  std::string row_reg = "(?:"+sq_reg+",){0,"+std::to_string(SIZE-1)+"}(?:"+sq_reg+")";
-  std::string board_reg = "(?:"+row_reg+"\\/){"+std::to_string(SIZE-1)+"}(?:"+row_reg+")";
-  std::string tps_str = "("+board_reg+") ([12]) ([0-9]+)";
-  std::regex tps_rgx(tps_str);
-  std::cout << tps_str << std::endl;
+std::string to_str(const Board<SIZE>& board) {
+  std::string s;
+  s.reserve(4*SIZE*SIZE);
+  write(board, s);
+  return s;
+}
 
-  std::smatch match;
-  if(std::regex_search(tps, match, tps_rgx)) {
-    board.curPlayer = std::stoi(match[2].str()) - 1;
-    board.round = std::stoi(match[3].str());
+// Parse a position in TPS: the rows from the top down, the player to
+// move and the move number. Only whitespace may come before or after.
+//
+// The board's hash and reserves are worked out from the pieces on it,
+// so it's as good as one reached by playing moves. If tps isn't a
+// position on a board of SIZE (or uses more pieces than there are)
+// board is left as it was.
+template<uint8_t SIZE>
+bool from_str(util::string_view tps, Board<SIZE>& board) {
+  const char* p = tps.data();
+  const char* end = p + tps.size();
+  auto space = [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+  while(p != end && space(*p)) p++;
 
-    std::istringstream b(match[1].str());
-    std::string row;
-    int y = SIZE-1;
-    while(std::getline(b, row, '/')) {
-      std::istringstream r(row);
-      std::string square;
-      int x = 0;
-      while(std::getline(r, square, ',')) {
-        if(square[0] == 'x') {
-          int num = 1;
-          if(square.size() > 1) {
-            num = square[1]-'0';
-          }
-          int end = x+num;
-          if((end-1)/SIZE != x/SIZE) return false;
-          for(; x < end; x++) {
-            int idx = x+y*SIZE;
-            board.board[idx].height = 0;
-            board.board[idx].owners = 0;
-            board.board[idx].top = Piece::FLAT;
-          }
-        } else {
-          int idx = x+y*SIZE;
-          for(char c : square) {
-            board.board[idx].top = Piece::FLAT;
-            if(c == '1') {
-              board.board[idx].owners <<= 1;
-              board.board[idx].height += 1;
-            } else if(c == '2') {
-              board.board[idx].owners <<= 1;
-              board.board[idx].owners |= 1;
-              board.board[idx].height += 1;
-            } else if(c == 'S') {
-              board.board[idx].top = Piece::WALL;
-            } else if(c == 'C') {
-              board.board[idx].top = Piece::CAP;
-            }
-          }
-          x++;
+  Board<SIZE> b;
+  // What's on the board of each player's: flats and walls, and caps
+  int stones[2] = { 0, 0 };
+  int caps[2] = { 0, 0 };
+  for(int y = SIZE-1; y >= 0; y--) {
+    int x = 0;
+    while(true) {
+      if(p == end || x == SIZE) return false;
+      if(*p == 'x') {
+        p++;
+        int n = 0;
+        while(p != end && *p >= '0' && *p <= '9' && n <= SIZE) n = n*10 + *p++-'0';
+        if(!n) n = 1;
+        if(x+n > SIZE) return false;
+        x += n;
+      } else {
+        Stack& s = b.board[x+y*SIZE];
+        for(; p != end && (*p == '1' || *p == '2'); p++) {
+          if(s.height == 64) return false;
+          int owner = *p-'1';
+          s.owners = s.owners<<1 | owner;
+          s.height++;
+          stones[owner]++;
+        }
+        if(!s.height) return false;
+        if(p != end && *p == 'C') {
+          s.top = Piece::CAP;
+          stones[s.owner()]--;
+          caps[s.owner()]++;
+          p++;
+        } else if(p != end && *p == 'S') {
+          s.top = Piece::WALL;
+          p++;
         }
+        x++;
       }
-
-      y--;
+      if(p == end || *p != ',') break;
+      p++;
+    }
+    if(x != SIZE) return false;
+    if(y > 0) {
+      if(p == end || *p != '/') return false;
+      p++;
     }
+  }
 
-    return true;
-  } else {
+  if(p == end || *p++ != ' ') return false;
+  if(p == end || (*p != '1' && *p != '2')) return false;
+  b.curPlayer = *p++ == '1' ? WHITE : BLACK;
+  if(p == end || *p++ != ' ') return false;
+  uint64_t round = 0;
+  const char* digits = p;
+  while(p != end && *p >= '0' && *p <= '9' && round <= UINT32_MAX) round = round*10 + *p++-'0';
+  if(p == digits || round == 0 || round > UINT32_MAX) return false;
+  b.round = round;
+  while(p != end && space(*p)) p++;
+  if(p != end) return false;
+
+  // The first piece each player places is the other's, but it's taken
+  // from their own reserve (see Board::execute)
+  if(b.round == 1 && b.curPlayer == BLACK) {
+    std::swap(stones[WHITE], stones[BLACK]);
+  }
+  if(stones[WHITE] > num_flats<SIZE>::value || stones[BLACK] > num_flats<SIZE>::value ||
+     caps[WHITE] > num_caps<SIZE>::value || caps[BLACK] > num_caps<SIZE>::value) {
     return false;
   }
+  b.white.flats = num_flats<SIZE>::value - stones[WHITE];
+  b.white.caps = num_caps<SIZE>::value - caps[WHITE];
+  b.black.flats = num_flats<SIZE>::value - stones[BLACK];
+  b.black.caps = num_caps<SIZE>::value - caps[BLACK];
+  b.rehash();
+  board = b;
+  return true;
 }
 
 } // namespace tps
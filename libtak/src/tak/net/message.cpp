@@ -1,5 +1,4 @@
 #include <sstream>
-#include <regex>
 #include "tak/net/message.hpp"
 
 namespace tak {
@@ -139,74 +138,117 @@ const std::string ClientMsg::text() { return msg; }
 //                   Server Messages                     //
 // ----------------------------------------------------- //
 
-// There's probably better ways to implement this, but this is easy
-std::regex welcome_rgx("^Welcome!");
-std::regex login_prompt_rgx("^Login or Register");
-std::regex login_succes_rgx("^Welcome ([^!]+)!");
-std::regex game_add_rgx("^GameList Add Game#([0-9]+) ([^ ]+) vs ([^ ]+), ([0-9]+)x([0-9]+), ([0-9]+), ([0-9]+), ([0-9]+) half-moves played, ([^ ]+) to move");
-std::regex game_remove_rgx("^GameList Remove Game#([0-9]+) ([^ ]+) vs ([^ ]+), ([0-9]+)x([0-9]+), ([0-9]+), ([0-9]+), ([0-9]+) half-moves played, ([^ ]+) to move");
-std::regex game_start_rgx("^Game Start ([0-9]+) ([3-8]) ([^ ]+) vs ([^ ]+) (white|black)");
-std::regex place_rgx("^Game#([0-9]+) P ([A-F][1-8])(?: ([CW]))?");
-std::regex move_rgx("^Game#([0-9]+) M ([A-F][1-8]) ([A-F][1-8])((?: [1-8])+)");
-std::regex time_rgx("^Game#([0-9]+) Time ([0-9]+) ([0-9]+)");
-std::regex game_over_rgx("^Game#([0-9]+) Over (.*)");
-std::regex draw_offer_rgx("^Game#([0-9]+) OfferDraw");
-std::regex draw_cancel_rgx("^Game#([0-9]+) RemoveDraw");
-std::regex undo_req_rgx("^Game#([0-9]+) RequestUndo");
-std::regex undo_cancel_rgx("^Game#([0-9]+) RemoveUndo");
-std::regex undo_rgx("^Game#([0-9]+) Undo");
-std::regex game_abandon_rgx("^Game#([0-9]+) Abandoned");
-std::regex seek_new_rgx("^Seek new ([0-9]+) ([^ ]+) ([3-8]) ([0-9]+)(?: ([WB]))?");
-std::regex seek_rem_rgx("^Seek remove ([0-9]+) ([^ ]+) ([3-8]) ([0-9]+)(?: ([WB]))?");
-std::regex observe_game_rgx("^Observe Game#([0-9]+) ([3-8]) ([^ ]+) vs ([^ ]+), ([0-9]+)x([0-9]+), ([0-9]+), ([0-9]+) half-moves played, ([^ ]+) to move");
-std::regex shout_rgx("^Shout <([^>]+)> (.*)");
-std::regex server_rgx("^Message (.*)");
-std::regex error_rgx("^Error (.*)");
-std::regex online_rgx("^Online ([0-9]+)");
-std::regex nok_rgx("^NOK");
-std::regex ok_rgx("^OK");
-
-ServerMsg::ServerMsg(std::string msg) : m(msg) {}
+// Server messages are read a token at a time straight out of the line,
+// without copying it or any part of it. Which message it is can almost
+// always be told from the first word.
+namespace {
 
-void ServerMsg::handle(ServerMsg::Visitor& handler) {
-  std::smatch match;
-  if(std::regex_search(m, match, welcome_rgx)) {
-    handler.welcome_msg();
-  } else if(std::regex_search(m, match, login_prompt_rgx)) {
-    handler.login_prompt_msg();
-  } else if(std::regex_search(m, match, login_succes_rgx)) {
-    handler.login_success_msg(match[1].str());
-  } else if(std::regex_search(m, match, game_add_rgx)) {
-    // Verify that the board is a square size
-    if(std::stoi(match[4].str()) != std::stoi(match[5].str())) {
-      handler.unknown_msg(m);
-    } else {
-      handler.game_add_msg(
-        std::stoi(match[1].str()), match[2].str(), match[3].str(),
-        std::stoi(match[4].str()), std::stoi(match[6].str()), std::stoi(match[7].str()),
-        std::stoi(match[8].str()), match[9].str()
-      );
+using util::string_view;
+
+// A position in a message
+struct Reader {
+  string_view s;
+  size_t pos;
+
+  Reader(string_view s) : s(s), pos(0) {}
+
+  // Skip over l if it's next
+  bool lit(string_view l) {
+    if(!s.substr(pos).starts_with(l)) return false;
+    pos += l.size();
+    return true;
+  }
+
+  bool num(int& v) {
+    size_t start = pos;
+    v = 0;
+    for(; pos < s.size() && s[pos] >= '0' && s[pos] <= '9'; pos++) {
+      v = v*10 + (s[pos]-'0');
     }
-  } else if(std::regex_search(m, match, game_remove_rgx)) {
-    handler.game_remove_msg(std::stoi(match[1].str()));
-  } else if(std::regex_search(m, match, game_start_rgx)) {
-    Player player = match[5].str() == "white" ? WHITE : BLACK;
-    handler.game_start_msg(std::stoi(match[1].str()), std::stoi(match[2].str()), match[3].str(), match[4].str(), player);
-  } else if(std::regex_search(m, match, place_rgx)) {
+    return pos > start;
+  }
+
+  // Everything up to the next c, skipping over the c
+  bool until(char c, string_view& out) {
+    size_t end = s.find(c, pos);
+    if(end == string_view::npos || end == pos) return false;
+    out = s.substr(pos, end-pos);
+    pos = end+1;
+    return true;
+  }
+
+  // A word up to the next space or the end, skipping over the space
+  bool word(string_view& out) {
+    size_t end = s.find(' ', pos);
+    if(end == string_view::npos) end = s.size();
+    if(end == pos) return false;
+    out = s.substr(pos, end-pos);
+    pos = end == s.size() ? end : end+1;
+    return true;
+  }
+
+  string_view rest() {
+    string_view r = s.substr(pos);
+    pos = s.size();
+    return r;
+  }
+
+  bool done() const { return pos >= s.size(); }
+  char peek() const { return done() ? 0 : s[pos]; }
+
+  bool square(int& x, int& y) {
+    if(pos+2 > s.size()) return false;
+    x = s[pos]-'A';
+    y = s[pos+1]-'1';
+    if(x < 0 || x > 7 || y < 0 || y > 7) return false;
+    pos += 2;
+    return true;
+  }
+
+  bool size(int& v) {
+    return num(v) && v >= 3 && v <= 8;
+  }
+};
+
+// <player1> vs <player2>, <size>x<size>, <time>, [<incr>, ]<moves> half-moves played, <player> to move
+bool game_info(Reader& r, bool incr, string_view& p1, string_view& p2, int& size, int& time, int& inc, int& moves, string_view& cur) {
+  int height;
+  if(!(r.until(' ', p1) && r.lit("vs ") && r.until(',', p2) && r.lit(" ") &&
+       r.num(size) && r.lit("x") && r.num(height) && r.lit(", ") &&
+       r.num(time) && r.lit(", "))) {
+    return false;
+  }
+  if(incr && !(r.num(inc) && r.lit(", "))) return false;
+  return r.num(moves) && r.lit(" half-moves played, ") && r.until(' ', cur) && r.lit("to move") &&
+         size == height;
+}
+
+// Seek new|remove <id> <player> <size> <time>[ W|B]
+bool seek(Reader& r, int& id, string_view& player, int& size, int& time, util::option<Player>& color) {
+  if(!(r.num(id) && r.lit(" ") && r.until(' ', player) && r.size(size) && r.lit(" ") && r.num(time))) {
+    return false;
+  }
+  if(r.lit(" W")) color = WHITE;
+  else if(r.lit(" B")) color = BLACK;
+  return true;
+}
+
+// Game#<id> followed by what happened
+bool game_msg(Reader& r, ServerMsg::Visitor& handler) {
+  int id;
+  if(!r.num(id)) return false;
+  if(r.lit(" P ")) {
+    int x, y;
+    if(!r.square(x, y)) return false;
     Piece type = Piece::FLAT;
-    if(match[3] == "C") type = Piece::CAP;
-    else if(match[3] == "W") type = Piece::WALL;
-    uint8_t x = match[2].str()[0]-'A';
-    uint8_t y = match[2].str()[1]-'1';
-    DynamicMove move(x, y, type);
-    handler.move_msg(std::stoi(match[1].str()), move);
-  } else if(std::regex_search(m, match, move_rgx)) {
-    int x1 = match[2].str()[0]-'A';
-    int y1 = match[2].str()[1]-'1';
-    int x2 = match[3].str()[0]-'A';
-    int y2 = match[3].str()[1]-'1';
+    if(r.lit(" C")) type = Piece::CAP;
+    else if(r.lit(" W")) type = Piece::WALL;
+    handler.move_msg(id, DynamicMove(x, y, type));
+  } else if(r.lit(" M ")) {
+    int x1, y1, x2, y2;
+    if(!(r.square(x1, y1) && r.lit(" ") && r.square(x2, y2))) return false;
     int range = 0;
-    DynamicMove::Dir dir;
+    DynamicMove::Dir dir = DynamicMove::Dir::NORTH;
     if(x1 == x2) {
       range = y2 - y1;
       dir = DynamicMove::Dir::NORTH;
@@ -222,103 +264,166 @@ void ServerMsg::handle(ServerMsg::Visitor& handler) {
         dir = DynamicMove::Dir::WEST;
       }
     }
-    std::istringstream slides_str(match[4].str());
-    std::string slide;
-    std::vector<uint8_t> slides;
-    int i = 0;
-    while(std::getline(slides_str, slide, ' ')) {
-      if(slide.size()) {
-        if(i >= sizeof(slides)) break;
-        slides.push_back(std::stoi(slide));
-      }
+    uint8_t slides[7];
+    int n = 0;
+    while(r.lit(" ")) {
+      int slide;
+      if(!r.num(slide) || slide < 1 || slide > 8) return false;
+      if(n < 7) slides[n++] = slide;
     }
-    DynamicMove move(x1, y1, dir, range, slides);
-    handler.move_msg(std::stoi(match[1].str()), move);
-  } else if(std::regex_search(m, match, time_rgx)) {
-    handler.time_msg(std::stoi(match[1].str()), std::stoi(match[2].str()), std::stoi(match[3].str()));
-  } else if(std::regex_search(m, match, game_over_rgx)) {
+    if(!n) return false;
+    handler.move_msg(id, DynamicMove(x1, y1, dir, range, slides, n));
+  } else if(r.lit(" Time ")) {
+    int white_time, black_time;
+    if(!(r.num(white_time) && r.lit(" ") && r.num(black_time))) return false;
+    handler.time_msg(id, white_time, black_time);
+  } else if(r.lit(" Over ")) {
+    string_view result = r.rest();
     GameStatus status;
     status.over = true;
 
-    if(match[2].str() == "R-0" || match[2].str() == "0-R") {
+    if(result == "R-0" || result == "0-R") {
       status.condition = ROAD_VICTORY;
-    } else if(match[2].str() == "F-0" || match[2].str() == "0-F") {
-      status.condition = FLAT_VICTORY;
     } else {
       status.condition = FLAT_VICTORY;
     }
 
-    if(match[2].str() == "R-0" || match[2].str() == "F-0") {
+    if(result == "R-0" || result == "F-0") {
       status.winner = WHITE;
-    } else if(match[2].str() == "0-R" || match[2].str() == "0-F") {
+    } else if(result == "0-R" || result == "0-F") {
       status.winner = BLACK;
     } else {
       status.winner = NEITHER;
     }
 
-    handler.game_over_msg(std::stoi(match[1].str()), status);
-  } else if(std::regex_search(m, match, draw_offer_rgx)) {
-    handler.draw_offer_msg(std::stoi(match[1].str()));
-  } else if(std::regex_search(m, match, draw_cancel_rgx)) {
-    handler.draw_cancel_msg(std::stoi(match[1].str()));
-  } else if(std::regex_search(m, match, undo_req_rgx)) {
-    handler.undo_req_msg(std::stoi(match[1].str()));
-  } else if(std::regex_search(m, match, undo_cancel_rgx)) {
-    handler.undo_cancel_msg(std::stoi(match[1].str()));
-  } else if(std::regex_search(m, match, undo_rgx)) {
-    handler.undo_msg(std::stoi(match[1].str()));
-  } else if(std::regex_search(m, match, game_abandon_rgx)) {
-    handler.game_abandon_msg(std::stoi(match[1].str()));
-  } else if(std::regex_search(m, match, seek_new_rgx)) {
-    util::option<Player> player;
-    if(match[5].str() == "W") {
-      player = WHITE;
-    } else if(match[5].str() == "B") {
-      player = BLACK;
-    }
+    handler.game_over_msg(id, status);
+  } else if(r.lit(" OfferDraw")) {
+    handler.draw_offer_msg(id);
+  } else if(r.lit(" RemoveDraw")) {
+    handler.draw_cancel_msg(id);
+  } else if(r.lit(" RequestUndo")) {
+    handler.undo_req_msg(id);
+  } else if(r.lit(" RemoveUndo")) {
+    handler.undo_cancel_msg(id);
+  } else if(r.lit(" Undo")) {
+    handler.undo_msg(id);
+  } else if(r.lit(" Abandoned")) {
+    handler.game_abandon_msg(id);
+  } else {
+    return false;
+  }
+  return true;
+}
 
-    Seek seek(
-      std::stoi(match[1].str()), match[2].str(),
-      std::stoi(match[3].str()), std::stoi(match[4].str()), player
-    );
-    handler.seek_new_msg(seek);
-  } else if(std::regex_search(m, match, seek_rem_rgx)) {
-    util::option<Player> player;
-    if(match[5].str() == "W") {
-      player = WHITE;
-    } else if(match[5].str() == "B") {
-      player = BLACK;
+bool dispatch(Reader& r, ServerMsg::Visitor& handler) {
+  switch(r.peek()) {
+  case 'G':
+    if(r.lit("Game#")) {
+      return game_msg(r, handler);
+    } else if(r.lit("GameList Add Game#")) {
+      int id, size, time, incr, moves;
+      string_view p1, p2, cur;
+      if(!(r.num(id) && r.lit(" ") && game_info(r, true, p1, p2, size, time, incr, moves, cur))) return false;
+      handler.game_add_msg(id, p1, p2, size, time, incr, moves, cur);
+      return true;
+    } else if(r.lit("GameList Remove Game#")) {
+      int id;
+      if(!r.num(id)) return false;
+      handler.game_remove_msg(id);
+      return true;
+    } else if(r.lit("Game Start ")) {
+      int id, size;
+      string_view p1, p2;
+      if(!(r.num(id) && r.lit(" ") && r.size(size) && r.lit(" ") &&
+           r.until(' ', p1) && r.lit("vs ") && r.until(' ', p2))) {
+        return false;
+      }
+      Player player;
+      if(r.lit("white")) player = WHITE;
+      else if(r.lit("black")) player = BLACK;
+      else return false;
+      handler.game_start_msg(id, size, p1, p2, player);
+      return true;
     }
-
-    Seek seek(
-      std::stoi(match[1].str()), match[2].str(),
-      std::stoi(match[3].str()), std::stoi(match[4].str()), player
-    );
-    handler.seek_remove_msg(seek);
-  } else if(std::regex_search(m, match, observe_game_rgx)) {
-    // Assert that board is square
-    if(std::stoi(match[4].str()) != std::stoi(match[5].str())) {
-      handler.unknown_msg(m);
-    } else {
-      handler.observe_game_msg(
-        std::stoi(match[1].str()), match[2].str(), match[3].str(),
-        std::stoi(match[4].str()), std::stoi(match[6].str()),
-        std::stoi(match[7].str()), match[8].str()
-      );
+    return false;
+  case 'W':
+    if(r.lit("Welcome!")) {
+      handler.welcome_msg();
+      return true;
+    } else if(r.lit("Welcome ")) {
+      string_view name;
+      if(!r.until('!', name)) return false;
+      handler.login_success_msg(name);
+      return true;
     }
-  } else if(std::regex_search(m, match, shout_rgx)) {
-    handler.shout_msg(match[1].str(), match[2].str());
-  } else if(std::regex_search(m, match, server_rgx)) {
-    handler.server_msg(match[1].str());
-  } else if(std::regex_search(m, match, error_rgx)) {
-    handler.error_msg(match[1].str());
-  } else if(std::regex_search(m, match, online_rgx)) {
-    handler.online_msg(std::stoi(match[1].str()));
-  } else if(std::regex_search(m, match, nok_rgx)) {
+    return false;
+  case 'L':
+    if(!r.lit("Login or Register")) return false;
+    handler.login_prompt_msg();
+    return true;
+  case 'S': {
+    bool add = r.lit("Seek new ");
+    if(add || r.lit("Seek remove ")) {
+      int id, size, time;
+      string_view player;
+      util::option<Player> color;
+      if(!seek(r, id, player, size, time, color)) return false;
+      Seek s(id, player.str(), size, time, color);
+      if(add) handler.seek_new_msg(s);
+      else handler.seek_remove_msg(s);
+      return true;
+    } else if(r.lit("Shout <")) {
+      string_view name;
+      if(!(r.until('>', name) && r.lit(" "))) return false;
+      handler.shout_msg(name, r.rest());
+      return true;
+    }
+    return false;
+  }
+  case 'O':
+    if(r.lit("Observe Game#")) {
+      int id, size, time, incr, moves;
+      string_view p1, p2, cur;
+      if(!(r.num(id) && r.lit(" ") && r.size(size) && r.lit(" ") &&
+           game_info(r, false, p1, p2, size, time, incr, moves, cur))) {
+        return false;
+      }
+      handler.observe_game_msg(id, p1, p2, size, time, moves, cur);
+      return true;
+    } else if(r.lit("Online ")) {
+      int n;
+      if(!r.num(n)) return false;
+      handler.online_msg(n);
+      return true;
+    } else if(r.lit("OK")) {
+      handler.ok_msg();
+      return true;
+    }
+    return false;
+  case 'M':
+    if(!r.lit("Message ")) return false;
+    handler.server_msg(r.rest());
+    return true;
+  case 'E':
+    if(!r.lit("Error ")) return false;
+    handler.error_msg(r.rest());
+    return true;
+  case 'N':
+    if(!r.lit("NOK")) return false;
     handler.nok_msg();
-  } else if(std::regex_search(m, match, ok_rgx)) {
-    handler.ok_msg();
-  } else {
+    return true;
+  default:
+    return false;
+  }
+}
+
+} // namespace
+
+ServerMsg::ServerMsg(util::string_view msg) : m(msg) {}
+
+void ServerMsg::handle(ServerMsg::Visitor& handler) {
+  Reader r(m);
+  if(!dispatch(r, handler)) {
     handler.unknown_msg(m);
   }
 }
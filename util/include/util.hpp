@@ -2,6 +2,9 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
 
 #if defined(__CUDACC__)
 #define CUDA_CALLABLE __host__ __device__
@@ -9,6 +12,15 @@
 #define CUDA_CALLABLE
 #endif
 
+// Fully unroll the loop that follows (its trip count must be a constant)
+#if defined(__CUDACC__) || defined(__clang__)
+#define UNROLL _Pragma("unroll")
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#define UNROLL _Pragma("GCC unroll 64")
+#else
+#define UNROLL
+#endif
+
 namespace util {
 #if defined(__CUDACC__)
 template<typename T>
@@ -58,6 +70,66 @@ private:
 };
 */
 
+// A read only view of characters that live somewhere else, for parsing
+// without copying. Whatever it looks at has to outlive it.
+class string_view {
+public:
+  static const size_t npos = (size_t)-1;
+
+  string_view() : p(nullptr), n(0) {}
+  string_view(const char* p, size_t n) : p(p), n(n) {}
+  string_view(const char* s) : p(s), n(std::strlen(s)) {}
+  string_view(const std::string& s) : p(s.data()), n(s.size()) {}
+
+  const char* data() const { return p; }
+  size_t size() const { return n; }
+  bool empty() const { return n == 0; }
+  char operator[](size_t i) const { return p[i]; }
+  const char* begin() const { return p; }
+  const char* end() const { return p+n; }
+
+  string_view substr(size_t pos, size_t len = npos) const {
+    pos = min(pos, n);
+    return string_view(p+pos, min(len, n-pos));
+  }
+
+  size_t find(char c, size_t pos = 0) const {
+    for(; pos < n; pos++) {
+      if(p[pos] == c) return pos;
+    }
+    return npos;
+  }
+
+  size_t find(string_view s, size_t pos = 0) const {
+    for(; pos+s.n <= n; pos++) {
+      if(std::memcmp(p+pos, s.p, s.n) == 0) return pos;
+    }
+    return npos;
+  }
+
+  bool starts_with(string_view s) const {
+    return s.n <= n && (!s.n || std::memcmp(p, s.p, s.n) == 0);
+  }
+
+  std::string str() const { return std::string(p, n); }
+
+private:
+  const char* p;
+  size_t n;
+};
+
+inline bool operator==(string_view a, string_view b) {
+  return a.size() == b.size() && (!a.size() || std::memcmp(a.data(), b.data(), a.size()) == 0);
+}
+
+inline bool operator!=(string_view a, string_view b) {
+  return !(a == b);
+}
+
+inline std::ostream& operator<<(std::ostream& os, string_view s) {
+  return os.write(s.data(), s.size());
+}
+
 extern const uint64_t base[64];
 #if defined(__CUDACC__)
 extern __constant__ uint64_t base_dev[64];